@@ -56,6 +56,37 @@ public:
     QtnPropertyUInt* cmdUdpBroadcastPort;// 广播端口
     QtnPropertyQString* dataSrvIpAddress;  // 数据服务器地址
     QtnPropertyUInt* dataSrvRemotePort;  // 通讯端口
+
+    //采集存储设置
+    QtnPropertySet* propSetCapture;
+    QtnPropertyBool* streamingSave;// 边采集边存储
+    QtnPropertyInt* streamingRingFrames;// 环形缓冲帧数
+    QtnPropertyBool* readyByInterrupt;// 中断方式检测数据就绪
+    QtnPropertyBool* sharedReadyPoll;// 共享就绪轮询线程
+    QtnPropertyBool* stripedRead;// 条带读取
+    QtnPropertyBool* barMapping;// BAR内存映射
+    QtnPropertyBool* asyncShotFlush;// 连续测量异步写盘
+    QtnPropertyBool* preTriggerCapture;// 外触发预触发采集
+    QtnPropertyInt* preTriggerMs;// 预触发时长
+    QtnPropertyInt* preTriggerMaxArmSeconds;// 最长等待触发时长
+    QtnPropertyBool* writeDirectIO;// 直接I/O写盘
+    QtnPropertyInt* writeQueueDepth;// 并发写入文件数
+    QtnPropertyBool* frameCrcCheck;// 帧CRC32C校验
+    QtnPropertyBool* crcVerifyOnRead;// 离线读取时校验CRC
+    QtnPropertyBool* zeroSuppression;// 零压缩保存
+    QtnPropertyInt* zeroSuppressThreshold;// 零压缩触发阈值
+    QtnPropertyInt* zeroSuppressPrePoints;// 零压缩触发前点数
+    QtnPropertyInt* zeroSuppressPostPoints;// 零压缩触发后点数
+    QtnPropertyInt* zeroSuppressRawEvery;// 零压缩保留原始帧间隔
+    QtnPropertyBool* losslessSave;// 无损压缩保存
+    QtnPropertyBool* containerSave;// 整炮容器保存
+    QtnPropertyBool* planarSave;// 通道分平面保存
+    QtnPropertyBool* hugePageBuffers;// 大页内存
+    QtnPropertyInt* bufferBudgetGB;// 缓冲池内存上限
+    QtnPropertyBool* threadPinning;// 绑定CPU核心
+    QtnPropertyQString* captureCpuList;// 采集线程CPU列表
+    QtnPropertyInt* schedPolicy;// 调度策略
+    QtnPropertyInt* schedPriority;// 实时优先级
 };
 
 // 在AppConfig类中添加辅助函数
@@ -276,6 +307,265 @@ AppConfig::AppConfig(QObject* parent)
         propSet->addChildProperty(d->dataSrvRemotePort);
     }
 
+    // 采集存储设置
+    baseId = ID_CAPTURE_SET;
+    {
+        QtnPropertySet* propSet = new QtnPropertySet(d->propSetRoot);
+        d->propSetCapture = propSet;
+        d->propSetRoot->addChildProperty(propSet);
+        propSet->setName("采集存储设置");
+        propSet->setId(ID_CAPTURE_SET);
+
+        // 边采集边存储
+        d->streamingSave = new QtnPropertyBool(propSet);
+        d->streamingSave->setId(++baseId);
+        d->streamingSave->setName("边采集边存储");
+        d->streamingSave->setDescription("启用后采集数据经环形缓冲实时写入硬盘，内存占用与采集时长无关（需要硬盘写入速度跟得上采集速度）");
+        d->streamingSave->setValue(false);
+
+        // 环形缓冲帧数
+        d->streamingRingFrames = new QtnPropertyInt(propSet);
+        d->streamingRingFrames->setId(++baseId);
+        d->streamingRingFrames->setName("环形缓冲帧数");
+        d->streamingRingFrames->setDescription("每个DDR的环形缓冲帧数，每帧约120MB，范围：4 ~ 256");
+        d->streamingRingFrames->setMaxValue(256);
+        d->streamingRingFrames->setMinValue(4);
+        d->streamingRingFrames->setValue(16);
+
+        // 中断方式检测数据就绪
+        d->readyByInterrupt = new QtnPropertyBool(propSet);
+        d->readyByInterrupt->setId(++baseId);
+        d->readyByInterrupt->setName("中断方式检测数据就绪");
+        d->readyByInterrupt->setDescription("启用后采集线程阻塞等待XDMA用户中断事件（events_0/events_1），不再每1ms轮询就绪寄存器；事件文件打不开时自动退回轮询");
+        d->readyByInterrupt->setValue(false);
+
+        // 共享就绪轮询线程
+        d->sharedReadyPoll = new QtnPropertyBool(propSet);
+        d->sharedReadyPoll->setId(++baseId);
+        d->sharedReadyPoll->setName("共享就绪轮询");
+        d->sharedReadyPoll->setDescription("轮询方式下由一个线程统一轮询所有采集卡所有DDR的就绪寄存器，再分发给各DDR的采集线程，否则每个DDR的采集线程各自轮询；采集结束后日志输出板间就绪偏差");
+        d->sharedReadyPoll->setValue(false);
+
+        // 条带读取
+        d->stripedRead = new QtnPropertyBool(propSet);
+        d->stripedRead->setId(++baseId);
+        d->stripedRead->setName("条带读取");
+        d->stripedRead->setDescription("启用后每帧波形拆成4段（4KB对齐）在c2h_0~3上并行读取，否则整帧只在就绪区域对应的c2h通道上读取；采集结束后日志输出各引擎速度和占用率");
+        d->stripedRead->setValue(false);
+
+        // BAR内存映射
+        d->barMapping = new QtnPropertyBool(propSet);
+        d->barMapping->setId(++baseId);
+        d->barMapping->setName("BAR内存映射");
+        d->barMapping->setDescription("启用后user/bypass通道的BAR映射到内存，读就绪寄存器和能谱数据不再经过系统调用（仅Linux驱动支持，映射失败时自动使用读写句柄）");
+        d->barMapping->setValue(false);
+
+        // 连续测量异步写盘
+        d->asyncShotFlush = new QtnPropertyBool(propSet);
+        d->asyncShotFlush->setId(++baseId);
+        d->asyncShotFlush->setName("连续测量异步写盘");
+        d->asyncShotFlush->setDescription("连续测量且不是边采集边存储时，一炮采集结束后只同步写能谱，波形在后台写盘，同时开始下一炮采集；后台写盘积压超过一炮时下一炮等待写盘完成");
+        d->asyncShotFlush->setValue(false);
+
+        // 外触发预触发采集
+        d->preTriggerCapture = new QtnPropertyBool(propSet);
+        d->preTriggerCapture->setId(++baseId);
+        d->preTriggerCapture->setName("外触发预触发采集");
+        d->preTriggerCapture->setDescription("外触发模式下点击开始测量后立即开始采集，只在内存中保留最近的预触发时长数据；收到外触发（到达触发时刻或紧急停机）时冻结并保存，再采集一炮的采集时长。采集卡的测量时间需要覆盖等待触发的时长");
+        d->preTriggerCapture->setValue(false);
+
+        // 预触发时长
+        d->preTriggerMs = new QtnPropertyInt(propSet);
+        d->preTriggerMs->setId(++baseId);
+        d->preTriggerMs->setName("预触发时长(ms)");
+        d->preTriggerMs->setDescription("触发前保留的数据时长，每40ms一帧，每个DDR每帧约120MB，范围：40 ~ 10000");
+        d->preTriggerMs->setMaxValue(10000);
+        d->preTriggerMs->setMinValue(40);
+        d->preTriggerMs->setValue(1000);
+
+        // 最长等待触发时长
+        d->preTriggerMaxArmSeconds = new QtnPropertyInt(propSet);
+        d->preTriggerMaxArmSeconds->setId(++baseId);
+        d->preTriggerMaxArmSeconds->setName("最长等待触发时长(s)");
+        d->preTriggerMaxArmSeconds->setDescription("超过该时长仍未收到触发时结束采集并保存最后一段数据，范围：1 ~ 3600");
+        d->preTriggerMaxArmSeconds->setMaxValue(3600);
+        d->preTriggerMaxArmSeconds->setMinValue(1);
+        d->preTriggerMaxArmSeconds->setValue(600);
+
+        propSet->addChildProperty(d->streamingSave);
+        propSet->addChildProperty(d->streamingRingFrames);
+        propSet->addChildProperty(d->readyByInterrupt);
+        propSet->addChildProperty(d->sharedReadyPoll);
+        propSet->addChildProperty(d->stripedRead);
+        propSet->addChildProperty(d->barMapping);
+        propSet->addChildProperty(d->asyncShotFlush);
+        propSet->addChildProperty(d->preTriggerCapture);
+        propSet->addChildProperty(d->preTriggerMs);
+        propSet->addChildProperty(d->preTriggerMaxArmSeconds);
+
+        // 直接I/O写盘
+        d->writeDirectIO = new QtnPropertyBool(propSet);
+        d->writeDirectIO->setId(++baseId);
+        d->writeDirectIO->setName("直接I/O写盘");
+        d->writeDirectIO->setDescription("绕过系统文件缓存直接写入硬盘（Linux O_DIRECT / Windows FILE_FLAG_NO_BUFFERING），并预分配文件大小");
+        d->writeDirectIO->setValue(false);
+
+        // 并发写入文件数
+        d->writeQueueDepth = new QtnPropertyInt(propSet);
+        d->writeQueueDepth->setId(++baseId);
+        d->writeQueueDepth->setName("并发写入文件数");
+        d->writeQueueDepth->setDescription("每个DDR同时在写的文件数，范围：1 ~ 32");
+        d->writeQueueDepth->setMaxValue(32);
+        d->writeQueueDepth->setMinValue(1);
+        d->writeQueueDepth->setValue(4);
+
+        // 帧CRC32C校验
+        d->frameCrcCheck = new QtnPropertyBool(propSet);
+        d->frameCrcCheck->setId(++baseId);
+        d->frameCrcCheck->setName("帧CRC32C校验");
+        d->frameCrcCheck->setDescription("每帧DMA完成后计算波形和能谱的CRC32C（支持时使用CPU硬件指令），采集结束后写入%1%2crc.txt，供离线读取时校验文件");
+        d->frameCrcCheck->setValue(true);
+
+        // 离线读取时校验CRC
+        d->crcVerifyOnRead = new QtnPropertyBool(propSet);
+        d->crcVerifyOnRead->setId(++baseId);
+        d->crcVerifyOnRead->setName("离线读取时校验CRC");
+        d->crcVerifyOnRead->setDescription("离线读取波形/能谱文件时按CRC旁路文件校验（.nbin、分平面和容器中的帧解码还原后校验，零压缩的帧不校验），校验失败的文件不参与分析；开启后单通道和按时间段读取也改为读整帧");
+        d->crcVerifyOnRead->setValue(false);
+
+        // 零压缩保存
+        d->zeroSuppression = new QtnPropertyBool(propSet);
+        d->zeroSuppression->setId(++baseId);
+        d->zeroSuppression->setName("零压缩保存");
+        d->zeroSuppression->setDescription("波形文件只保存超过阈值的脉冲窗口和每块基线，文件名不变，离线读取时自动还原；压缩在写盘线程中进行，开启后建议调大并发写入文件数");
+        d->zeroSuppression->setValue(false);
+
+        // 零压缩触发阈值
+        d->zeroSuppressThreshold = new QtnPropertyInt(propSet);
+        d->zeroSuppressThreshold->setId(++baseId);
+        d->zeroSuppressThreshold->setName("零压缩触发阈值");
+        d->zeroSuppressThreshold->setDescription("与离线分析相同的上升沿判断，超过基线该值的点作为脉冲，范围：1 ~ 16383");
+        d->zeroSuppressThreshold->setMaxValue(16383);
+        d->zeroSuppressThreshold->setMinValue(1);
+        d->zeroSuppressThreshold->setValue(100);
+
+        // 零压缩触发前点数
+        d->zeroSuppressPrePoints = new QtnPropertyInt(propSet);
+        d->zeroSuppressPrePoints->setId(++baseId);
+        d->zeroSuppressPrePoints->setName("零压缩触发前点数");
+        d->zeroSuppressPrePoints->setDescription("脉冲窗口在触发点之前保留的点数，范围：0 ~ 1024");
+        d->zeroSuppressPrePoints->setMaxValue(1024);
+        d->zeroSuppressPrePoints->setMinValue(0);
+        d->zeroSuppressPrePoints->setValue(64);
+
+        // 零压缩触发后点数
+        d->zeroSuppressPostPoints = new QtnPropertyInt(propSet);
+        d->zeroSuppressPostPoints->setId(++baseId);
+        d->zeroSuppressPostPoints->setName("零压缩触发后点数");
+        d->zeroSuppressPostPoints->setDescription("脉冲窗口在一个波形长度之后额外保留的点数，范围：0 ~ 4096");
+        d->zeroSuppressPostPoints->setMaxValue(4096);
+        d->zeroSuppressPostPoints->setMinValue(0);
+        d->zeroSuppressPostPoints->setValue(64);
+
+        // 零压缩保留原始帧间隔
+        d->zeroSuppressRawEvery = new QtnPropertyInt(propSet);
+        d->zeroSuppressRawEvery->setId(++baseId);
+        d->zeroSuppressRawEvery->setName("零压缩保留原始帧间隔");
+        d->zeroSuppressRawEvery->setDescription("每隔该帧数保存一帧原始波形用于核对阈值，在线校验出错的帧也保存原始波形；0为只保存出错帧，范围：0 ~ 100000");
+        d->zeroSuppressRawEvery->setMaxValue(100000);
+        d->zeroSuppressRawEvery->setMinValue(0);
+        d->zeroSuppressRawEvery->setValue(100);
+
+        // 无损压缩保存
+        d->losslessSave = new QtnPropertyBool(propSet);
+        d->losslessSave->setId(++baseId);
+        d->losslessSave->setName("无损压缩保存");
+        d->losslessSave->setDescription("原始波形帧写成%1%2data%3.nbin（按通道差分+位打包），离线读取时自动解码；与零压缩同时开启时只对保留原始数据的帧生效。压缩在写盘线程中进行，开启后建议调大并发写入文件数");
+        d->losslessSave->setValue(false);
+
+        // 整炮容器保存
+        d->containerSave = new QtnPropertyBool(propSet);
+        d->containerSave->setId(++baseId);
+        d->containerSave->setName("整炮容器保存");
+        d->containerSave->setDescription("每个DDR一炮只写一个%1%2shot.nsc文件，文件头带帧索引（采集卡、DDR、文件序号、偏移、包序号、时刻），代替每帧一个的data/spec文件；离线读取按原文件名自动从容器中查找");
+        d->containerSave->setValue(false);
+
+        // 通道分平面保存
+        d->planarSave = new QtnPropertyBool(propSet);
+        d->planarSave->setId(++baseId);
+        d->planarSave->setName("通道分平面保存");
+        d->planarSave->setDescription("波形帧按通道连续存放（不做零压缩和无损压缩的帧），文件名不变；只分析一个相机时只读该通道，读盘量约为原来的1/3");
+        d->planarSave->setValue(false);
+
+        propSet->addChildProperty(d->writeDirectIO);
+        propSet->addChildProperty(d->writeQueueDepth);
+        propSet->addChildProperty(d->frameCrcCheck);
+        propSet->addChildProperty(d->crcVerifyOnRead);
+        propSet->addChildProperty(d->zeroSuppression);
+        propSet->addChildProperty(d->zeroSuppressThreshold);
+        propSet->addChildProperty(d->zeroSuppressPrePoints);
+        propSet->addChildProperty(d->zeroSuppressPostPoints);
+        propSet->addChildProperty(d->zeroSuppressRawEvery);
+        propSet->addChildProperty(d->losslessSave);
+        propSet->addChildProperty(d->containerSave);
+        propSet->addChildProperty(d->planarSave);
+
+        // 大页内存
+        d->hugePageBuffers = new QtnPropertyBool(propSet);
+        d->hugePageBuffers->setId(++baseId);
+        d->hugePageBuffers->setName("大页内存");
+        d->hugePageBuffers->setDescription("DMA帧缓冲优先使用大页（Linux需要预留/proc/sys/vm/nr_hugepages，Windows需要锁定内存页权限），不可用时自动使用普通页");
+        d->hugePageBuffers->setValue(false);
+        propSet->addChildProperty(d->hugePageBuffers);
+
+        // 缓冲池内存上限
+        d->bufferBudgetGB = new QtnPropertyInt(propSet);
+        d->bufferBudgetGB->setId(++baseId);
+        d->bufferBudgetGB->setName("缓冲池内存上限(GB)");
+        d->bufferBudgetGB->setDescription("所有采集线程共用的DMA帧缓冲上限（含已归还待复用的缓冲），0表示物理内存的3/4，范围：0 ~ 4096");
+        d->bufferBudgetGB->setMaxValue(4096);
+        d->bufferBudgetGB->setMinValue(0);
+        d->bufferBudgetGB->setValue(0);
+        propSet->addChildProperty(d->bufferBudgetGB);
+
+        // 绑定CPU核心
+        d->threadPinning = new QtnPropertyBool(propSet);
+        d->threadPinning->setId(++baseId);
+        d->threadPinning->setName("绑定CPU核心");
+        d->threadPinning->setDescription("每个DDR的采集线程和4个读线程依次绑定到采集线程CPU列表中的核心");
+        d->threadPinning->setValue(false);
+
+        // 采集线程CPU列表
+        d->captureCpuList = new QtnPropertyQString(propSet);
+        d->captureCpuList->setId(++baseId);
+        d->captureCpuList->setName("采集线程CPU列表");
+        d->captureCpuList->setDescription("如：2-31,34；为空时优先使用内核参数isolcpus隔离的核心，没有隔离核心时使用除CPU0以外的全部核心；每个DDR依次占5个核心，共享就绪轮询线程使用其后的一个核心，核心不够时不绑定");
+        d->captureCpuList->setValue("");
+
+        // 调度策略
+        d->schedPolicy = new QtnPropertyInt(propSet);
+        d->schedPolicy->setId(++baseId);
+        d->schedPolicy->setName("调度策略");
+        d->schedPolicy->setDescription("0：系统默认 1：SCHED_FIFO 2：SCHED_RR（Linux需要root或CAP_SYS_NICE权限；Windows实时策略均为THREAD_PRIORITY_TIME_CRITICAL）");
+        d->schedPolicy->setMaxValue(2);
+        d->schedPolicy->setMinValue(0);
+        d->schedPolicy->setValue(0);
+
+        // 实时优先级
+        d->schedPriority = new QtnPropertyInt(propSet);
+        d->schedPriority->setId(++baseId);
+        d->schedPriority->setName("实时优先级");
+        d->schedPriority->setDescription("SCHED_FIFO/SCHED_RR的优先级，范围：1 ~ 99");
+        d->schedPriority->setMaxValue(99);
+        d->schedPriority->setMinValue(1);
+        d->schedPriority->setValue(50);
+
+        propSet->addChildProperty(d->threadPinning);
+        propSet->addChildProperty(d->captureCpuList);
+        propSet->addChildProperty(d->schedPolicy);
+        propSet->addChildProperty(d->schedPriority);
+    }
+
     this->load();
 
     // 类型安全的绑定，自动识别属性类型
@@ -425,6 +715,8 @@ QtnPropertySet* AppConfig::propertySet(int id)
         return d->propSetState;
     else if (ID_CONTROLCENTER_SET == id)
         return d->propSetControlCenter;
+    else if (ID_CAPTURE_SET == id)
+        return d->propSetCapture;
     else
         return d->propSetRoot;
 }
@@ -587,3 +879,60 @@ int AppConfig::boardcastPort() const { return d->cmdUdpBroadcastPort->value(); }
 QString AppConfig::dataSrvIpAddress() const { return d->dataSrvIpAddress->value(); }
 
 int AppConfig::dataSrvRemotePort() const { return d->dataSrvRemotePort->value(); }
+
+// 采集存储设置
+bool AppConfig::streamingSave() const { return d->streamingSave->value(); }
+
+int AppConfig::streamingRingFrames() const { return d->streamingRingFrames->value(); }
+
+bool AppConfig::readyByInterrupt() const { return d->readyByInterrupt->value(); }
+
+bool AppConfig::sharedReadyPoll() const { return d->sharedReadyPoll->value(); }
+
+bool AppConfig::stripedRead() const { return d->stripedRead->value(); }
+
+bool AppConfig::barMapping() const { return d->barMapping->value(); }
+
+bool AppConfig::asyncShotFlush() const { return d->asyncShotFlush->value(); }
+
+bool AppConfig::preTriggerCapture() const { return d->preTriggerCapture->value(); }
+
+int AppConfig::preTriggerMs() const { return d->preTriggerMs->value(); }
+
+int AppConfig::preTriggerMaxArmSeconds() const { return d->preTriggerMaxArmSeconds->value(); }
+
+bool AppConfig::writeDirectIO() const { return d->writeDirectIO->value(); }
+
+int AppConfig::writeQueueDepth() const { return d->writeQueueDepth->value(); }
+
+bool AppConfig::frameCrcCheck() const { return d->frameCrcCheck->value(); }
+
+bool AppConfig::crcVerifyOnRead() const { return d->crcVerifyOnRead->value(); }
+
+bool AppConfig::zeroSuppression() const { return d->zeroSuppression->value(); }
+
+int AppConfig::zeroSuppressThreshold() const { return d->zeroSuppressThreshold->value(); }
+
+int AppConfig::zeroSuppressPrePoints() const { return d->zeroSuppressPrePoints->value(); }
+
+int AppConfig::zeroSuppressPostPoints() const { return d->zeroSuppressPostPoints->value(); }
+
+int AppConfig::zeroSuppressRawEvery() const { return d->zeroSuppressRawEvery->value(); }
+
+bool AppConfig::losslessSave() const { return d->losslessSave->value(); }
+
+bool AppConfig::containerSave() const { return d->containerSave->value(); }
+
+bool AppConfig::planarSave() const { return d->planarSave->value(); }
+
+bool AppConfig::hugePageBuffers() const { return d->hugePageBuffers->value(); }
+
+int AppConfig::bufferBudgetGB() const { return d->bufferBudgetGB->value(); }
+
+bool AppConfig::threadPinning() const { return d->threadPinning->value(); }
+
+QString AppConfig::captureCpuList() const { return d->captureCpuList->value(); }
+
+int AppConfig::schedPolicy() const { return d->schedPolicy->value(); }
+
+int AppConfig::schedPriority() const { return d->schedPriority->value(); }
@@ -22,6 +22,9 @@ public:
 
         // 数据中心网络
         ID_CONTROLCENTER_SET = 4000,
+
+        // 采集存储设置
+        ID_CAPTURE_SET = 5000,
     };
 
     static AppConfig& instance();
@@ -51,6 +54,36 @@ public:
     QString dataSrvIpAddress() const;
     int dataSrvRemotePort() const;
 
+    // 采集存储设置
+    bool streamingSave() const;
+    int streamingRingFrames() const;
+    bool readyByInterrupt() const;
+    bool sharedReadyPoll() const;
+    bool stripedRead() const;
+    bool barMapping() const;
+    bool asyncShotFlush() const;
+    bool preTriggerCapture() const;
+    int preTriggerMs() const;
+    int preTriggerMaxArmSeconds() const;
+    bool writeDirectIO() const;
+    int writeQueueDepth() const;
+    bool frameCrcCheck() const;
+    bool crcVerifyOnRead() const;
+    bool zeroSuppression() const;
+    int zeroSuppressThreshold() const;
+    int zeroSuppressPrePoints() const;
+    int zeroSuppressPostPoints() const;
+    int zeroSuppressRawEvery() const;
+    bool losslessSave() const;
+    bool containerSave() const;
+    bool planarSave() const;
+    bool hugePageBuffers() const;
+    int bufferBudgetGB() const;
+    bool threadPinning() const;
+    QString captureCpuList() const;
+    int schedPolicy() const;
+    int schedPriority() const;
+
     // 配置操作接口
     bool save(const QString& filePath = "config.json");
     bool load(const QString& filePath = "config.json");
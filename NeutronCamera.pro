@@ -12,10 +12,15 @@ DEFINES += ENABLE_IOCP=0   #启用IO完成端口
 
 SOURCES += \
     AppConfig.cpp \
+    capturebench.cpp \
     commhelper.cpp \
     dataanalysisworker.cpp \
     datacompresswindow.cpp \
+    deadlinewaiter.cpp \
     devicemanagerwindow.cpp \
+    framebufferpool.cpp \
+    framereaderthread.cpp \
+    framevalidator.cpp \
     globalsettings.cpp \
     hdadataupload.cpp \
     main.cpp \
@@ -23,30 +28,65 @@ SOURCES += \
     n_gamma.cpp \
     offlinewindow.cpp \
     pciecommsdk.cpp \
-    pcieiocpreader.cpp \
+    planarframe.cpp \
+    pretriggerring.cpp \
     qgaugepanel.cpp \
+    readydispatcher.cpp \
+    registertransaction.cpp \
     settingwindow.cpp \
+    shotcontainer.cpp \
+    shotfilewriter.cpp \
+    shotstreamwriter.cpp \
     switchbutton.cpp \
-    waitingspinnerwidget.cpp
+    threadscheduler.cpp \
+    waitingspinnerwidget.cpp \
+    waveformcodec.cpp \
+    xdmabarmap.cpp \
+    xdmadevice.cpp \
+    zerosuppressor.cpp
 
 HEADERS += \
     AppConfig.h \
+    capturebench.h \
+    captureframe.h \
+    capturetrace.h \
     commhelper.h \
     dataanalysisworker.h \
     datacompresswindow.h \
+    deadlinewaiter.h \
     devicemanagerwindow.h \
+    framebufferpool.h \
+    framereaderthread.h \
+    framevalidator.h \
     hdadataupload.h \
     n_gamma.h \
     offlinewindow.h \
     pciecommsdk.h \
-    pcieiocpreader.h \
+    planarframe.h \
+    pretriggerring.h \
     qgaugepanel.h \
     qlitethread.h \
+    readydispatcher.h \
+    registertransaction.h \
     globalsettings.h \
     mainwindow.h \
     settingwindow.h \
+    shotcontainer.h \
+    shotfilewriter.h \
+    shotstreamwriter.h \
     switchbutton.h \
-    waitingspinnerwidget.h
+    threadscheduler.h \
+    waitingspinnerwidget.h \
+    waveformcodec.h \
+    xdmabarmap.h \
+    xdmadevice.h \
+    zerosuppressor.h
+
+# IO完成端口读取只在Windows下可用
+win32 {
+    SOURCES += pcieiocpreader.cpp
+    HEADERS += pcieiocpreader.h
+}
 
 FORMS += \
     datacompresswindow.ui \
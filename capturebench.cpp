@@ -0,0 +1,369 @@
+﻿#include "capturebench.h"
+#include "pciecommsdk.h"
+#include "xdmadevice.h"
+#include "framebufferpool.h"
+#include "readydispatcher.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QEventLoop>
+#include <QTimer>
+#include <QFile>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QDateTime>
+#include <QScopedPointer>
+#include <QDebug>
+#include <algorithm>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// 进程占用的CPU时间（us），包含写盘线程
+qint64 CaptureBench::processCpuTimeUs()
+{
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+        return 0;
+
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    return (kernel.QuadPart + user.QuadPart) / 10;// 100ns为单位
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+double CaptureBench::gbPerSecond(qint64 bytes, qint64 us)
+{
+    return us > 0 ? bytes / 1e9 / (us / 1e6) : 0.0;
+}
+
+// 百分位数和按2的幂分桶的直方图（桶上限us，只输出非空的桶）
+QJsonObject CaptureBench::histogram(QVector<qint64> samplesUs)
+{
+    QJsonObject result;
+    result["count"] = samplesUs.size();
+    if (samplesUs.isEmpty())
+        return result;
+
+    std::sort(samplesUs.begin(), samplesUs.end());
+    auto percentile = [&](double p){
+        int index = qBound(0, int(p * (samplesUs.size() - 1) + 0.5), samplesUs.size() - 1);
+        return (double)samplesUs[index];
+    };
+
+    qint64 total = 0;
+    for (qint64 sample : samplesUs)
+        total += sample;
+
+    result["minUs"] = (double)samplesUs.first();
+    result["maxUs"] = (double)samplesUs.last();
+    result["meanUs"] = (double)total / samplesUs.size();
+    result["p50Us"] = percentile(0.50);
+    result["p90Us"] = percentile(0.90);
+    result["p99Us"] = percentile(0.99);
+    result["p999Us"] = percentile(0.999);
+
+    QJsonArray buckets;
+    qint64 bound = 1;
+    int count = 0;
+    for (qint64 sample : samplesUs){
+        while (sample > bound){
+            if (count > 0){
+                QJsonObject bucket;
+                bucket["leUs"] = (double)bound;
+                bucket["count"] = count;
+                buckets.append(bucket);
+            }
+            bound *= 2;
+            count = 0;
+        }
+        count++;
+    }
+    QJsonObject bucket;
+    bucket["leUs"] = (double)bound;
+    bucket["count"] = count;
+    buckets.append(bucket);
+    result["buckets"] = buckets;
+    return result;
+}
+
+int CaptureBench::exec(const QStringList& args)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QObject::tr("采集性能基准测试（模拟采集卡）"));
+    parser.addHelpOption();
+    parser.addOption({"m", QObject::tr("运行模式"), "mode"});
+    parser.addOption({"frames", QObject::tr("每炮帧数"), "n", "100"});
+    parser.addOption({"shots", QObject::tr("炮数"), "n", "1"});
+    parser.addOption({"boards", QObject::tr("模拟采集卡数量1~3"), "n", "3"});
+    parser.addOption({"speed", QObject::tr("模拟采集卡帧率倍数"), "x", "1"});
+    parser.addOption({"ring", QObject::tr("边采集边存储的环形缓冲帧数，0为一次性内存模式"), "n", "16"});
+    parser.addOption({"queue-depth", QObject::tr("同时写入的文件数"), "n", "4"});
+    parser.addOption({"buffered", QObject::tr("写盘不使用直接I/O")});
+    parser.addOption({"interrupt", QObject::tr("用中断事件检测数据就绪")});
+    parser.addOption({"own-poller", QObject::tr("每个DDR的采集线程各自轮询就绪寄存器，不使用共享轮询线程")});
+    parser.addOption({"striped", QObject::tr("每帧拆成4段在c2h_0~3上并行读取")});
+    parser.addOption({"no-crc", QObject::tr("不计算帧CRC32C")});
+    parser.addOption({"async-flush", QObject::tr("一次性内存模式下波形在后台写盘，与下一炮采集重叠")});
+    parser.addOption({"hugepages", QObject::tr("DMA帧缓冲使用大页内存")});
+    parser.addOption({"save", QObject::tr("数据保存目录，不指定时不写盘"), "dir"});
+    parser.addOption({"out", QObject::tr("JSON结果文件，不指定时输出到标准输出"), "file"});
+    parser.process(args);
+
+    quint32 frames = qMax(1u, parser.value("frames").toUInt());
+    int shots = qMax(1, parser.value("shots").toInt());
+    int ringFrames = parser.value("ring").toInt();
+    bool streaming = ringFrames > 0;
+    bool saveToDisk = parser.isSet("save");
+    FrameBufferPool::instance().setHugePages(parser.isSet("hugepages"));
+    FrameBufferPool::instance().setCacheLimit(-1);
+
+    // 模拟采集卡在第一次创建时读取环境变量
+    if (!XdmaDevice::fakeDeviceEnabled())
+        qputenv("NEUTRON_FAKE_XDMA", QDir::tempPath().toLocal8Bit());
+    qputenv("NEUTRON_FAKE_XDMA_BOARDS", parser.value("boards").toLocal8Bit());
+    qputenv("NEUTRON_FAKE_XDMA_SPEED", parser.value("speed").toLocal8Bit());
+
+    // 不写盘时采集日志（.inf）放到临时目录
+    QTemporaryDir tempDir;
+    QString savePath = saveToDisk ? parser.value("save") : tempDir.path();
+    QDir().mkpath(savePath);
+
+    QStringList devices = XdmaDevice::enumFakeDevices();
+    QList<CaptureThread*> threads;
+    for (int deviceIndex = 1; deviceIndex <= devices.size() * 2; ++deviceIndex){
+        bool isDDR1 = deviceIndex <= devices.size();
+        quint32 physicalNo = (deviceIndex - 1) % devices.size() + 1;
+        CaptureThread *captureThread = new CaptureThread(deviceIndex, physicalNo, devices[physicalNo-1], isDDR1);
+        captureThread->setParamter(savePath, frames * PACKET_TIMELENGTH, !saveToDisk);
+        captureThread->setStreamingMode(streaming, ringFrames);
+        captureThread->setReadyMode(parser.isSet("interrupt"), !parser.isSet("own-poller"));
+        captureThread->setReadMode(parser.isSet("striped"));
+        captureThread->setWriterOptions(parser.value("queue-depth").toInt(), !parser.isSet("buffered"));
+        captureThread->setValidateMode(!parser.isSet("no-crc"));
+        captureThread->setFlushMode(parser.isSet("async-flush"));
+        captureThread->start();
+        threads.append(captureThread);
+    }
+
+    QVector<DdrResult> results(threads.size());
+    for (int i=0; i<threads.size(); ++i){
+        results[i].physicalNo = threads[i]->physicalNo();
+        results[i].isDDR1 = threads[i]->isDDR1();
+    }
+
+    qint64 frameBytes = XdmaRegDef::DDR_FRAME_SIZE + XdmaRegDef::RAM_FRAME_SIZE;
+    QScopedPointer<XdmaDevice> probe(XdmaDevice::create(devices.first()));
+    qint64 periodMs = qMax<qint64>(1, probe->framePeriodNs() / 1000000);
+    qint64 benchCpuUs = processCpuTimeUs();
+    qint64 dispatcherCpuUs = ReadyDispatcher::instance().cpuTimeUs();
+    quint64 dispatcherSweeps = ReadyDispatcher::instance().sweeps();
+    QVector<qint64> readySkewUs[2];// DDR1、DDR2各自的板间就绪偏差
+    QElapsedTimer benchTimer;
+    benchTimer.start();
+    bool timeout = false;
+    for (int shot = 0; shot < shots && !timeout; ++shot){
+        QEventLoop loop;
+        int remaining = threads.size();
+        for (CaptureThread* captureThread : threads){
+            QObject::connect(captureThread, &CaptureThread::captureFinished, &loop, [&](quint32, bool){
+                if (--remaining == 0)
+                    loop.quit();
+            });
+        }
+        QTimer::singleShot(int(frames * periodMs + 30000), &loop, [&](){
+            timeout = true;
+            loop.quit();
+        });
+
+        for (CaptureThread* captureThread : threads)
+            captureThread->resume();
+        loop.exec();
+        if (timeout){
+            qCritical() << "基准测试超时，第" << shot + 1 << "炮";
+            break;
+        }
+
+        // 线程已经暂停，本炮的统计不会再变化
+        for (int i=0; i<threads.size(); ++i){
+            const CaptureThread* captureThread = threads[i];
+            const CaptureThread::ShotTiming& timing = captureThread->shotTiming();
+            DdrResult& result = results[i];
+            quint32 captured = captureThread->capturedFrames();
+            for (quint32 frameNo = 1; frameNo <= captured && frameNo < (quint32)timing.readyNs.size(); ++frameNo){
+                if (timing.dmaEndNs[frameNo] <= 0)
+                    continue;// 丢弃或超时的帧
+
+                result.readyToDmaUs.append((timing.dmaStartNs[frameNo] - timing.readyNs[frameNo]) / 1000);
+                result.dmaUs.append((timing.dmaEndNs[frameNo] - timing.dmaStartNs[frameNo]) / 1000);
+                if (timing.diskDoneNs[frameNo] > 0)
+                    result.dmaToDiskUs.append((timing.diskDoneNs[frameNo] - timing.dmaEndNs[frameNo]) / 1000);
+                result.bytes += frameBytes;
+            }
+            result.frames += captured;
+            result.droppedFrames += captureThread->droppedFrames();
+            result.faultFrames += captureThread->faultFrames();
+            result.wallUs += captureThread->captureWallTimeUs();
+            result.pollerCpuUs += captureThread->pollerCpuTimeUs();
+            for (int step=0; step<4; ++step){
+                result.readerCpuUs[step] += timing.readerCpuUs[step];
+                result.engineBytes[step] += timing.engineBytes[step];
+                result.engineBusyNs[step] += timing.engineBusyNs[step];
+            }
+        }
+
+        for (int side=0; side<2; ++side){
+            QList<QVector<qint64>> readyClockNs;
+            for (const CaptureThread* captureThread : threads){
+                if (captureThread->isDDR1() == (side == 0))
+                    readyClockNs.append(captureThread->shotTiming().readyClockNs);
+            }
+            for (qint64 skewNs : ReadyDispatcher::edgeSkewNs(readyClockNs))
+                readySkewUs[side].append(skewNs / 1000);
+        }
+    }
+    qint64 benchWallUs = benchTimer.nsecsElapsed() / 1000;
+    benchCpuUs = processCpuTimeUs() - benchCpuUs;
+    dispatcherCpuUs = ReadyDispatcher::instance().cpuTimeUs() - dispatcherCpuUs;
+    dispatcherSweeps = ReadyDispatcher::instance().sweeps() - dispatcherSweeps;
+
+    for (CaptureThread* captureThread : threads){
+        captureThread->stop();
+        captureThread->wait();
+    }
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+
+    // 汇总输出
+    bool passed = !timeout;
+    QJsonArray ddrArray;
+    QMap<quint32, QPair<qint64, qint64>> boardTotals;// 卡号 -> 字节数、两个DDR中较长的采集时长
+    for (const DdrResult& result : results){
+        QJsonObject ddr;
+        ddr["board"] = (int)result.physicalNo;
+        ddr["ddr"] = result.isDDR1 ? "DDR1" : "DDR2";
+        ddr["frames"] = (int)result.frames;
+        ddr["droppedFrames"] = (int)result.droppedFrames;
+        ddr["faultFrames"] = (int)result.faultFrames;
+        ddr["bytes"] = (double)result.bytes;
+        ddr["wallUs"] = (double)result.wallUs;
+        ddr["sustainedGBps"] = gbPerSecond(result.bytes, result.wallUs);
+
+        QJsonObject latency;
+        latency["readyToDma"] = histogram(result.readyToDmaUs);
+        latency["dma"] = histogram(result.dmaUs);
+        latency["dmaToDisk"] = histogram(result.dmaToDiskUs);
+        ddr["latency"] = latency;
+
+        QJsonObject cpu;
+        cpu["pollerUs"] = (double)result.pollerCpuUs;
+        QJsonArray readers;
+        for (int step=0; step<4; ++step)
+            readers.append((double)result.readerCpuUs[step]);
+        cpu["readersUs"] = readers;
+        ddr["cpuTime"] = cpu;
+
+        QJsonArray engines;
+        for (int engine=0; engine<4; ++engine){
+            QJsonObject engineObj;
+            engineObj["channel"] = QString("c2h_%1").arg(engine);
+            engineObj["bytes"] = (double)result.engineBytes[engine];
+            engineObj["busyUs"] = (double)(result.engineBusyNs[engine] / 1000);
+            engineObj["busyGBps"] = gbPerSecond(result.engineBytes[engine], result.engineBusyNs[engine] / 1000);
+            engineObj["utilization"] = result.wallUs > 0 ? result.engineBusyNs[engine] / 1000.0 / result.wallUs : 0.0;
+            engines.append(engineObj);
+        }
+        ddr["engines"] = engines;
+        ddrArray.append(ddr);
+
+        QPair<qint64, qint64>& board = boardTotals[result.physicalNo];
+        board.first += result.bytes;
+        board.second = qMax(board.second, result.wallUs);
+
+        if (result.frames < frames * shots || result.droppedFrames > 0 || result.faultFrames > 0)
+            passed = false;
+    }
+
+    QJsonArray boardArray;
+    qint64 totalBytes = 0;
+    for (auto iter = boardTotals.constBegin(); iter != boardTotals.constEnd(); ++iter){
+        QJsonObject board;
+        board["board"] = (int)iter.key();
+        board["bytes"] = (double)iter.value().first;
+        board["sustainedGBps"] = gbPerSecond(iter.value().first, iter.value().second);
+        boardArray.append(board);
+        totalBytes += iter.value().first;
+    }
+
+    QJsonObject config;
+    config["frames"] = (int)frames;
+    config["shots"] = shots;
+    config["boards"] = devices.size();
+    config["framePeriodUs"] = (double)periodMs * 1000;
+    config["saveMode"] = streaming ? "streaming" : "memory";
+    config["ringFrames"] = ringFrames;
+    config["saveToDisk"] = saveToDisk;
+    config["directIO"] = !parser.isSet("buffered");
+    config["queueDepth"] = parser.value("queue-depth").toInt();
+    config["readyByInterrupt"] = parser.isSet("interrupt");
+    config["sharedReadyPoll"] = !parser.isSet("own-poller");
+    config["stripedRead"] = parser.isSet("striped");
+    config["frameCrc"] = !parser.isSet("no-crc");
+    config["asyncFlush"] = parser.isSet("async-flush");
+    config["hugePages"] = FrameBufferPool::instance().hugePages();
+
+    QJsonObject total;
+    total["bytes"] = (double)totalBytes;
+    total["wallUs"] = (double)benchWallUs;
+    total["sustainedGBps"] = gbPerSecond(totalBytes, benchWallUs);
+    total["processCpuUs"] = (double)benchCpuUs;
+
+    // 共享轮询线程的CPU时间在睡眠前更新，最多少算最后一帧的自旋
+    QJsonObject dispatcher;
+    dispatcher["cpuUs"] = (double)dispatcherCpuUs;
+    dispatcher["sweeps"] = (double)dispatcherSweeps;
+
+    QJsonObject readySkew;
+    readySkew["DDR1"] = histogram(readySkewUs[0]);
+    readySkew["DDR2"] = histogram(readySkewUs[1]);
+
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    root["passed"] = passed;
+    root["config"] = config;
+    root["ddrs"] = ddrArray;
+    root["boards"] = boardArray;
+    root["total"] = total;
+    root["readyDispatcher"] = dispatcher;
+    root["readySkew"] = readySkew;
+
+    QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Indented);
+    if (parser.isSet("out")){
+        QFile file(parser.value("out"));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)){
+            qCritical().noquote() << "基准测试结果保存失败：" << file.fileName();
+            return 1;
+        }
+        file.write(json);
+    }
+    else{
+        std::cout << json.constData() << std::flush;
+    }
+
+    if (timeout)
+        return 2;
+    return passed ? 0 : 1;
+}
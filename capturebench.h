@@ -0,0 +1,48 @@
+﻿#ifndef CAPTUREBENCH_H
+#define CAPTUREBENCH_H
+
+#include <QStringList>
+#include <QJsonObject>
+#include <QVector>
+
+/**
+ * CaptureBench 采集性能基准测试
+ * 不启动界面，用模拟采集卡（NEUTRON_FAKE_XDMA）按正式流程跑CaptureThread，统计：
+ *   逐帧延迟直方图：就绪->开始DMA、DMA耗时、DMA完成->落盘
+ *   每个DDR和每张卡的持续吞吐（GB/s）
+ *   采集线程、读线程CPU时间和进程总CPU时间
+ *   c2h_0~3各引擎的忙时速度和占用率（对比--striped判断受PCIe链路还是DMA引擎限制）
+ * 结果输出为JSON，用于比较pciecommsdk.cpp修改前后的性能。
+ * 用法：NeutronCamera -m bench [--frames 100] [--shots 1] [--boards 3] [--speed 1] [--ring 16] [--striped] [--save 目录] [--out 结果.json]
+ * 采集帧数不足、丢帧或校验失败时返回1，超时返回2。
+ */
+class CaptureBench
+{
+public:
+    static int exec(const QStringList& args);
+
+private:
+    // 一个DDR所有炮次累计的结果
+    struct DdrResult {
+        quint32 physicalNo = 0;
+        bool isDDR1 = true;
+        QVector<qint64> readyToDmaUs;
+        QVector<qint64> dmaUs;
+        QVector<qint64> dmaToDiskUs;
+        quint32 frames = 0;
+        quint32 droppedFrames = 0;
+        quint32 faultFrames = 0;
+        qint64 bytes = 0;
+        qint64 wallUs = 0;
+        qint64 pollerCpuUs = 0;
+        qint64 readerCpuUs[4] = {0};
+        qint64 engineBytes[4] = {0};
+        qint64 engineBusyNs[4] = {0};
+    };
+
+    static QJsonObject histogram(QVector<qint64> samplesUs);
+    static double gbPerSecond(qint64 bytes, qint64 us);
+    static qint64 processCpuTimeUs();
+};
+
+#endif // CAPTUREBENCH_H
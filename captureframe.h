@@ -0,0 +1,42 @@
+﻿#ifndef CAPTUREFRAME_H
+#define CAPTUREFRAME_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QMetaType>
+#include <QSharedPointer>
+#include "framebufferpool.h"
+
+/**
+ * CaptureFrame DMA完成的一帧（只读）
+ * 直接引用DMA写入的缓冲池内存，不复制：写盘、在线校验、实时显示等环节共享同一块缓冲。
+ * 通过CaptureFrameHandle原子引用计数，最后一个持有者释放后缓冲才归还（环形缓冲的槽位或缓冲池），
+ * 所以持有句柄期间缓冲不会被下一帧或下一炮覆盖；长时间持有会占住环形缓冲，形成反压。
+ */
+struct CaptureFrame {
+    quint32 physicalNo = 0;     // 采集卡编号 1~3
+    bool isDDR1 = true;
+    quint32 frameNo = 0;        // 包序号，从1开始
+    quint8 step = 0;            // DDR区域 0~3
+    bool readOk = false;        // DMA是否成功
+    quint32 faults = 0;         // 在线校验结果，见FrameValidator::Fault
+    qint64 readyNs = 0;         // 检测到就绪（相对开始测量）
+    qint64 captureUtcNs = 0;    // 帧开始时刻（UTC，ns），实测就绪时刻减一个包时长，0为未知
+    qint64 dmaStartNs = 0;
+    qint64 dmaEndNs = 0;
+    FrameBufferHandle waveformBuffer;
+    FrameBufferHandle spectrumBuffer;
+    qint64 waveformSize = 0;    // 有效长度
+    qint64 spectrumSize = 0;
+
+    const char* waveformData() const { return waveformBuffer ? waveformBuffer->data() : nullptr; }
+    const char* spectrumData() const { return spectrumBuffer ? spectrumBuffer->data() : nullptr; }
+    /*不拷贝的QByteArray视图，生命周期不能超过句柄*/
+    QByteArray waveform() const { return QByteArray::fromRawData(waveformData(), int(waveformSize)); }
+    QByteArray spectrum() const { return QByteArray::fromRawData(spectrumData(), int(spectrumSize)); }
+};
+
+typedef QSharedPointer<const CaptureFrame> CaptureFrameHandle;
+Q_DECLARE_METATYPE(CaptureFrameHandle)
+
+#endif // CAPTUREFRAME_H
@@ -0,0 +1,64 @@
+﻿#ifndef CAPTURETRACE_H
+#define CAPTURETRACE_H
+
+#include <QtGlobal>
+#include <vector>
+
+// 一次读寄存器的记录
+struct CaptureTraceRecord {
+    quint32 frame;      // 包序号
+    quint8 value;       // 寄存器值
+    quint8 flags;       // 见CaptureTraceRing::Flag
+    qint64 before;      // 读寄存器前时刻（ns，相对开始测量）
+    qint64 after;       // 读寄存器后时刻（ns，相对开始测量）
+};
+
+/**
+ * CaptureTraceRing 采集计时记录环
+ * 容量固定，构造时一次性分配，写入只做下标运算和结构体赋值，不会在轮询热路径上分配内存。
+ * 单写者：只允许采集线程写入，采集结束后由同一线程读取，不需要加锁。
+ * 写满后覆盖最旧的记录，overwritten()返回被覆盖的条数。
+ */
+class CaptureTraceRing
+{
+public:
+    enum Flag {
+        ZeroBeforeData = 0x01   // 正式数据包之前出现的寄存器0值
+    };
+
+    explicit CaptureTraceRing(quint32 capacityPow2 = 1u << 16)
+        : mRecords(capacityPow2)
+        , mMask(capacityPow2 - 1)
+    {
+        Q_ASSERT((capacityPow2 & mMask) == 0);
+    }
+
+    void clear() { mCount = 0; }
+
+    inline void push(quint32 frame, quint8 value, qint64 before, qint64 after, quint8 flags = 0){
+        CaptureTraceRecord& record = mRecords[mCount & mMask];
+        record.frame = frame;
+        record.value = value;
+        record.flags = flags;
+        record.before = before;
+        record.after = after;
+        ++mCount;
+    }
+
+    quint32 capacity() const { return mMask + 1; }
+    quint64 totalCount() const { return mCount; }
+    quint32 size() const { return mCount < capacity() ? (quint32)mCount : capacity(); }
+    quint64 overwritten() const { return mCount - size(); }
+
+    /*按写入顺序取第index条（0为保留下来的最旧记录）*/
+    const CaptureTraceRecord& at(quint32 index) const {
+        return mRecords[(mCount - size() + index) & mMask];
+    }
+
+private:
+    std::vector<CaptureTraceRecord> mRecords;
+    quint64 mMask;
+    quint64 mCount = 0;
+};
+
+#endif // CAPTURETRACE_H
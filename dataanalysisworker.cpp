@@ -1,7 +1,36 @@
 ﻿#include "dataanalysisworker.h"
 #include "globalsettings.h"
+#include "zerosuppressor.h"
+#include "waveformcodec.h"
+#include "shotcontainer.h"
+#include "planarframe.h"
+#include "framevalidator.h"
+#include "AppConfig.h"
 #include <cstring> // std::memcpy
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    // 映射文件中的一段并提示内核按顺序预读，offset不必页对齐（QFile::map内部处理）
+    uchar* mapRange(QFile& file, qint64 offset, qint64 size)
+    {
+        uchar* p = file.map(offset, size);
+#ifndef _WIN32
+        if (p && size > 0){
+            const quintptr pageSize = quintptr(sysconf(_SC_PAGESIZE));
+            uchar* aligned = reinterpret_cast<uchar*>(quintptr(p) & ~(pageSize - 1));
+            const size_t length = size_t(size + (p - aligned));
+            madvise(aligned, length, MADV_SEQUENTIAL);
+            madvise(aligned, length, MADV_WILLNEED);
+        }
+#endif
+        return p;
+    }
+}
+
 // ========== DataAnalysisWorker 实现 ==========
 
 DataAnalysisWorker::DataAnalysisWorker(QObject *parent)
@@ -76,21 +105,174 @@ bool DataAnalysisWorker::readBin3Ch_fast(const QString& filePath,
                                          QVector<quint16>& ch2,
                                          bool littleEndian /*= true*/)
 {
-    // 打开文件进行只读访问
-    QFile f(filePath);
-    if (!f.open(QIODevice::ReadOnly)) return false;
-    QByteArray buf = f.readAll();;
-    f.close();
+    // 按原文件名读取，.bin不存在时依次查找无损压缩的.nbin和整炮容器
+    QByteArray buf;
+    if (!ShotContainer::readFile(filePath, buf)) return false;
+
+    // 按CRC旁路文件校验，损坏的文件不参与分析
+    if (AppConfig::instance().crcVerifyOnRead()
+        && FrameValidator::verifyFrame(filePath, buf) == FrameValidator::CrcMismatch){
+        qWarning().noquote() << "文件CRC校验失败：" << filePath;
+        return false;
+    }
 
     return DataAnalysisWorker::readBin3Ch_fast(buf, ch0, ch1, ch2, littleEndian);
 }
 
+bool DataAnalysisWorker::readBinChannel(const QString& filePath,
+                                        int channel,
+                                        QVector<quint16>& data,
+                                        bool littleEndian/* = true*/)
+{
+    if (channel < 0 || channel > 2)
+        return false;
+
+    // 分平面文件：先读文件头页，再只读该通道的平面（需要校验CRC时读整帧）
+    QByteArray page;
+    PlanarFrame::PlanarHeader header;
+    if (!AppConfig::instance().crcVerifyOnRead()
+        && ShotContainer::readFileRange(filePath, 0, PlanarFrame::kHeaderPage, page)
+        && PlanarFrame::readHeader(page.constData(), page.size(), header)){
+        const qint64 planeBytes = qint64(header.samplesPerChannel) * 2;
+        QByteArray plane;
+        if (!ShotContainer::readFileRange(filePath, header.planeOffset[channel], planeBytes, plane) || plane.size() != planeBytes)
+            return false;
+
+        data.resize(int(header.samplesPerChannel));
+        std::memcpy(data.data(), plane.constData(), planeBytes);
+        if (!littleEndian){
+            for (quint16& v : data)
+                v = qbswap(v);
+        }
+        return true;
+    }
+
+    QVector<quint16> ch[3];
+    if (!DataAnalysisWorker::readBin3Ch_fast(filePath, ch[0], ch[1], ch[2], littleEndian))
+        return false;
+    data = ch[channel];
+    return true;
+}
+
+bool DataAnalysisWorker::readBinChannelRange(const QString& filePath,
+                                             int channel,
+                                             qint64 first,
+                                             qint64 count,
+                                             QVector<quint16>& data,
+                                             qint64& samplesPerChannel,
+                                             bool littleEndian/* = true*/)
+{
+    if (channel < 0 || channel > 2 || first < 0)
+        return false;
+
+    // 零压缩和.nbin只能整帧解码后截取
+    auto readWhole = [&]() -> bool {
+        QVector<quint16> ch;
+        if (!DataAnalysisWorker::readBinChannel(filePath, channel, ch, littleEndian))
+            return false;
+        samplesPerChannel = ch.size();
+        const qint64 from = qMin<qint64>(first, ch.size());
+        data = ch.mid(int(from), count < 0 ? -1 : int(qMin(count, ch.size() - from)));
+        return true;
+    };
+
+    // 需要校验CRC时只能读整帧
+    QString physicalPath;
+    qint64 base = 0;
+    qint64 frameSize = 0;
+    if (AppConfig::instance().crcVerifyOnRead() || !ShotContainer::locate(filePath, physicalPath, base, frameSize))
+        return readWhole();
+
+    QFile file(physicalPath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    // 先映射文件头页判断格式
+    const qint64 pageSize = qMin<qint64>(frameSize, PlanarFrame::kHeaderPage);
+    uchar* page = file.map(base, pageSize);
+    if (!page)
+        return readWhole();
+
+    const QByteArray pageData = QByteArray::fromRawData(reinterpret_cast<const char*>(page), int(pageSize));
+    PlanarFrame::PlanarHeader header;
+    const bool planar = PlanarFrame::readHeader(pageData.constData(), pageData.size(), header);
+    const bool encoded = !planar && (ZeroSuppressor::isSuppressed(pageData) || WaveformCodec::isEncoded(pageData));
+    file.unmap(page);
+    if (encoded)
+        return readWhole();
+
+    const qint64 headBytes = 12;
+    const qint64 tailBytes = 12;
+    if (planar){
+        samplesPerChannel = qint64(header.samplesPerChannel);
+    }
+    else {
+        const qint64 payloadBytes = frameSize - headBytes - tailBytes;
+        if (payloadBytes < 0 || payloadBytes % 12 != 0)
+            return false;
+        samplesPerChannel = payloadBytes / 6;
+    }
+
+    first = qMin(first, samplesPerChannel);
+    count = (count < 0) ? samplesPerChannel - first : qMin(count, samplesPerChannel - first);
+    data.resize(int(count));
+    if (count == 0)
+        return true;
+
+    if (planar){
+        // 分平面：直接映射该通道平面中的一段
+        uchar* p = mapRange(file, base + qint64(header.planeOffset[channel]) + first * 2, count * 2);
+        if (!p)
+            return readWhole();
+        std::memcpy(data.data(), p, count * 2);
+        file.unmap(p);
+    }
+    else {
+        // 原始交织帧：每6个quint16为一组（ch0,ch0,ch1,ch1,ch2,ch2），只映射覆盖该范围的组
+        const qint64 firstGroup = first / 2;
+        const qint64 lastGroup = (first + count + 1) / 2;
+        uchar* p = mapRange(file, base + headBytes + firstGroup * 12, (lastGroup - firstGroup) * 12);
+        if (!p)
+            return readWhole();
+
+        const quint16* src = reinterpret_cast<const quint16*>(p) + channel * 2;
+        quint16* dst = data.data();
+        for (qint64 i = 0, j = first; i < count; ++i, ++j)
+            dst[i] = src[((j >> 1) - firstGroup) * 6 + (j & 1)];
+        file.unmap(p);
+    }
+
+    if (!littleEndian){
+        for (quint16& v : data)
+            v = qbswap(v);
+    }
+    return true;
+}
+
 bool DataAnalysisWorker::readBin3Ch_fast(const QByteArray& fileData,
                                          QVector<quint16>& ch0,
                                          QVector<quint16>& ch1,
                                          QVector<quint16>& ch2,
                                          bool littleEndian/* = true*/)
 {
+    // 零压缩保存的波形文件先还原成原始帧格式
+    if (ZeroSuppressor::isSuppressed(fileData))
+        return DataAnalysisWorker::readBin3Ch_fast(ZeroSuppressor::expand(fileData), ch0, ch1, ch2, littleEndian);
+
+    // 无损压缩和分平面的文件直接解码到各通道，不经过原始帧
+    if (WaveformCodec::isEncoded(fileData) || PlanarFrame::isPlanar(fileData)){
+        bool ok = WaveformCodec::isEncoded(fileData) ? WaveformCodec::decodeChannels(fileData, ch0, ch1, ch2)
+                                                     : PlanarFrame::decodeChannels(fileData, ch0, ch1, ch2);
+        if (!ok)
+            return false;
+        if (!littleEndian){
+            for (QVector<quint16>* ch : {&ch0, &ch1, &ch2})
+                for (quint16& v : *ch)
+                    v = qbswap(v);
+        }
+        return true;
+    }
+
     // 文件头和文件尾字节数（当前设置为0，表示不使用文件头尾）
     // 注释掉的代码显示原始格式可能有16字节的文件头和文件尾
     const qint64 headBytes = 12;
@@ -256,6 +438,7 @@ QVector<qint16> DataAnalysisWorker::adjustDataWithBaseline(QVector<quint16>& dat
             result[i] = baseline_ch - data_ch[i];
         }
     }
+    return result;
 }
 
 // 提取超过阈值的有效波形数据
@@ -482,7 +665,7 @@ void DataAnalysisWorker::getValidWave()
 
                 const QString fileName = tempFileList[deviceIndex-1][i];// QString("%1data%2.bin").arg(deviceIndex).arg(fileID);
                 const QString filePath = QDir(dataDir).filePath(fileName);
-                if (!QFile::exists(filePath)){
+                if (!ShotContainer::exists(filePath)){
                     emit logMessage(QString("采集卡%1 文件%2: 不存在").arg(cardName).arg(fileName), QtWarningMsg);
                     continue;
                 }
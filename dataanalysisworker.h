@@ -56,6 +56,23 @@ public:
                                 QVector<quint16>& ch2,
                                 bool littleEndian = true);
 
+    // 只读取一个通道（0~2）的波形，分平面存储的文件只读文件头页和该通道的平面，其余格式读整帧后解交织
+    static bool readBinChannel(const QString& filePath,
+                               int channel,
+                               QVector<quint16>& data,
+                               bool littleEndian = true);
+
+    // 只读取一个通道中[first, first+count)范围内的采样点，count<0表示读到末尾，超出部分截断
+    // 原始帧和分平面文件（含容器中的帧）内存映射后只解码该范围，零压缩和.nbin整帧解码后截取
+    // samplesPerChannel返回该通道的总采样点数
+    static bool readBinChannelRange(const QString& filePath,
+                                    int channel,
+                                    qint64 first,
+                                    qint64 count,
+                                    QVector<quint16>& data,
+                                    qint64& samplesPerChannel,
+                                    bool littleEndian = true);
+
     // 计算基线值：使用直方图方法，找到出现频率最高的值作为基线
     // 当波形信号过多时，该方法明显会出现问题（暂时采用该方法）
     static qint16 calculateBaseline(const QVector<quint16>& data_ch);
@@ -190,9 +207,12 @@ public:
     }
 
     void run() override {
-        // 1) 从 buffer 解交织出 4 通道
+        // 1) 从 buffer 解交织出 4 通道，只处理单个相机时只读该通道
         QVector<quint16> ch[3];
-        if (!DataAnalysisWorker::readBin3Ch_fast(mJob.filePath, ch[0], ch[1], ch[2], true)) {
+        bool readOk = mCameraIndex != 0
+                ? DataAnalysisWorker::readBinChannel(mJob.filePath, (mCameraIndex - 1) % 3, ch[(mCameraIndex - 1) % 3], true)
+                : DataAnalysisWorker::readBin3Ch_fast(mJob.filePath, ch[0], ch[1], ch[2], true);
+        if (!readOk) {
             if (mOnFinished) mOnFinished();
             return;
         }
@@ -10,6 +10,7 @@
 #include <QDir>
 #include "globalsettings.h"
 #include "waitingspinnerwidget.h"
+#include "shotcontainer.h"
 
 #include <array>
 #include <QVector>
@@ -437,11 +438,12 @@ QStringList DataCompressWindow::loadRelatedFiles(const QString& dirPath)
     }
 
     // 使用静态函数获取.bin文件列表
-    QFileInfoList fileinfoList = getBinFileList(dirPath);
+    ShotContainer::FrameFiles containerFrames;
+    QFileInfoList fileinfoList = getBinFileList(dirPath, &containerFrames);
     mfileinfoList = fileinfoList;
 
     // 使用静态函数统计总大小
-    qint64 totalSize = calculateTotalSize(fileinfoList);
+    qint64 totalSize = calculateTotalSize(fileinfoList, containerFrames);
     int fileCount = fileinfoList.size();
     
     // 使用静态函数提取文件名列表
@@ -468,15 +470,19 @@ QStringList DataCompressWindow::loadRelatedFiles(const QString& dirPath)
         auto *itemName = new QTableWidgetItem(fi.fileName());
         itemName->setFlags(itemName->flags() ^ Qt::ItemIsEditable);
 
-        auto *itemBytes = new QTableWidgetItem(locale.toString(fi.size()));
+        // 整炮容器中的帧大小和时间取自容器索引，不查询文件系统
+        auto frame = containerFrames.constFind(fi.fileName());
+        const bool inContainer = frame != containerFrames.constEnd();
+        const qint64 fileSize = inContainer ? frame->size : fi.size();
+        auto *itemBytes = new QTableWidgetItem(locale.toString(fileSize));
         itemBytes->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
         itemBytes->setFlags(itemBytes->flags() ^ Qt::ItemIsEditable);
 
-        auto *itemHuman = new QTableWidgetItem(humanReadableSize(fi.size()));
+        auto *itemHuman = new QTableWidgetItem(humanReadableSize(fileSize));
         itemHuman->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
         itemHuman->setFlags(itemHuman->flags() ^ Qt::ItemIsEditable);
 
-        auto *itemTime = new QTableWidgetItem(fi.lastModified().toString("yyyy-MM-dd HH:mm:ss"));
+        auto *itemTime = new QTableWidgetItem((inContainer ? frame->modified : fi.lastModified()).toString("yyyy-MM-dd HH:mm:ss"));
         itemTime->setFlags(itemTime->flags() ^ Qt::ItemIsEditable);
 
         ui->tableWidget_file->setItem(i, 0, itemName);
@@ -562,7 +568,7 @@ QString DataCompressWindow::humanReadableSize(qint64 bytes)
 #include <algorithm>
 #include <atomic>
 #include <thread>
-QFileInfoList DataCompressWindow::getBinFileList(const QString& dirPath)
+QFileInfoList DataCompressWindow::getBinFileList(const QString& dirPath, ShotContainer::FrameFiles* containerFrames)
 {
     QFileInfoList fileinfoList;
     
@@ -571,15 +577,22 @@ QFileInfoList DataCompressWindow::getBinFileList(const QString& dirPath)
         return fileinfoList;  // 返回空列表
     }
 
-    // 仅过滤 .bin 文件，按名称排序
+    // 仅过滤 .bin 文件（含无损压缩的 .nbin），按名称排序
     QStringList filters;
-    filters << "*.bin";
+    filters << "*.bin" << "*.nbin";
     fileinfoList = dir.entryInfoList(
         filters,
         QDir::Files | QDir::NoSymLinks,   // 只要文件
         QDir::Unsorted    // 不排序了，后面手动排序
     );
 
+    // 整炮容器中的帧按原文件名列出，读取时由ShotContainer::readFile从容器中查找
+    ShotContainer::FrameFiles frames = ShotContainer::frameFiles(dirPath);
+    for (const ShotContainer::FrameFile& frame : qAsConst(frames))
+        fileinfoList.append(QFileInfo(dir.filePath(frame.fileName)));
+    if (containerFrames)
+        containerFrames->swap(frames);
+
     // 过滤掉能谱文件
     QFileInfoList result;
     for (auto item : fileinfoList){
@@ -597,11 +610,12 @@ QFileInfoList DataCompressWindow::getBinFileList(const QString& dirPath)
 }
 
 // 计算文件信息列表的总大小
-qint64 DataCompressWindow::calculateTotalSize(const QFileInfoList& fileinfoList)
+qint64 DataCompressWindow::calculateTotalSize(const QFileInfoList& fileinfoList, const ShotContainer::FrameFiles& containerFrames)
 {
     qint64 totalSize = 0;
     for (const QFileInfo& fi : fileinfoList) {
-        totalSize += fi.size();
+        auto frame = containerFrames.constFind(fi.fileName());
+        totalSize += frame != containerFrames.constEnd() ? frame->size : fi.size();// 整炮容器中的帧
     }
     return totalSize;
 }
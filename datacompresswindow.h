@@ -18,6 +18,7 @@
 #include <thread>
 
 #include "dataanalysisworker.h"
+#include "shotcontainer.h"
 
 namespace Ui {
 class DataCompressWindow;
@@ -39,11 +40,11 @@ public:
     // 给出容量的最佳表示方法
     static QString humanReadableSize(qint64 bytes);
 
-    // 从目录获取所有.bin文件列表（按名称排序）
-    static QFileInfoList getBinFileList(const QString& dirPath);
+    // 从目录获取所有.bin文件列表（按名称排序），containerFrames返回其中来自整炮容器的帧（大小、时间取自容器索引）
+    static QFileInfoList getBinFileList(const QString& dirPath, ShotContainer::FrameFiles* containerFrames = nullptr);
 
-    // 计算文件信息列表的总大小
-    static qint64 calculateTotalSize(const QFileInfoList& fileinfoList);
+    // 计算文件信息列表的总大小，整炮容器中的帧按containerFrames中的大小计算
+    static qint64 calculateTotalSize(const QFileInfoList& fileinfoList, const ShotContainer::FrameFiles& containerFrames = ShotContainer::FrameFiles());
 
     // 从文件信息列表提取文件名列表
     static QStringList extractFileNames(const QFileInfoList& fileinfoList);
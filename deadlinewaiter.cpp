@@ -0,0 +1,116 @@
+﻿#include "deadlinewaiter.h"
+#include <QThread>
+
+namespace {
+    const qint64 kGuardBaseNs = 200 * 1000;     // 预计跳变前开始自旋的最小提前量
+    const qint64 kSpinSliceNs = 5 * 1000;       // 自旋阶段两次读寄存器的间隔
+    const qint64 kIdlePollNs = 250 * 1000;      // 还没学到节拍时的轮询间隔
+    const qint64 kLatePollNs = 100 * 1000;      // 过了预计时刻仍未跳变时的轮询间隔
+#ifdef _WIN32
+    const qint64 kInitSleepMarginNs = 1500 * 1000;// timeBeginPeriod(1)后睡眠误差约1ms
+#else
+    const qint64 kInitSleepMarginNs = 80 * 1000;
+#endif
+    const qint64 kMinSleepMarginNs = 20 * 1000;
+    const qint64 kMaxSleepMarginNs = 3000 * 1000;
+}
+
+DeadlineWaiter::DeadlineWaiter(qint64 periodNs)
+    : mNominalPeriodNs(periodNs)
+    , mPeriodNs(periodNs)
+    , mSleepMarginNs(kInitSleepMarginNs)
+{
+}
+
+void DeadlineWaiter::reset()
+{
+    mLastTransitionNs = -1;
+}
+
+void DeadlineWaiter::setNominalPeriodNs(qint64 periodNs)
+{
+    if (periodNs <= 0 || periodNs == mNominalPeriodNs)
+        return;
+
+    mNominalPeriodNs = periodNs;
+    mPeriodNs = periodNs;
+    mJitterNs = 0;
+}
+
+qint64 DeadlineWaiter::guardNs() const
+{
+    return qMin(kGuardBaseNs + 4 * mJitterNs, mPeriodNs / 4);
+}
+
+void DeadlineWaiter::onTransition(qint64 nowNs)
+{
+    if (mLastTransitionNs >= 0){
+        qint64 period = nowNs - mLastTransitionNs;
+        // 漏帧或超时后的间隔不参与学习，只重新对齐
+        if (period > mNominalPeriodNs / 2 && period < mNominalPeriodNs * 3 / 2){
+            qint64 deviation = qAbs(period - mPeriodNs);
+            mPeriodNs += (period - mPeriodNs) / 8;
+            mJitterNs += (deviation - mJitterNs) / 8;
+        }
+    }
+
+    mLastTransitionNs = nowNs;
+}
+
+void DeadlineWaiter::waitBeforePoll(const QElapsedTimer& timer)
+{
+    // 自旋间隔小于睡眠提前量，临近跳变时sleepUntil只会自旋
+    sleepUntil(timer, nextPollNs(timer.nsecsElapsed()));
+}
+
+qint64 DeadlineWaiter::nextPollNs(qint64 nowNs) const
+{
+    if (mLastTransitionNs < 0)
+        return nowNs + kIdlePollNs;
+
+    qint64 expectedNs = mLastTransitionNs + mPeriodNs;
+    qint64 guard = guardNs();
+    if (nowNs < expectedNs - guard)
+        return expectedNs - guard;// 离预计跳变还远，睡到提前量处
+    else if (nowNs < expectedNs + guard)
+        return nowNs + kSpinSliceNs;// 临近跳变，自旋
+    else
+        return nowNs + kLatePollNs;
+}
+
+qint64 DeadlineWaiter::takeMaxOvershootNs()
+{
+    qint64 overshootNs = mMaxOvershootNs;
+    mMaxOvershootNs = 0;
+    return overshootNs;
+}
+
+void DeadlineWaiter::sleepFor(qint64 ns)
+{
+    QElapsedTimer timer;
+    timer.start();
+    sleepUntil(timer, ns);
+}
+
+void DeadlineWaiter::sleepUntil(const QElapsedTimer& timer, qint64 deadlineNs)
+{
+    osSleepUntil(timer, deadlineNs);
+    while (timer.nsecsElapsed() < deadlineNs)
+        cpuRelax();
+}
+
+void DeadlineWaiter::osSleepUntil(const QElapsedTimer& timer, qint64 deadlineNs)
+{
+    qint64 wakeNs = deadlineNs - mSleepMarginNs;
+    qint64 nowNs = timer.nsecsElapsed();
+    if (wakeNs <= nowNs)
+        return;
+
+    QThread::usleep((wakeNs - nowNs) / 1000);
+
+    // 学习唤醒误差，下次提前唤醒
+    qint64 overshootNs = timer.nsecsElapsed() - wakeNs;
+    mMaxOvershootNs = qMax(mMaxOvershootNs, overshootNs);
+    qint64 margin = mSleepMarginNs + (overshootNs + kMinSleepMarginNs - mSleepMarginNs) / 8;
+    mSleepMarginNs = qBound(kMinSleepMarginNs, margin, kMaxSleepMarginNs);
+}
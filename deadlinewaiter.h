@@ -0,0 +1,66 @@
+﻿#ifndef DEADLINEWAITER_H
+#define DEADLINEWAITER_H
+
+#include <QtGlobal>
+#include <QElapsedTimer>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+/**
+ * DeadlineWaiter 就绪寄存器等待器
+ * 数据按PACKET_TIMELENGTH节拍到来，根据历史跳变时刻学习实际周期：
+ *   离预计跳变时刻较远时交给系统睡眠，临近时用pause指令自旋，过了预计时刻仍未跳变时低频轮询。
+ * 睡眠的唤醒误差也会被学习，睡眠只睡到目标时刻前一点，剩下的时间自旋补齐。
+ * 不调用processEvents，可以在任何工作线程中使用。
+ */
+class DeadlineWaiter
+{
+public:
+    explicit DeadlineWaiter(qint64 periodNs = 40 * 1000000LL);
+
+    /*每次采集开始时调用，清除上一炮的跳变时刻，保留已学到的周期*/
+    void reset();
+    /*设置名义周期，与当前周期不同时重新学习*/
+    void setNominalPeriodNs(qint64 periodNs);
+
+    /*记录一次寄存器跳变的时刻（ns，与waitBeforePoll使用同一计时器）*/
+    void onTransition(qint64 nowNs);
+
+    /*两次读寄存器之间调用*/
+    void waitBeforePoll(const QElapsedTimer& timer);
+    /*按学到的节拍计算下一次应读寄存器的时刻，多个寄存器共用一个轮询线程时取最早的一个*/
+    qint64 nextPollNs(qint64 nowNs) const;
+
+    /*混合睡眠：系统睡眠 + 自旋*/
+    void sleepFor(qint64 ns);
+    void sleepUntil(const QElapsedTimer& timer, qint64 deadlineNs);
+
+    qint64 periodNs() const { return mPeriodNs; }
+    qint64 jitterNs() const { return mJitterNs; }
+    qint64 guardNs() const;
+    qint64 sleepMarginNs() const { return mSleepMarginNs; }
+    /*上次调用以来系统睡眠唤醒的最大延迟（调度延迟），取出后清零*/
+    qint64 takeMaxOvershootNs();
+
+    static inline void cpuRelax(){
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        __asm__ __volatile__("yield");
+#endif
+    }
+
+private:
+    void osSleepUntil(const QElapsedTimer& timer, qint64 deadlineNs);
+
+    qint64 mNominalPeriodNs;
+    qint64 mPeriodNs;           // 学到的周期
+    qint64 mJitterNs = 0;       // 周期抖动（平均绝对偏差）
+    qint64 mLastTransitionNs = -1;
+    qint64 mSleepMarginNs;      // 系统睡眠唤醒误差
+    qint64 mMaxOvershootNs = 0; // 唤醒延迟最大值
+};
+
+#endif // DEADLINEWAITER_H
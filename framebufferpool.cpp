@@ -0,0 +1,389 @@
+﻿#include "framebufferpool.h"
+#include <QDebug>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#endif
+
+namespace {
+    const qint64 kNormalPageSize = 4096;
+    const qint64 kHugePage2M = 2LL << 20;
+    const qint64 kHugePage1G = 1LL << 30;
+
+    qint64 alignUp(qint64 size, qint64 alignment)
+    {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+#ifdef _WIN32
+    // 大页需要“锁定内存页”权限（需要管理员权限运行程序）
+    bool enableLargePagePrivilege()
+    {
+        HANDLE hToken;
+        TOKEN_PRIVILEGES tp;
+        LUID luid;
+
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+            return false;
+
+        if (!LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &luid)){
+            CloseHandle(hToken);
+            return false;
+        }
+
+        tp.PrivilegeCount = 1;
+        tp.Privileges[0].Luid = luid;
+        tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        BOOL ok = AdjustTokenPrivileges(hToken, FALSE, &tp, sizeof(tp), NULL, NULL);
+        DWORD error = GetLastError();// 没有分配该权限时返回成功，但错误码为ERROR_NOT_ALL_ASSIGNED
+        CloseHandle(hToken);
+        return ok && error == ERROR_SUCCESS;
+    }
+#else
+    void* mapAnonymous(qint64 size, int extraFlags)
+    {
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | extraFlags, -1, 0);
+        return data == MAP_FAILED ? nullptr : data;
+    }
+
+    // 首选采集卡所在节点，节点内存不足时内核仍可以从其它节点分配
+    void bindToNode(void* data, qint64 size, int numaNode)
+    {
+#ifdef SYS_mbind
+        if (numaNode < 0 || numaNode >= 63)
+            return;
+
+        unsigned long nodeMask = 1UL << numaNode;
+        if (syscall(SYS_mbind, data, size, MPOL_PREFERRED, &nodeMask, sizeof(nodeMask) * 8, 0) != 0)
+            qWarning() << "mbind node" << numaNode << "fail, errno:" << errno;
+#else
+        Q_UNUSED(data)
+        Q_UNUSED(size)
+        Q_UNUSED(numaNode)
+#endif
+    }
+#endif
+}
+
+FrameBufferPool& FrameBufferPool::instance()
+{
+    static FrameBufferPool pool;
+    return pool;
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+    trim();
+}
+
+qint64 FrameBufferPool::physicalMemoryBytes()
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx(&status) ? (qint64)status.ullTotalPhys : 0;
+#else
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return (pages > 0 && pageSize > 0) ? (qint64)pages * pageSize : 0;
+#endif
+}
+
+void FrameBufferPool::setBudget(qint64 bytes)
+{
+    QMutexLocker locker(&mMutex);
+    mBudget = bytes > 0 ? bytes : physicalMemoryBytes() / 4 * 3;
+}
+
+qint64 FrameBufferPool::budget() const
+{
+    QMutexLocker locker(&mMutex);
+    return mBudget;
+}
+
+void FrameBufferPool::setCacheLimit(qint64 bytes)
+{
+    QList<FrameBuffer*> evicted;
+    {
+        QMutexLocker locker(&mMutex);
+        mCacheLimit = bytes;
+        while (mCacheLimit >= 0 && mCachedBytes > mCacheLimit && !mCached.isEmpty()){
+            FrameBuffer* cached = mCached.takeFirst();
+            mCachedBytes -= cached->mMappedSize;
+            evicted.append(cached);
+        }
+    }
+
+    for (FrameBuffer* cached : evicted)
+        freeBuffer(cached);
+}
+
+qint64 FrameBufferPool::cacheLimit() const
+{
+    QMutexLocker locker(&mMutex);
+    return mCacheLimit;
+}
+
+bool FrameBufferPool::useHugePages(qint64 size) const
+{
+    return mHugePages && size >= kHugePage2M;
+}
+
+qint64 FrameBufferPool::estimateMappedSize(qint64 size) const
+{
+    return alignUp(size, useHugePages(size) ? kHugePage2M : kNormalPageSize);
+}
+
+FrameBufferHandle FrameBufferPool::acquire(qint64 size, int numaNode)
+{
+    if (size <= 0)
+        return FrameBufferHandle();
+
+    FrameBuffer* buffer = nullptr;
+    QList<FrameBuffer*> evicted;
+    qint64 pendingBytes = 0;
+    {
+        QMutexLocker locker(&mMutex);
+        for (int i=0; i<mCached.size(); ++i){
+            FrameBuffer* cached = mCached.at(i);
+            if (cached->mSize == size && (numaNode < 0 || cached->mNumaNode == numaNode)){
+                buffer = mCached.takeAt(i);
+                mCachedBytes -= buffer->mMappedSize;
+                break;
+            }
+        }
+
+        if (!buffer){
+            // 超出预算时先释放缓存中用不上的缓冲
+            pendingBytes = estimateMappedSize(size);
+            if (mBudget <= 0)
+                mBudget = physicalMemoryBytes() / 4 * 3;
+            while (mBudget > 0 && mUsedBytes + mCachedBytes + mPendingBytes + pendingBytes > mBudget && !mCached.isEmpty()){
+                FrameBuffer* cached = mCached.takeFirst();
+                mCachedBytes -= cached->mMappedSize;
+                evicted.append(cached);
+            }
+
+            if (mBudget > 0 && mUsedBytes + mCachedBytes + mPendingBytes + pendingBytes > mBudget){
+                qWarning().noquote() << "frame buffer pool over budget, size:" << size << statisticsTextLocked();
+                pendingBytes = -1;
+            }
+            else{
+                mPendingBytes += pendingBytes;
+            }
+        }
+    }
+
+    for (FrameBuffer* cached : evicted)
+        freeBuffer(cached);
+    if (pendingBytes < 0)
+        return FrameBufferHandle();
+
+    // 新分配要锁页，耗时较长，不能持锁
+    if (!buffer){
+        buffer = allocBuffer(size, numaNode);
+        QMutexLocker locker(&mMutex);
+        mPendingBytes -= pendingBytes;
+    }
+    if (!buffer)
+        return FrameBufferHandle();
+
+    {
+        QMutexLocker locker(&mMutex);
+        mUsedBytes += buffer->mMappedSize;
+        if (buffer->mPageKind != FrameBuffer::NormalPage)
+            mHugePageBytes += buffer->mMappedSize;
+    }
+
+    return FrameBufferHandle(buffer, [](FrameBuffer* buffer){
+        FrameBufferPool::instance().recycle(buffer);
+    });
+}
+
+void FrameBufferPool::recycle(FrameBuffer* buffer)
+{
+    QList<FrameBuffer*> evicted;
+    {
+        QMutexLocker locker(&mMutex);
+        mUsedBytes -= buffer->mMappedSize;
+        if (buffer->mPageKind != FrameBuffer::NormalPage)
+            mHugePageBytes -= buffer->mMappedSize;
+        mCached.append(buffer);
+        mCachedBytes += buffer->mMappedSize;
+
+        // 超出缓存上限时先释放最早归还的缓冲
+        while (mCacheLimit >= 0 && mCachedBytes > mCacheLimit && !mCached.isEmpty()){
+            FrameBuffer* cached = mCached.takeFirst();
+            mCachedBytes -= cached->mMappedSize;
+            evicted.append(cached);
+        }
+    }
+
+    // 解锁和释放内存耗时，不能持锁
+    for (FrameBuffer* cached : evicted)
+        freeBuffer(cached);
+}
+
+void FrameBufferPool::trim()
+{
+    QList<FrameBuffer*> buffers;
+    {
+        QMutexLocker locker(&mMutex);
+        buffers.swap(mCached);
+        mCachedBytes = 0;
+    }
+
+    for (FrameBuffer* buffer : buffers)
+        freeBuffer(buffer);
+}
+
+qint64 FrameBufferPool::usedBytes() const
+{
+    QMutexLocker locker(&mMutex);
+    return mUsedBytes;
+}
+
+qint64 FrameBufferPool::cachedBytes() const
+{
+    QMutexLocker locker(&mMutex);
+    return mCachedBytes;
+}
+
+QString FrameBufferPool::statisticsText() const
+{
+    QMutexLocker locker(&mMutex);
+    return statisticsTextLocked();
+}
+
+QString FrameBufferPool::statisticsTextLocked() const
+{
+    return QStringLiteral("缓冲池使用中：%1MB（大页：%2MB） 缓存：%3MB 预算：%4MB")
+            .arg(mUsedBytes >> 20)
+            .arg(mHugePageBytes >> 20)
+            .arg(mCachedBytes >> 20)
+            .arg(mBudget >> 20);
+}
+
+FrameBuffer* FrameBufferPool::allocBuffer(qint64 size, int numaNode)
+{
+    FrameBuffer* buffer = new FrameBuffer;
+    buffer->mSize = size;
+    buffer->mNumaNode = numaNode;
+
+#ifdef _WIN32
+    DWORD node = numaNode >= 0 ? (DWORD)numaNode : NUMA_NO_PREFERRED_NODE;
+    if (useHugePages(size)){
+        static const bool privileged = enableLargePagePrivilege();
+        SIZE_T largePageSize = GetLargePageMinimum();
+        if (privileged && largePageSize > 0 && (SIZE_T)size >= largePageSize){
+            // 大页内存不会被换出，不需要再锁定
+            SIZE_T mappedSize = alignUp(size, largePageSize);
+            buffer->mData = reinterpret_cast<char*>(VirtualAllocExNuma(GetCurrentProcess(), NULL, mappedSize,
+                                                                       MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES,
+                                                                       PAGE_READWRITE, node));
+            if (buffer->mData){
+                buffer->mMappedSize = mappedSize;
+                buffer->mPageKind = largePageSize >= (SIZE_T)kHugePage1G ? FrameBuffer::HugePage1G : FrameBuffer::HugePage2M;
+            }
+        }
+    }
+
+    if (!buffer->mData){
+        SIZE_T mappedSize = alignUp(size, kNormalPageSize);
+        buffer->mData = reinterpret_cast<char*>(VirtualAllocExNuma(GetCurrentProcess(), NULL, mappedSize,
+                                                                   MEM_COMMIT | MEM_RESERVE,
+                                                                   PAGE_READWRITE, node));
+        if (buffer->mData){
+            buffer->mMappedSize = mappedSize;
+            buffer->mLocked = VirtualLock(buffer->mData, mappedSize);
+            if (!buffer->mLocked){
+                // 内存锁定失败，通过逐页访问确保所有页都被提交到物理内存
+                for (qint64 i=0; i<buffer->mMappedSize; i+=kNormalPageSize){
+                    buffer->mData[i] = 0;
+                }
+            }
+        }
+    }
+#else
+    if (useHugePages(size)){
+        // 1GB大页只给不小于1GB的缓冲，避免一帧120MB占用整页
+        if (size >= kHugePage1G){
+            qint64 mappedSize = alignUp(size, kHugePage1G);
+            buffer->mData = reinterpret_cast<char*>(mapAnonymous(mappedSize, MAP_HUGETLB | MAP_HUGE_1GB));
+            if (buffer->mData){
+                buffer->mMappedSize = mappedSize;
+                buffer->mPageKind = FrameBuffer::HugePage1G;
+            }
+        }
+
+        if (!buffer->mData){
+            qint64 mappedSize = alignUp(size, kHugePage2M);
+            buffer->mData = reinterpret_cast<char*>(mapAnonymous(mappedSize, MAP_HUGETLB | MAP_HUGE_2MB));
+            if (buffer->mData){
+                buffer->mMappedSize = mappedSize;
+                buffer->mPageKind = FrameBuffer::HugePage2M;
+            }
+        }
+    }
+
+    if (!buffer->mData){
+        // 没有预留大页（/proc/sys/vm/nr_hugepages为0）时退回普通页，尽量使用透明大页
+        qint64 mappedSize = alignUp(size, useHugePages(size) ? kHugePage2M : kNormalPageSize);
+        buffer->mData = reinterpret_cast<char*>(mapAnonymous(mappedSize, 0));
+        if (buffer->mData){
+            buffer->mMappedSize = mappedSize;
+#ifdef MADV_HUGEPAGE
+            if (useHugePages(size))
+                madvise(buffer->mData, mappedSize, MADV_HUGEPAGE);
+#endif
+        }
+    }
+
+    if (buffer->mData){
+        // 先指定节点再锁定，锁定时才真正分配物理页
+        bindToNode(buffer->mData, buffer->mMappedSize, numaNode);
+        // 锁定失败时不逐页访问，交给第一次DMA写入时提交，避免启动时占满物理内存
+        buffer->mLocked = mlock(buffer->mData, buffer->mMappedSize) == 0;
+    }
+#endif
+
+    if (!buffer->mData){
+        qCritical() << "allocate frame buffer fail, size:" << size << "numa node:" << numaNode;
+        delete buffer;
+        return nullptr;
+    }
+
+    return buffer;
+}
+
+void FrameBufferPool::freeBuffer(FrameBuffer* buffer)
+{
+#ifdef _WIN32
+    if (buffer->mLocked)
+        VirtualUnlock(buffer->mData, buffer->mMappedSize);
+    VirtualFree(buffer->mData, 0, MEM_RELEASE);
+#else
+    if (buffer->mLocked)
+        munlock(buffer->mData, buffer->mMappedSize);
+    munmap(buffer->mData, buffer->mMappedSize);
+#endif
+    delete buffer;
+}
@@ -0,0 +1,104 @@
+﻿#ifndef FRAMEBUFFERPOOL_H
+#define FRAMEBUFFERPOOL_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QByteArray>
+#include <QSharedPointer>
+
+/**
+ * FrameBuffer DMA帧缓冲
+ * 由FrameBufferPool分配，通过FrameBufferHandle引用计数，最后一个句柄释放时自动归还缓冲池
+ */
+class FrameBuffer
+{
+public:
+    enum PageKind {
+        NormalPage = 0, // 普通页（Linux上建议透明大页）
+        HugePage2M,     // 2MB大页
+        HugePage1G      // 1GB大页
+    };
+
+    char* data() const { return mData; }
+    qint64 size() const { return mSize; }
+    int numaNode() const { return mNumaNode; }
+    PageKind pageKind() const { return mPageKind; }
+
+    /*不拷贝的QByteArray视图，生命周期不能超过句柄*/
+    QByteArray toByteArray() const { return QByteArray::fromRawData(mData, int(mSize)); }
+
+private:
+    friend class FrameBufferPool;
+    char* mData = nullptr;
+    qint64 mSize = 0;       // 申请的大小
+    qint64 mMappedSize = 0; // 按页对齐后实际映射的大小
+    int mNumaNode = -1;
+    PageKind mPageKind = NormalPage;
+    bool mLocked = false;
+};
+
+typedef QSharedPointer<FrameBuffer> FrameBufferHandle;
+
+/**
+ * FrameBufferPool DMA帧缓冲池
+ * 所有采集线程共用一个缓冲池，统一负责锁页内存的分配和释放：
+ *   优先使用大页（Linux mmap MAP_HUGETLB 2MB/1GB，Windows MEM_LARGE_PAGES），减少120MB DMA和拷贝时的TLB缺失；
+ *   小于一个大页的缓冲（如40KB的能谱帧）只用普通页，避免每个占满一整页；
+ *   没有预留大页时退回普通页（Linux同时建议透明大页），并用mlock/VirtualLock锁定；
+ *   按采集卡所在的NUMA节点分配（Linux mbind，Windows VirtualAllocExNuma）。
+ * 归还的缓冲先缓存在池中，下次申请相同大小、相同节点的缓冲时直接复用；缓存超过上限时归还的缓冲立即释放，
+ * 单次测量在一炮保存完成后由采集线程调用trim释放全部缓存，连续测量保留缓存给下一炮。
+ * 使用中和缓存的内存合计不超过预算，超出时先释放缓存，仍然不够则申请失败。
+ */
+class FrameBufferPool
+{
+public:
+    static FrameBufferPool& instance();
+
+    void setHugePages(bool enable) { mHugePages = enable; }
+    bool hugePages() const { return mHugePages; }
+
+    /*内存预算（字节），小于等于0时为物理内存的3/4*/
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+    static qint64 physicalMemoryBytes();
+
+    /*缓存上限（字节），小于0时只受预算限制*/
+    void setCacheLimit(qint64 bytes);
+    qint64 cacheLimit() const;
+
+    /*申请缓冲，numaNode<0时不指定节点，失败返回空句柄*/
+    FrameBufferHandle acquire(qint64 size, int numaNode = -1);
+    /*释放缓存的空闲缓冲*/
+    void trim();
+
+    qint64 usedBytes() const;
+    qint64 cachedBytes() const;
+    QString statisticsText() const;
+
+private:
+    FrameBufferPool() = default;
+    ~FrameBufferPool();
+    Q_DISABLE_COPY(FrameBufferPool)
+
+    FrameBuffer* allocBuffer(qint64 size, int numaNode);
+    bool useHugePages(qint64 size) const;
+    qint64 estimateMappedSize(qint64 size) const;
+    QString statisticsTextLocked() const;
+    void freeBuffer(FrameBuffer* buffer);
+    void recycle(FrameBuffer* buffer);
+
+    bool mHugePages = false;
+    mutable QMutex mMutex;
+    QList<FrameBuffer*> mCached;// 已归还、等待复用的缓冲
+    qint64 mUsedBytes = 0;
+    qint64 mCachedBytes = 0;
+    qint64 mHugePageBytes = 0;// 使用中的大页字节数
+    qint64 mPendingBytes = 0;// 正在分配、还没计入使用中的字节数
+    qint64 mBudget = 0;
+    qint64 mCacheLimit = 1LL << 30;
+};
+
+#endif // FRAMEBUFFERPOOL_H
@@ -0,0 +1,66 @@
+﻿#include "framereaderthread.h"
+
+FrameReaderThread::FrameReaderThread(quint8 step, QObject *parent)
+    : QThread(parent)
+    , mStep(step)
+{
+}
+
+FrameReaderThread::~FrameReaderThread()
+{
+    stop();
+    wait();
+}
+
+void FrameReaderThread::post(FrameReadTask task)
+{
+    QMutexLocker locker(&mMutex);
+    mTasks.enqueue(std::move(task));
+    mNotEmpty.wakeOne();
+}
+
+void FrameReaderThread::waitForDone()
+{
+    QMutexLocker locker(&mMutex);
+    while (!mTasks.isEmpty() || mBusy > 0){
+        mDone.wait(&mMutex);
+    }
+}
+
+void FrameReaderThread::stop()
+{
+    QMutexLocker locker(&mMutex);
+    mStopped = true;
+    mNotEmpty.wakeAll();
+}
+
+void FrameReaderThread::run()
+{
+    while (true)
+    {
+        FrameReadTask task;
+        {
+            QMutexLocker locker(&mMutex);
+            while (!mStopped && mTasks.isEmpty()){
+                mNotEmpty.wait(&mMutex);
+            }
+            if (mTasks.isEmpty())
+                break;
+
+            task = mTasks.dequeue();
+            mBusy++;
+        }
+
+        task();
+
+        {
+            QMutexLocker locker(&mMutex);
+            mBusy--;
+            if (mTasks.isEmpty() && mBusy == 0)
+                mDone.wakeAll();
+        }
+    }
+
+    QMutexLocker locker(&mMutex);
+    mDone.wakeAll();
+}
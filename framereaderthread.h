@@ -0,0 +1,45 @@
+﻿#ifndef FRAMEREADERTHREAD_H
+#define FRAMEREADERTHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <functional>
+
+typedef std::function<void()> FrameReadTask;
+
+/**
+ * FrameReaderThread DDR区域专用读线程
+ * 每个DDR区域（step 0~3）固定对应一个读线程和一个c2h通道，线程在采集线程创建时启动，一直存在，
+ * 避免每帧从线程池调度带来的抖动。任务按提交顺序依次执行。
+ */
+class FrameReaderThread : public QThread
+{
+    Q_OBJECT
+public:
+    explicit FrameReaderThread(quint8 step, QObject *parent = nullptr);
+    ~FrameReaderThread();
+
+    quint8 step() const { return mStep; }
+
+    /*提交读任务*/
+    void post(FrameReadTask task);
+    /*等待已提交的任务全部执行完*/
+    void waitForDone();
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    quint8 mStep = 0;
+    QQueue<FrameReadTask> mTasks;
+    int mBusy = 0;
+    bool mStopped = false;
+    QMutex mMutex;
+    QWaitCondition mNotEmpty;
+    QWaitCondition mDone;
+};
+
+#endif // FRAMEREADERTHREAD_H
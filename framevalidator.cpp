@@ -0,0 +1,292 @@
+﻿#include "framevalidator.h"
+#include "shotcontainer.h"
+#include "zerosuppressor.h"
+#include "waveformcodec.h"
+#include "planarframe.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QTextStream>
+#include <QStringList>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CRC32C_X86 1
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_FEATURE_CRC32)
+#define CRC32C_ARM 1
+#include <arm_acle.h>
+#endif
+
+#ifdef CRC32C_X86
+#if defined(__GNUC__) || defined(__clang__)
+#define CRC32C_TARGET __attribute__((target("sse4.2")))
+#else
+#define CRC32C_TARGET
+#endif
+#endif
+
+namespace {
+    // Castagnoli多项式（反射）
+    const quint32 kCrc32cPoly = 0x82F63B78;
+
+    struct Crc32cTable {
+        quint32 table[256];
+        Crc32cTable(){
+            for (quint32 i = 0; i < 256; ++i){
+                quint32 crc = i;
+                for (int k = 0; k < 8; ++k)
+                    crc = (crc & 1) ? (crc >> 1) ^ kCrc32cPoly : (crc >> 1);
+                table[i] = crc;
+            }
+        }
+    };
+
+    quint32 crc32cSoftware(quint32 crc, const quint8* p, qint64 size)
+    {
+        static const Crc32cTable t;
+        while (size-- > 0)
+            crc = t.table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        return crc;
+    }
+
+#ifdef CRC32C_X86
+    CRC32C_TARGET quint32 crc32cHardwareImpl(quint32 crc, const quint8* p, qint64 size)
+    {
+        // 先按字节对齐到8字节边界
+        while (size > 0 && ((quintptr)p & 7) != 0){
+            crc = _mm_crc32_u8(crc, *p++);
+            --size;
+        }
+#if defined(__x86_64__) || defined(_M_X64)
+        quint64 crc64 = crc;
+        while (size >= 8){
+            crc64 = _mm_crc32_u64(crc64, *(const quint64*)p);
+            p += 8;
+            size -= 8;
+        }
+        crc = (quint32)crc64;
+#endif
+        while (size >= 4){
+            crc = _mm_crc32_u32(crc, *(const quint32*)p);
+            p += 4;
+            size -= 4;
+        }
+        while (size-- > 0)
+            crc = _mm_crc32_u8(crc, *p++);
+        return crc;
+    }
+
+    bool detectHardware()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 20)) != 0;
+#else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.2");
+#endif
+    }
+#elif defined(CRC32C_ARM)
+    quint32 crc32cHardwareImpl(quint32 crc, const quint8* p, qint64 size)
+    {
+        while (size >= 8){
+            crc = __crc32cd(crc, *(const quint64*)p);
+            p += 8;
+            size -= 8;
+        }
+        while (size-- > 0)
+            crc = __crc32cb(crc, *p++);
+        return crc;
+    }
+
+    bool detectHardware() { return true; }
+#endif
+}
+
+bool FrameValidator::crc32cHardware()
+{
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+    static const bool supported = detectHardware();
+    return supported;
+#else
+    return false;
+#endif
+}
+
+quint32 FrameValidator::crc32c(const char* data, qint64 size, quint32 crc)
+{
+    const quint8* p = reinterpret_cast<const quint8*>(data);
+    crc = ~crc;
+#if defined(CRC32C_X86) || defined(CRC32C_ARM)
+    if (crc32cHardware())
+        return ~crc32cHardwareImpl(crc, p, size);
+#endif
+    return ~crc32cSoftware(crc, p, size);
+}
+
+quint32 FrameValidator::checkFrame(quint32 frameNo, const char* waveformHead, const char* waveformTail, const char* spectrumHead)
+{
+    quint32 faults = NoFault;
+
+    // 原始数据按12字节反转后第7字节为帧序号，对应原始第4字节
+    quint8 headSeq = (quint8)waveformHead[12 - 1 - 7];
+    quint8 tailSeq = (quint8)waveformTail[12 - 1 - 7];
+    // 与采集结束后的检查保持一致：包头序号为0时不判断波形
+    if (headSeq != 0){
+        if (headSeq != tailSeq)
+            faults |= WaveformHeadTail;
+        else if (headSeq != (quint8)(frameNo & 0xFF))
+            faults |= WaveformSequence;
+    }
+
+    // 能谱包头按16字节反转后第4、5字节为序号，对应原始第11、10字节
+    quint16 spectrumSeq = ((quint8)spectrumHead[16 - 1 - 4] << 8) | (quint8)spectrumHead[16 - 1 - 5];
+    if (spectrumSeq != (quint16)(frameNo & 0xFFFF))
+        faults |= SpectrumSequence;
+
+    return faults;
+}
+
+QString FrameValidator::faultText(quint32 faults)
+{
+    QStringList lst;
+    if (faults & ReadFailed)
+        lst << QStringLiteral("DMA读失败");
+    if (faults & WaveformHeadTail)
+        lst << QStringLiteral("波形包头包尾帧序号不一致");
+    if (faults & WaveformSequence)
+        lst << QStringLiteral("波形帧序号异常");
+    if (faults & SpectrumSequence)
+        lst << QStringLiteral("能谱帧序号异常");
+    return lst.join(QStringLiteral("，"));
+}
+
+QString FrameValidator::crcFileName(const QString& dir, quint32 physicalNo, bool isDDR1)
+{
+    return QString("%1/%2%3crc.txt").arg(dir).arg(physicalNo).arg(isDDR1 ? 'A' : 'B');
+}
+
+bool FrameValidator::writeCrcFile(const QString& filePath, const QVector<FrameCrc>& crcs)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream out(&file);
+    out << "# CRC32C of the raw DMA frame; .nbin, planar and container frames are checked after decoding,\n";
+    out << "# zero-suppressed frames are lossy and cannot be checked\n";
+    out << "# file data spec\n";
+    for (const FrameCrc& crc : crcs){
+        if (crc.frameNo == 0)
+            continue;
+
+        out << crc.frameNo << " "
+            << QString("%1").arg(crc.waveformCrc, 8, 16, QLatin1Char('0')) << " "
+            << QString("%1").arg(crc.spectrumCrc, 8, 16, QLatin1Char('0')) << "\n";
+    }
+    return true;
+}
+
+QMap<quint32, FrameCrc> FrameValidator::readCrcFile(const QString& filePath)
+{
+    QMap<quint32, FrameCrc> crcs;
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return crcs;
+
+    QTextStream in(&file);
+    while (!in.atEnd()){
+        QString line = in.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList fields = line.split(' ', Qt::SkipEmptyParts);
+        if (fields.size() < 3)
+            continue;
+
+        FrameCrc crc;
+        crc.frameNo = fields[0].toUInt();
+        crc.waveformCrc = fields[1].toUInt(nullptr, 16);
+        crc.spectrumCrc = fields[2].toUInt(nullptr, 16);
+        crcs.insert(crc.frameNo, crc);
+    }
+    return crcs;
+}
+
+bool FrameValidator::rawFrame(const QByteArray& fileData, QByteArray& raw)
+{
+    if (ZeroSuppressor::isSuppressed(fileData))
+        return false;
+
+    if (WaveformCodec::isEncoded(fileData))
+        raw = WaveformCodec::decode(fileData);
+    else if (PlanarFrame::isPlanar(fileData))
+        raw = PlanarFrame::decode(fileData);
+    else
+        raw = fileData;
+    return !raw.isEmpty();
+}
+
+FrameValidator::VerifyResult FrameValidator::verifyFrame(const QString& binFilePath, const QByteArray& fileData)
+{
+    // 原单帧文件名：采集卡序号 + A/B + data/spec + 文件序号
+    static const QRegularExpression re("^(\\d+)([AB])(data|spec)(\\d+)\\.n?bin$");
+    QFileInfo fi(binFilePath);
+    QRegularExpressionMatch match = re.match(fi.fileName());
+    if (!match.hasMatch())
+        return NotVerifiable;
+
+    // 旁路文件按路径缓存，文件大小或修改时间变化时重新读取
+    struct CachedCrcs {
+        qint64 size = -1;
+        QDateTime modified;
+        QMap<quint32, FrameCrc> crcs;
+    };
+    static QMutex mutex;
+    static QHash<QString, CachedCrcs> cache;
+
+    const QString crcPath = crcFileName(fi.path(), match.captured(1).toUInt(), match.captured(2) == "A");
+    QFileInfo crcInfo(crcPath);
+    if (!crcInfo.exists())
+        return NotVerifiable;
+
+    FrameCrc expected;
+    {
+        QMutexLocker locker(&mutex);
+        CachedCrcs& cached = cache[crcPath];
+        if (cached.size != crcInfo.size() || cached.modified != crcInfo.lastModified()){
+            cached.size = crcInfo.size();
+            cached.modified = crcInfo.lastModified();
+            cached.crcs = readCrcFile(crcPath);
+        }
+
+        auto it = cached.crcs.constFind(match.captured(4).toUInt());
+        if (it == cached.crcs.constEnd())
+            return NotVerifiable;
+        expected = it.value();
+    }
+
+    QByteArray raw;
+    if (!rawFrame(fileData, raw))
+        return NotVerifiable;
+
+    const quint32 expectedCrc = match.captured(3) == "data" ? expected.waveformCrc : expected.spectrumCrc;
+    return crc32c(raw.constData(), raw.size()) == expectedCrc ? Verified : CrcMismatch;
+}
+
+bool FrameValidator::verifyFile(const QString& binFilePath, quint32 expectedCrc)
+{
+    QByteArray data;
+    QByteArray raw;
+    if (!ShotContainer::readFile(binFilePath, data) || !rawFrame(data, raw))
+        return false;
+
+    return crc32c(raw.constData(), raw.size()) == expectedCrc;
+}
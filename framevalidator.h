@@ -0,0 +1,61 @@
+﻿#ifndef FRAMEVALIDATOR_H
+#define FRAMEVALIDATOR_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QMap>
+#include <QVector>
+
+// 一帧两个文件的CRC32C
+struct FrameCrc {
+    quint32 frameNo = 0;
+    quint32 waveformCrc = 0;
+    quint32 spectrumCrc = 0;
+};
+
+/**
+ * FrameValidator 帧校验
+ * 每帧DMA完成后立即检查：
+ *   波形包头/包尾帧序号（按12字节反转后第7字节）一致且等于包序号的低8位
+ *   能谱包头（按16字节反转后第4、5字节）序号等于包序号
+ * 并计算整帧CRC32C（x86 SSE4.2 / ARMv8 CRC指令，不支持时查表），
+ * 采集结束后写入旁路文件 %1%2crc.txt，离线读取时不用重新解析整帧就能校验文件完整性。
+ */
+class FrameValidator
+{
+public:
+    enum Fault {
+        NoFault = 0x00,
+        ReadFailed = 0x01,          // DMA读失败
+        WaveformHeadTail = 0x02,    // 波形包头包尾帧序号不一致
+        WaveformSequence = 0x04,    // 波形帧序号不连续
+        SpectrumSequence = 0x08     // 能谱序号不连续
+    };
+
+    /*检查一帧的包头包尾，frameNo从1开始*/
+    static quint32 checkFrame(quint32 frameNo, const char* waveformHead, const char* waveformTail, const char* spectrumHead);
+    static QString faultText(quint32 faults);
+
+    static quint32 crc32c(const char* data, qint64 size, quint32 crc = 0);
+    static bool crc32cHardware();
+
+    enum VerifyResult {
+        Verified = 0,       // 与CRC旁路文件一致
+        CrcMismatch,        // 不一致，文件已损坏
+        NotVerifiable       // 没有旁路文件或该帧的记录，或零压缩保存（有损，不能还原原始帧）
+    };
+
+    /*CRC旁路文件，CRC针对原始DMA帧，每行按文件序号（与%1%2data%3.bin中的%3相同）记录*/
+    static QString crcFileName(const QString& dir, quint32 physicalNo, bool isDDR1);
+    static bool writeCrcFile(const QString& filePath, const QVector<FrameCrc>& crcs);
+    static QMap<quint32, FrameCrc> readCrcFile(const QString& filePath);
+
+    /*存储的帧（原始、.nbin、分平面）还原成原始DMA帧，零压缩的帧有损返回false*/
+    static bool rawFrame(const QByteArray& fileData, QByteArray& raw);
+    /*按原单帧文件名在同目录的CRC旁路文件中查找记录，校验读到的文件内容（解码还原后计算）*/
+    static VerifyResult verifyFrame(const QString& binFilePath, const QByteArray& fileData);
+    /*按原单帧文件名读取（.bin、.nbin或容器中的帧），还原后与expectedCrc比较*/
+    static bool verifyFile(const QString& binFilePath, quint32 expectedCrc);
+};
+
+#endif // FRAMEVALIDATOR_H
@@ -6,6 +6,7 @@
 #include "offlinewindow.h"
 #include "globalsettings.h"
 #include "darkstyle.h"
+#include "capturebench.h"
 
 #include <QApplication>
 #include <QStyleFactory>
@@ -51,8 +52,27 @@ void AppMessageHandler(QtMsgType type, const QMessageLogContext& context, const
 static QTranslator qtTranslator;
 static QTranslator qtbaseTranslator;
 static QTranslator appTranslator;
+
+// 命令行中"-m"后面紧跟的运行模式是否为mode
+static bool isRunMode(int argc, char *argv[], const char* mode)
+{
+    for (int i = 1; i + 1 < argc; ++i){
+        if (qstrcmp(argv[i], "-m") == 0)
+            return qstrcmp(argv[i + 1], mode) == 0;
+    }
+    return false;
+}
+
 int main(int argc, char *argv[])
 {
+    // 采集性能基准测试，不启动界面，不需要显示器和平台插件，结果输出为JSON
+    if (isRunMode(argc, argv, "bench")){
+        QCoreApplication a(argc, argv);
+        QCoreApplication::setApplicationName("中子伽马相机软件");
+        QCoreApplication::setApplicationVersion(APP_VERSION);
+        return CaptureBench::exec(QCoreApplication::arguments());
+    }
+
     QGoodWindow::setup();
     QApplication::setHighDpiScaleFactorRoundingPolicy(Qt::HighDpiScaleFactorRoundingPolicy::PassThrough);
 
@@ -4,6 +4,7 @@
 #include "qcustomplothelper.h"
 #include "globalsettings.h"
 #include "switchbutton.h"
+#include "AppConfig.h"
 
 // 对尾缀_1等数字进行加1操作。一定要有下划线
 QString increaseShotNumSuffix(QString shotNumStr)
@@ -81,6 +82,10 @@ MainWindow::MainWindow(bool isDarkTheme, QWidget *parent)
         }
     });
 
+    connect(&mPCIeCommSdk, &PCIeCommSdk::captureFailOccurred, this, [=](quint32 deviceIndex, quint32 frameNo){
+        emit writeLog(QString("采集卡[%1]第%2帧数据校验失败").arg(deviceIndex).arg(frameNo), QtCriticalMsg);
+    });
+
     connect(&mPCIeCommSdk, &PCIeCommSdk::captureFinished, this, [=](){
         SetPriorityClass(GetCurrentProcess(), NORMAL_PRIORITY_CLASS);
         ui->action_startMeasure->setEnabled(true);
@@ -501,6 +506,16 @@ void MainWindow::initUi()
                     emit startMeasure();
                 }
             }
+            else if (mPreTriggerArmed && mExternalSignalTriggered)
+            {
+                // 预触发采集已经在进行，到达触发时刻时冻结触发前的数据
+                if (currentDateTime >= ui->dateTimeEdit_startTime->dateTime())
+                {
+                    mPreTriggerArmed = false;
+                    mPCIeCommSdk.triggerAllCapture();
+                    ui->lineEdit_triggerflag->setText(QStringLiteral("正在测量"));
+                }
+            }
         }
 
     });
@@ -764,8 +779,15 @@ void MainWindow::initUi()
             qInfo().noquote().nospace() << tr("48V电压已关闭");
         }
 
-        // 停止测量
-        emit ui->action_stopMeasure->trigger();
+        // 停止测量；预触发采集时作为触发，保存停机前的数据和停机后的一炮数据
+        if (mPreTriggerArmed){
+            mPreTriggerArmed = false;
+            mPCIeCommSdk.triggerAllCapture();
+            ui->lineEdit_triggerflag->setText(QStringLiteral("紧急停机"));
+        }
+        else{
+            emit ui->action_stopMeasure->trigger();
+        }
 
         // 断开设备连接
         mCommHelper->disconnectServer();
@@ -1466,6 +1488,15 @@ void MainWindow::on_action_startMeasure_triggered()
         ui->action_stopMeasure->setEnabled(true);
         ui->lineEdit_savePath->setEnabled(false);
         ui->spinBox_timeLength->setEnabled(false);
+
+        // 预触发采集：立即开始采集，内存中只保留最近一段数据，等待外触发
+        if (AppConfig::instance().preTriggerCapture()){
+            mPreTriggerArmed = true;
+            onStartMeasure();
+            mPreTriggerArmed = mIsMeasuring;
+            if (mPreTriggerArmed)
+                ui->lineEdit_triggerflag->setText(QStringLiteral("预触发采集，等待触发"));
+        }
     }
     else
     {
@@ -1494,6 +1525,7 @@ void MainWindow::on_action_startMeasure_triggered()
 void MainWindow::on_action_stopMeasure_triggered()
 {
     mExternalTriggerMode = false;
+    mPreTriggerArmed = false;
 
     // 发送指令集
     //mPCIeCommSdk.writeStopMeasure();
@@ -1963,6 +1995,8 @@ void MainWindow::onStartMeasure()
     int measureMode = mEnableContinueMeasuer ? PCIeCommSdk::mmContinue : PCIeCommSdk::mmSingle;//mMeasureMode
     if (ui->action_test->isChecked())
         measureMode |= PCIeCommSdk::mmTest;
+    if (mPreTriggerArmed)
+        measureMode |= PCIeCommSdk::mmPreTrigger;
     mPCIeCommSdk.setMeasureMode((PCIeCommSdk::MeasureMode)measureMode);
 
     // 先发送PSD甄别阈值
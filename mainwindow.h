@@ -151,6 +151,7 @@ private:
     bool mEnableContinueMeasuer = false; // 启用连续测量
     bool mExternalTriggerMode = false;// 启用外触发
     bool mExternalSignalTriggered = false;// 外触发信号是否已经触发
+    bool mPreTriggerArmed = false;// 预触发采集已经开始，等待外触发
     int mCurrentMeasuerCount = 0;
     int mContinueMeasuerCount = 0;
     int mContinueMeasuerFailCount = 0;
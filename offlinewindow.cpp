@@ -2,6 +2,7 @@
 #include "ui_offlinewindow.h"
 #include "globalsettings.h"
 #include "datacompresswindow.h"
+#include "shotcontainer.h"
 #include "waitingspinnerwidget.h"
 #include "qcustomplothelper.h"
 #include <QElapsedTimer>
@@ -438,11 +439,12 @@ void OfflineWindow::applyColorTheme()
 
 
 // 计算文件信息列表的总大小
-qint64 OfflineWindow::calculateTotalSize(const QFileInfoList& fileinfoList)
+qint64 OfflineWindow::calculateTotalSize(const QFileInfoList& fileinfoList, const ShotContainer::FrameFiles& containerFrames)
 {
     qint64 totalSize = 0;
     for (const QFileInfo& fi : fileinfoList) {
-        totalSize += fi.size();
+        auto frame = containerFrames.constFind(fi.fileName());
+        totalSize += frame != containerFrames.constEnd() ? frame->size : fi.size();// 整炮容器中的帧
     }
     return totalSize;
 }
@@ -483,7 +485,8 @@ void OfflineWindow::loadRelatedFiles(const QString& dirPath)
     ui->tableWidget_file->setRowCount(0);
 
     // 使用静态函数获取.bin文件列表
-    QFileInfoList fileinfoList = DataCompressWindow::getBinFileList(dirPath);
+    ShotContainer::FrameFiles containerFrames;
+    QFileInfoList fileinfoList = DataCompressWindow::getBinFileList(dirPath, &containerFrames);
     // 过滤掉能谱文件
     QFileInfoList result;
     for (auto item : fileinfoList){
@@ -510,7 +513,7 @@ void OfflineWindow::loadRelatedFiles(const QString& dirPath)
         // 使用静态函数提取文件名列表
         mfileList = DataCompressWindow::extractFileNames(result);
         {
-            qint64 totalSize = calculateTotalSize(fileinfoList);
+            qint64 totalSize = calculateTotalSize(fileinfoList, containerFrames);
             int fileCount = fileinfoList.count();
 
             //统计文件详细信息
@@ -531,22 +534,26 @@ void OfflineWindow::loadRelatedFiles(const QString& dirPath)
             QLocale locale(QLocale::English);
             for (int i = 0; i < fileCount; ++i) {
                 const QFileInfo& fi = fileinfoList.at(i);
+                // 整炮容器中的帧大小和时间取自容器索引，不查询文件系统
+                auto frame = containerFrames.constFind(fi.fileName());
+                const bool inContainer = frame != containerFrames.constEnd();
+                const qint64 fileSize = inContainer ? frame->size : fi.size();
 
                 auto *itemName = new QTableWidgetItem(fi.fileName());
 
-                auto *itemBytes = new QTableWidgetItem(locale.toString(fi.size()));
+                auto *itemBytes = new QTableWidgetItem(locale.toString(fileSize));
                 itemBytes->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
 
-                auto *itemHuman = new QTableWidgetItem(humanReadableSize(fi.size()));
+                auto *itemHuman = new QTableWidgetItem(humanReadableSize(fileSize));
                 itemHuman->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
 
-                auto *itemBirthTime = new QTableWidgetItem(fi.birthTime().toString("yyyy-MM-dd HH:mm:ss"));
+                auto *itemBirthTime = new QTableWidgetItem((inContainer ? frame->modified : fi.birthTime()).toString("yyyy-MM-dd HH:mm:ss"));
                 itemBirthTime->setTextAlignment(Qt::AlignCenter);
 
-                auto *itemModifiedTime = new QTableWidgetItem(fi.lastModified().toString("yyyy-MM-dd HH:mm:ss"));
+                auto *itemModifiedTime = new QTableWidgetItem((inContainer ? frame->modified : fi.lastModified()).toString("yyyy-MM-dd HH:mm:ss"));
                 itemModifiedTime->setTextAlignment(Qt::AlignCenter);
 
-                auto *itemReadTime = new QTableWidgetItem(fi.lastRead().toString("yyyy-MM-dd HH:mm:ss"));
+                auto *itemReadTime = new QTableWidgetItem((inContainer ? frame->modified : fi.lastRead()).toString("yyyy-MM-dd HH:mm:ss"));
                 itemReadTime->setTextAlignment(Qt::AlignCenter);
 
                 ui->tableWidget_filelist->setItem(i, 0, itemName);
@@ -2503,7 +2510,7 @@ void OfflineWindow::onNGammaFilter()
                             .arg(indexToPrefix(cameraIndex))
                             .arg(i);
 
-                    if (!QFile::exists(filePath)){
+                    if (!ShotContainer::exists(filePath)){
                         continue;
                     }
 
@@ -188,7 +188,7 @@ public:
     void initNGammaPage();// nγ甄别
     void initCpsPage(); // 计数率
 
-    qint64 calculateTotalSize(const QFileInfoList& fileinfoList);
+    qint64 calculateTotalSize(const QFileInfoList& fileinfoList, const ShotContainer::FrameFiles& containerFrames);
     void loadRelatedFiles(const QString& src);
 
     QPixmap maskPixmap(QPixmap, QSize sz, QColor clrMask);
@@ -1,49 +1,29 @@
 ﻿#include "pciecommsdk.h"
 #include <math.h>
+#include <limits>
+#include <algorithm>
 #include <QDateTime>
 #include <QDir>
 #include <QDebug>
+#include <QMetaMethod>
+#include <QSettings>
 #include "datacompresswindow.h"
 #include "AppConfig.h"
+#include "shotstreamwriter.h"
+#include "shotfilewriter.h"
+#include "pretriggerring.h"
+#include "waveformcodec.h"
+#include "planarframe.h"
+#include "framereaderthread.h"
+#include "framebufferpool.h"
+#include "readydispatcher.h"
+#include "registertransaction.h"
 
-#ifdef _WIN32
-#define	XDMA_FILE_USER		"\\user"
-#define	XDMA_FILE_CONTROL	"\\control"
-#define XDMA_FILE_BYPASS	"\\bypass"
-#define	XDMA_FILE_H2C_0		"\\h2c_0"
-#define	XDMA_FILE_H2C_1		"\\h2c_1"
-#define	XDMA_FILE_H2C_2		"\\h2c_2"
-#define	XDMA_FILE_H2C_3		"\\h2c_3"
-#define	XDMA_FILE_C2H		"\\c2h"
-#define	XDMA_FILE_C2H_0		"\\c2h_0"
-#define	XDMA_FILE_C2H_1		"\\c2h_1"
-#define	XDMA_FILE_C2H_2		"\\c2h_2"
-#define	XDMA_FILE_C2H_3		"\\c2h_3"
-#define	XDMA_FILE_EVENT_0	"\\event_0"
-#define	XDMA_FILE_EVENT_1	"\\event_1"
-#define	XDMA_FILE_EVENT_2	"\\event_2"
-#define	XDMA_FILE_EVENT_3	"\\event_3"
-#else
-#define	XDMA_FILE_USER		"_user"
-#define	XDMA_FILE_CONTROL	"_control"
-#define XDMA_FILE_BYPASS	"_bypass"
-#define	XDMA_FILE_H2C_0		"_h2c_0"
-#define	XDMA_FILE_H2C_1		"_h2c_1"
-#define	XDMA_FILE_H2C_2		"_h2c_2"
-#define	XDMA_FILE_H2C_3		"_h2c_3"
-#define	XDMA_FILE_C2H_0		"_c2h_0"
-#define	XDMA_FILE_C2H_1		"_c2h_1"
-#define	XDMA_FILE_C2H_2		"_c2h_2"
-#define	XDMA_FILE_C2H_3		"_c2h_3"
-#define	XDMA_FILE_EVENT_0	"_event_0"
-#define	XDMA_FILE_EVENT_1	"_event_1"
-#define	XDMA_FILE_EVENT_2	"_event_2"
-#define	XDMA_FILE_EVENT_3	"_event_3"
-#endif
 
 // pciecommsdk.cpp 实现
 bool NoBufferingFile::open(const QString &fileName, QIODevice::OpenMode mode)
 {
+#ifdef _WIN32
     DWORD access = 0;
     if (mode & QIODevice::WriteOnly) access |= GENERIC_WRITE;
     if (mode & QIODevice::ReadOnly) access |= GENERIC_READ;
@@ -67,6 +47,23 @@ bool NoBufferingFile::open(const QString &fileName, QIODevice::OpenMode mode)
     }
 
     return QFile::open(reinterpret_cast<intptr_t>(hFile), mode, QFile::AutoCloseHandle);
+#else
+    int flags = O_DIRECT | O_SYNC;
+    if ((mode & QIODevice::ReadWrite) == QIODevice::ReadWrite) flags |= O_RDWR;
+    else if (mode & QIODevice::WriteOnly) flags |= O_WRONLY;
+    else flags |= O_RDONLY;
+    if (mode & QIODevice::WriteOnly) flags |= O_CREAT;
+    if (mode & QIODevice::Truncate) flags |= O_TRUNC;
+    if (mode & QIODevice::Append) flags |= O_APPEND;
+
+    int fd = ::open(QFile::encodeName(fileName).constData(), flags, 0644);
+    if (fd < 0) {
+        setErrorString(QString("open failed: %1").arg(errno));
+        return false;
+    }
+
+    return QFile::open(fd, mode, QFile::AutoCloseHandle);
+#endif
 }
 
 QStringList PCIeCommSdk::mEnumedDevices;// 搜索出来的采集卡设备列表，对应的是 boardIndex
@@ -76,7 +73,15 @@ PCIeCommSdk::PCIeCommSdk(QObject *parent)
 {
     QStringList args = QCoreApplication::arguments();
     if (args.size() == 1){
-        mPhysicalNames << CARD1_NAME << CARD2_NAME << CARD3_NAME;
+        if (XdmaDevice::fakeDeviceEnabled())
+            mPhysicalNames = XdmaDevice::enumFakeDevices();
+        else {
+#ifdef _WIN32
+            mPhysicalNames << CARD1_NAME << CARD2_NAME << CARD3_NAME;
+#else
+            mPhysicalNames = enumDevices();
+#endif
+        }
         mEnumedDevices = enumDevices();
         initCaptureThreads();        
     }
@@ -97,6 +102,35 @@ PCIeCommSdk::~PCIeCommSdk()
     }
 }
 
+void PCIeCommSdk::connectNotify(const QMetaMethod& signal)
+{
+    if (signal == QMetaMethod::fromSignal(&PCIeCommSdk::frameCaptured)){
+        for (CaptureThread* captureThread : qAsConst(mMapDeviceCaptureThread))
+            updateFrameForwarding(captureThread);
+    }
+    QObject::connectNotify(signal);
+}
+
+void PCIeCommSdk::disconnectNotify(const QMetaMethod& signal)
+{
+    // 断开所有连接（signal无效）时也要检查
+    if (!signal.isValid() || signal == QMetaMethod::fromSignal(&PCIeCommSdk::frameCaptured)){
+        for (CaptureThread* captureThread : qAsConst(mMapDeviceCaptureThread))
+            updateFrameForwarding(captureThread);
+    }
+    QObject::disconnectNotify(signal);
+}
+
+void PCIeCommSdk::updateFrameForwarding(CaptureThread* captureThread)
+{
+    // 只有外部订阅了逐帧信号才转发，CaptureThread据此跳过逐帧发信号
+    if (isSignalConnected(QMetaMethod::fromSignal(&PCIeCommSdk::frameCaptured)))
+        connect(captureThread, &CaptureThread::frameCaptured, this, &PCIeCommSdk::frameCaptured,
+                Qt::ConnectionType(Qt::DirectConnection | Qt::UniqueConnection));
+    else
+        disconnect(captureThread, &CaptureThread::frameCaptured, this, &PCIeCommSdk::frameCaptured);
+}
+
 // 枚举指定设备接口GUID下所有已连接设备，返回设备路径列表
 /*
     SetupDiEnumDeviceInterfaces 枚举指定设备接口GUID下所有已连接设备（已经禁用设备无法枚举到）
@@ -104,6 +138,10 @@ PCIeCommSdk::~PCIeCommSdk()
 */
 QStringList PCIeCommSdk::enumDevices()
 {
+    // 模拟采集卡，用于没有硬件的机器上调试和性能测试
+    if (XdmaDevice::fakeDeviceEnabled())
+        return XdmaDevice::enumFakeDevices();
+
 #ifdef _WIN32
     const GUID guid = {0x74c7e4a9, 0x6d5d, 0x4a70, {0xbc, 0x0d, 0x20, 0x69, 0x1d, 0xff, 0x9e, 0x9d}};
     QStringList lstDevices;
@@ -216,6 +254,10 @@ void PCIeCommSdk::printDevicesInfomation()
 /*判断采集卡是否存在*/
 bool PCIeCommSdk::boardExists(const quint8& physicalNo/*采集卡序号1-3*/)
 {
+#ifdef _WIN32
+    if (XdmaDevice::fakeDeviceEnabled())
+        return physicalNo >= 1 && physicalNo <= mEnumedDevices.size();
+
     QStringList lst = QStringList() << QStringLiteral("B189E7&0&0020") << QStringLiteral("10D89B97&0&0020") << QStringLiteral("18EC5E6B&0&0020");
     foreach(QString name, mEnumedDevices){
         if (name.toUpper().contains(lst[physicalNo-1]))
@@ -223,6 +265,9 @@ bool PCIeCommSdk::boardExists(const quint8& physicalNo/*采集卡序号1-3*/)
     }
 
     return false;
+#else
+    return physicalNo >= 1 && physicalNo <= mEnumedDevices.size();
+#endif
 }
 
 #ifdef _WIN32
@@ -241,6 +286,54 @@ void PCIeCommSdk::startCapture(quint32 deviceIndex, QString fileSavePath, quint3
         //     devicePath = "\\\\?\\PCI#VEN_10EE&DEV_9038&SUBSYS_000710EE&REV_00#4&18ec5e6b&0&0020#{74c7e4a9-6d5d-4a70-bc0d-20691dff9e9d}\\c2h_3";
 
         mMapDeviceCaptureThread[deviceIndex]->setParamter(fileSavePath, captureTimeSeconds, testMode);
+        mMapDeviceCaptureThread[deviceIndex]->setStreamingMode(AppConfig::instance().streamingSave(), AppConfig::instance().streamingRingFrames());
+        mMapDeviceCaptureThread[deviceIndex]->setReadyMode(AppConfig::instance().readyByInterrupt(), AppConfig::instance().sharedReadyPoll());
+        mMapDeviceCaptureThread[deviceIndex]->setReadMode(AppConfig::instance().stripedRead());
+        mMapDeviceCaptureThread[deviceIndex]->setWriterOptions(AppConfig::instance().writeQueueDepth(), AppConfig::instance().writeDirectIO());
+        mMapDeviceCaptureThread[deviceIndex]->setValidateMode(AppConfig::instance().frameCrcCheck());
+        mMapDeviceCaptureThread[deviceIndex]->setFlushMode(AppConfig::instance().asyncShotFlush() && (mMeasureMode & mmContinue), mMeasureMode & mmContinue);
+        mMapDeviceCaptureThread[deviceIndex]->setPreTriggerMode(mMeasureMode & mmPreTrigger, AppConfig::instance().preTriggerMs(), AppConfig::instance().preTriggerMaxArmSeconds() * 1000);
+        {
+            ZeroSuppressOptions options;
+            options.threshold = AppConfig::instance().zeroSuppressThreshold();
+            options.prePoints = AppConfig::instance().zeroSuppressPrePoints();
+            options.postPoints = AppConfig::instance().zeroSuppressPostPoints();
+            options.rawEvery = AppConfig::instance().zeroSuppressRawEvery();
+            mMapDeviceCaptureThread[deviceIndex]->setZeroSuppression(AppConfig::instance().zeroSuppression(), options);
+        }
+        mMapDeviceCaptureThread[deviceIndex]->setLosslessMode(AppConfig::instance().losslessSave());
+        mMapDeviceCaptureThread[deviceIndex]->setContainerMode(AppConfig::instance().containerSave());
+        mMapDeviceCaptureThread[deviceIndex]->setPlanarMode(AppConfig::instance().planarSave());
+
+        // 每个DDR占5个核心（采集线程+4个读线程），核心不够时循环复用
+        int pollerCpu = -1;
+        int dispatcherCpu = -1;
+        QVector<int> readerCpus(4, -1);
+        if (AppConfig::instance().threadPinning()){
+            QList<int> cpus = ThreadScheduler::parseCpuList(AppConfig::instance().captureCpuList());
+            if (cpus.isEmpty())
+                cpus = ThreadScheduler::defaultCpus();
+
+            // 共享轮询线程使用所有DDR之后的下一个核心，不与任何DDR的实时线程争用；没有空闲核心时不绑定
+            int ddrCount = mMapDeviceCaptureThread.isEmpty() ? 0 : int(mMapDeviceCaptureThread.lastKey());
+            dispatcherCpu = cpus.value(ddrCount * 5, -1);
+
+            int base = (deviceIndex - 1) * 5;
+            pollerCpu = cpus.at(base % cpus.size());
+            for (int i=0; i<4; ++i)
+                readerCpus[i] = cpus.at((base + 1 + i) % cpus.size());
+        }
+        mMapDeviceCaptureThread[deviceIndex]->setSchedulePolicy(ThreadScheduler::Policy(AppConfig::instance().schedPolicy()),
+                                                                AppConfig::instance().schedPriority(),
+                                                                pollerCpu,
+                                                                readerCpus);
+        ReadyDispatcher::instance().setSchedulePolicy(ThreadScheduler::Policy(AppConfig::instance().schedPolicy()),
+                                                      AppConfig::instance().schedPriority(),
+                                                      dispatcherCpu);
+        FrameBufferPool::instance().setHugePages(AppConfig::instance().hugePageBuffers());
+        FrameBufferPool::instance().setBudget((qint64)AppConfig::instance().bufferBudgetGB() << 30);
+        FrameBufferPool::instance().setCacheLimit((mMeasureMode & mmContinue) ? -1 : (1LL << 30));// 连续测量缓存整炮缓冲，只受预算限制
+        XdmaDevice::setBarMappingEnabled(AppConfig::instance().barMapping());
 
         //启动写文件线程
         mDeviceThreadRunning[deviceIndex] = true;
@@ -284,60 +377,49 @@ void PCIeCommSdk::stopAllCapture()
     }
 }
 
+void PCIeCommSdk::triggerAllCapture()
+{
+    qInfo().noquote() << "预触发采集：收到触发";
+    for (auto captureThread : mMapDeviceCaptureThread)
+        captureThread->trigger();
+}
+
 void PCIeCommSdk::init()
 {
+    using namespace XdmaRegDef;
     mEnumedDevices = enumDevices();
+    QList<RegisterTransaction> transactions;
     for (int boardIndex = 1; boardIndex <= mEnumedDevices.size(); ++boardIndex){
         quint8 physicalNo = physicalNoFromName(mEnumedDevices[boardIndex - 1]);
         if (!boardIsEnable(boardIndex))
             continue;
 
-        HANDLE fUserHandle = PCIeCommSdk::getHandle(mPhysicalNames[physicalNo-1] + XDMA_FILE_USER,
-                                                    GENERIC_READ | GENERIC_WRITE,
-                                                    FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE);
-        if (fUserHandle == INVALID_HANDLE_VALUE)
-            continue;
-
-        PCIeCommSdk::writeData(physicalNo, fUserHandle, 0x20000, QByteArray::fromHex("30 FA 34 12"));
-        ::QThread::msleep(100);
-        PCIeCommSdk::writeData(physicalNo, fUserHandle, 0x20000, QByteArray::fromHex("00 00 00 00"));
-        ::QThread::msleep(100);
-
-        CloseHandle(fUserHandle);
+        RegisterTransaction transaction(physicalNo, mPhysicalNames[physicalNo-1]);
+        transaction.command(regCommand(MEASURE_TIME_OFS, MEASURE_TIME_VALUE), REG_RESET_WAIT_MS, QStringLiteral("设置测量时间"));
+        transactions.append(transaction);
     }
+
+    RegisterTransaction::execAll(transactions, QStringLiteral("初始化"));
 }
 
 void PCIeCommSdk::reset()
 {
-    /*复位*/
+    /*复位：数采、DDR，然后重新设置测量时间，各卡并行*/
+    using namespace XdmaRegDef;
+    QList<RegisterTransaction> transactions;
     for (int boardIndex = 1; boardIndex <= mEnumedDevices.size(); ++boardIndex){
         quint8 physicalNo = physicalNoFromName(mEnumedDevices[boardIndex - 1]);
         if (!boardIsEnable(boardIndex))
             continue;
 
-        HANDLE fUserHandle = PCIeCommSdk::getHandle(mPhysicalNames[physicalNo-1] + XDMA_FILE_USER,
-                                             GENERIC_READ | GENERIC_WRITE,
-                                             FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE);
-        if (fUserHandle == INVALID_HANDLE_VALUE)
-            continue;
-
-        writeData(physicalNo, fUserHandle, 0x20000, QByteArray::fromHex("02 D0 34 12"));//数采
-        QThread::msleep(100);
-        writeData(physicalNo, fUserHandle, 0x20000, QByteArray::fromHex("00 00 00 00"));
-        QThread::msleep(100);
-        writeData(physicalNo, fUserHandle, 0x20000, QByteArray::fromHex("01 D0 34 12"));//DDR
-        QThread::msleep(100);
-        writeData(physicalNo, fUserHandle, 0x20000, QByteArray::fromHex("00 00 00 00"));
-
-        // 初始化，设置测量时间
-        writeData(physicalNo, fUserHandle, 0x20000, QByteArray::fromHex("30 FA 34 12"));//16-160ms 18-800ms 20-4000ms
-        ::QThread::msleep(100);
-        writeData(physicalNo, fUserHandle, 0x20000, QByteArray::fromHex("00 00 00 00"));
-        ::QThread::msleep(100);
-
-        CloseHandle(fUserHandle);
+        RegisterTransaction transaction(physicalNo, mPhysicalNames[physicalNo-1]);
+        transaction.command(CMD_RESET_ADC, REG_RESET_WAIT_MS, QStringLiteral("复位数采"));
+        transaction.command(CMD_RESET_DDR, REG_RESET_WAIT_MS, QStringLiteral("复位DDR"));
+        transaction.command(regCommand(MEASURE_TIME_OFS, MEASURE_TIME_VALUE), REG_RESET_WAIT_MS, QStringLiteral("设置测量时间"));
+        transactions.append(transaction);
     }
 
+    RegisterTransaction::execAll(transactions, QStringLiteral("复位"));
     qInfo().nospace() << "复位完成";
 }
 
@@ -346,6 +428,10 @@ bool PCIeCommSdk::boardIsEnable(quint8 boardIndex)
     if (boardIndex<=0)
         return false;
 
+#ifdef _WIN32
+    if (XdmaDevice::fakeDeviceEnabled())
+        return boardIndex <= mEnumedDevices.size();
+
     const GUID& deviceClassGuid = {0x74c7e4a9, 0x6d5d, 0x4a70, {0xbc, 0x0d, 0x20, 0x69, 0x1d, 0xff, 0x9e, 0x9d}};
 
     // 获取指定设备类的设备信息集合
@@ -386,10 +472,18 @@ bool PCIeCommSdk::boardIsEnable(quint8 boardIndex)
 
     SetupDiDestroyDeviceInfoList(hDevInfo);
     return false;
+#else
+    return boardIndex <= mEnumedDevices.size();
+#endif
 }
 
 bool PCIeCommSdk::setBoardEnable(quint8 boardIndex, bool enable)
 {
+#ifndef _WIN32
+    Q_UNUSED(boardIndex);
+    Q_UNUSED(enable);
+    return false;
+#else
     const GUID& deviceClassGuid = {0x74c7e4a9, 0x6d5d, 0x4a70, {0xbc, 0x0d, 0x20, 0x69, 0x1d, 0xff, 0x9e, 0x9d}};
 
     // 获取指定设备类的设备信息集合
@@ -460,6 +554,7 @@ bool PCIeCommSdk::setBoardEnable(quint8 boardIndex, bool enable)
     }
 
     return true;
+#endif
 }
 
 quint8 PCIeCommSdk::physicalNoToBoardIndex(const quint8& physicalNo)
@@ -475,58 +570,41 @@ void PCIeCommSdk::reboot()
 
 void PCIeCommSdk::setPSDThreshold()
 {
-    /* 设置PSD甄别阈值 */    
-    for (quint8 channelIndex = 1; channelIndex <= 18; ++channelIndex){
-        quint8 channelNo = (channelIndex-1) % 6 + 1;/*范围1~6*/
-        bool isDDR1 = channelNo <= 3 ? true : false;
-        quint8 physicalNo = (channelIndex-1) / 6 + 1;/*范围1~3*/
+    /* 设置PSD甄别阈值，每张卡6个通道排成一个事务，各卡并行 */
+    using namespace XdmaRegDef;
+    QList<RegisterTransaction> transactions;
+    for (quint8 physicalNo = 1; physicalNo <= 3; ++physicalNo){
         quint8 boardIndex = boardIndexFromName(mPhysicalNames[physicalNo - 1]);
 
         // 判断采集卡是否启用
         if (!boardIsEnable(boardIndex))
             continue;
 
-        // 判断通道是否启用
-        if (!AppConfig::instance().isEnableCapture(physicalNo, isDDR1))
-            continue;
+        RegisterTransaction transaction(physicalNo, mPhysicalNames[physicalNo-1]);
+        for (quint8 channelNo = 1; channelNo <= 6; ++channelNo){
+            quint8 channelIndex = (physicalNo - 1) * 6 + channelNo;/*范围1~18*/
+            bool isDDR1 = channelNo <= 3 ? true : false;
 
-        quint8 threshold = AppConfig::instance().psdThreshold(channelIndex);
-        HANDLE fUserHandle = PCIeCommSdk::getHandle(mPhysicalNames[physicalNo-1] + XDMA_FILE_USER,
-                                                    GENERIC_READ | GENERIC_WRITE,
-                                                    FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE);
-        if (fUserHandle == INVALID_HANDLE_VALUE)
-            continue;
+            // 判断通道是否启用
+            if (!AppConfig::instance().isEnableCapture(physicalNo, isDDR1))
+                continue;
 
-        quint64 address = 0x20000;
-        QByteArray command;
-        switch (channelNo){
-        case 1: command = QByteArray::fromHex("00 F1 34 12"); break;
-        case 2: command = QByteArray::fromHex("00 F2 34 12"); break;
-        case 3: command = QByteArray::fromHex("00 F3 34 12"); break;
-        case 4: command = QByteArray::fromHex("00 F4 34 12"); break;
-        case 5: command = QByteArray::fromHex("00 F5 34 12"); break;
-        case 6: command = QByteArray::fromHex("00 F6 34 12"); break;
+            quint8 threshold = AppConfig::instance().psdThreshold(channelIndex);
+            transaction.command(regCommand(CARD1_PSD_THRESHOLD_OFS + channelNo - 1, threshold), REG_OP_WAIT_MS,
+                                QStringLiteral("通道%1 PSD阈值").arg(channelIndex));
+            qInfo().nospace() << "通道" << channelIndex << "设置PSD阈值：" << threshold;
         }
-        command[0] = threshold;
-
-        writeData(physicalNo, fUserHandle, address, QByteArray::fromHex("00 00 00 00"));
-        ::QThread::msleep(10);
-
-        writeData(physicalNo, fUserHandle, address, command);//PSD阈值
-        ::QThread::msleep(10);
-
-        writeData(physicalNo, fUserHandle, address, QByteArray::fromHex("00 00 00 00"));
-        ::QThread::msleep(10);
-
-        qInfo().nospace() << "通道" << channelIndex << "设置PSD阈值：" << threshold;
-        CloseHandle(fUserHandle);
+        transactions.append(transaction);
     }
 
+    RegisterTransaction::execAll(transactions, QStringLiteral("设置PSD阈值"));
 }
 
 void PCIeCommSdk::setTriggerThreshold()
 {
-    /* 设置触发阈值 */
+    /* 设置触发阈值，各卡并行 */
+    using namespace XdmaRegDef;
+    QList<RegisterTransaction> transactions;
     for (quint8 physicalNo = 1; physicalNo <= 3; ++physicalNo){
         quint8 boardIndex = boardIndexFromName(mPhysicalNames[physicalNo - 1]);
 
@@ -539,63 +617,17 @@ void PCIeCommSdk::setTriggerThreshold()
             continue;
 
         quint16 threshold = AppConfig::instance().triggerThreshold();
-        HANDLE fUserHandle = PCIeCommSdk::getHandle(mPhysicalNames[physicalNo-1] + XDMA_FILE_USER,
-                                                    GENERIC_READ | GENERIC_WRITE,
-                                                    FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE);
-        if (fUserHandle == INVALID_HANDLE_VALUE)
-            continue;
 
-        // 保证句柄一定会被释放，避免泄漏
-        QScopeGuard handleGuard([fUserHandle](){ CloseHandle(fUserHandle); });
-
-        using namespace XdmaRegDef;
         // 拆分高低位寄存器配置
-        quint32 lowCmd = REG_CMD_BASE | THRESHOLD_LOW_OFS | (threshold & 0x00FF);
-        quint32 highCmd = REG_CMD_BASE | THRESHOLD_HIGH_OFS | (threshold >> 8);
-
-        writeRegAndClear(physicalNo, fUserHandle, USER_CTRL_ADDR, lowCmd);
-        writeRegAndClear(physicalNo, fUserHandle, USER_CTRL_ADDR, highCmd);
-
-        // quint64 address = 0x20000;
-
-        // QByteArray command = QByteArray::fromHex("00 F7 34 12");
-        // command[0] = threshold & 0x00FF; // 低位
-        // writeData(physicalNo, fUserHandle, address, command);//触发阈值低位
-        // ::QThread::msleep(10);
-
-        // writeData(physicalNo, fUserHandle, address, QByteArray::fromHex("00 00 00 00"));
-        // ::QThread::msleep(10);
-
-        // command = QByteArray::fromHex("00 F8 34 12");
-        // command[0] = threshold >> 8; // 高位
-        // writeData(physicalNo, fUserHandle, address, command);//触发阈值低位
-        // ::QThread::msleep(10);
-
-        // writeData(physicalNo, fUserHandle, address, QByteArray::fromHex("00 00 00 00"));
-        // ::QThread::msleep(10);
+        RegisterTransaction transaction(physicalNo, mPhysicalNames[physicalNo-1]);
+        transaction.command(regCommand(THRESHOLD_LOW_OFS, threshold & 0x00FF), REG_OP_WAIT_MS, QStringLiteral("触发阈值低位"));
+        transaction.command(regCommand(THRESHOLD_HIGH_OFS, threshold >> 8), REG_OP_WAIT_MS, QStringLiteral("触发阈值高位"));
+        transactions.append(transaction);
 
         qInfo().nospace() << "采集卡#" << (physicalNo) << "设置触发阈值：" << threshold;
     }
 
-}
-
-// 封装复用的写寄存器+清零握手函数
-inline bool PCIeCommSdk::writeRegAndClear(int physicalNo, HANDLE handle, quint64 addr, quint32 regValue)
-{
-    QByteArray cmd(4, 0x00);
-    // 拆分32位值到4字节（小端对齐，匹配你现有XDMA操作逻辑）
-    memcpy(cmd.data(), &regValue, sizeof(regValue));
-    if (!writeData(physicalNo, handle, addr, cmd)) {
-        qCritical() << "采集卡" << physicalNo << "寄存器0x" << QString::number(addr,16) << "写入失败";
-        return false;
-    }
-    QThread::msleep(XdmaRegDef::REG_OP_WAIT_MS);
-
-    // 写入清零握手
-    memset(cmd.data(), 0, 4);
-    writeData(physicalNo, handle, addr, cmd);
-    QThread::msleep(XdmaRegDef::REG_CLEAR_WAIT_MS);
-    return true;
+    RegisterTransaction::execAll(transactions, QStringLiteral("设置触发阈值"));
 }
 
 bool PCIeCommSdk::test()
@@ -650,11 +682,14 @@ bool PCIeCommSdk::analyzeHistorySpectrumData(const quint8& cameraIndex,
     for (int id = startFileId; id <= endFileId; ++id){
         QString filePath = QString("%1/%2%3spec%4.bin").arg(fileDir).arg(board_index).arg(sideFile).arg(id);
 
-        QFile f(filePath);
-        if (!f.open(QIODevice::ReadOnly))
+        QByteArray spectrumData;
+        if (!ShotContainer::readFile(filePath, spectrumData))
+            continue;
+        if (AppConfig::instance().crcVerifyOnRead()
+            && FrameValidator::verifyFrame(filePath, spectrumData) == FrameValidator::CrcMismatch){
+            qWarning().noquote() << "文件CRC校验失败：" << filePath;
             continue;
-        QByteArray spectrumData = f.readAll();
-        f.close();
+        }
 
         //计算出是当前文件波形的第几个数据点
         quint32 timeFrom;
@@ -787,39 +822,65 @@ bool PCIeCommSdk::analyzeHistoryWaveformData(const quint8& cameraIndex,
     int deviceIndex = (cameraIndex - 1) / CAMNUMBER_DDR_PER + 1;
     //根据通道号计算对应采集卡的第几通道
     quint8 cameraNo = (cameraIndex - 1) % CAMNUMBER_DDR_PER;
-    for (int id = startFileId; id <= endFileId; ++id){
+
+    // 整炮容器按索引中的实测帧时刻（以第1帧为零点）查找时间范围内的帧，跳过丢失的帧，允许半个包时长的抖动；
+    // 没有容器（单帧文件）时按文件序号依次读取
+    QVector<int> fileIds;
+    QSharedPointer<ShotContainerReader> container = ShotContainerReader::cached(ShotContainer::containerPath(fileDir, board_index, sideFile == "A"));
+    const ShotContainer::IndexEntry* firstEntry = container ? container->find(ShotContainer::Waveform, 1) : nullptr;
+    if (firstEntry){
+        const qint64 marginNs = qint64(PACKET_TIMELENGTH) * 1000000 / 2;
+        const qint64 beginNs = firstEntry->timeNs + qint64(timeStart) * 1000000 - marginNs;
+        const qint64 endNs = firstEntry->timeNs + qint64(timeStop) * 1000000 + marginNs;
+        for (const ShotContainer::IndexEntry& entry : container->findByTime(ShotContainer::Waveform, beginNs, endNs)){
+            if (int(entry.frameId) >= startFileId && int(entry.frameId) <= endFileId)
+                fileIds.append(int(entry.frameId));
+        }
+        std::sort(fileIds.begin(), fileIds.end());
+    }
+    else{
+        for (int id = startFileId; id <= endFileId; ++id)
+            fileIds.append(id);
+    }
+
+    for (int id : qAsConst(fileIds)){
         QString filePath = QString("%1/%2%3data%4.bin").arg(fileDir).arg(board_index).arg(sideFile).arg(id);
-        QVector<QVector<quint16>> ch(3);
-        if (DataAnalysisWorker::readBin3Ch_fast(filePath, ch[0], ch[1], ch[2], true)) {
 
-            //计算出是当前文件波形的第几个数据点
-            quint32 timeFrom;
-            quint32 timeTo;
+        //计算出是当前文件波形的第几个数据点
+        quint32 timeFrom;
+        quint32 timeTo = 0;
+        bool toEnd = true;//读到文件末尾
 
-            if (id == startFileId)
-                timeFrom = (timeStart % PACKET_TIMELENGTH) * 1000 * 1000 / 2;
-            else
-                timeFrom = 1;
+        if (id == startFileId)
+            timeFrom = (timeStart % PACKET_TIMELENGTH) * 1000 * 1000 / 2;
+        else
+            timeFrom = 1;
 
-            if (id == endFileId){
-                if ((timeStop % PACKET_TIMELENGTH) == 0)
-                    timeTo  = ch[cameraNo].size();
-                else
-                    timeTo = (timeStop % PACKET_TIMELENGTH) * 1000 * 1000 / 2;
-            }
-            else
-                timeTo  = ch[cameraNo].size();
+        if (id == endFileId && (timeStop % PACKET_TIMELENGTH) != 0){
+            timeTo = (timeStop % PACKET_TIMELENGTH) * 1000 * 1000 / 2;
+            toEnd = false;
+        }
+
+        const qint64 packPos = qint64(timeFrom) - 1;
+        qint64 point_num = toEnd ? -1 : qint64(timeTo) - timeFrom;
 
-            //计算出是当前文件波形的第几个数据点
-            int packPos = timeFrom - 1;
-            int point_num = timeTo - timeFrom;
+        // 只读取时间窗口以及两侧有限的邻域（用于扣基线），不再整帧读取和解交织
+        // 基线取采样值的众数，窗口两侧各补几千个采样点就足够稳定
+        const qint64 baselineMargin = 4096;//每侧采样点数（每点2ns，约8µs）
+        const qint64 readFirst = qMax<qint64>(0, packPos - baselineMargin);
+        const qint64 readCount = toEnd ? -1 : qMax<qint64>(0, packPos + point_num + baselineMargin - readFirst);
+        QVector<quint16> samples;
+        qint64 samplesPerChannel = 0;
+        if (DataAnalysisWorker::readBinChannelRange(filePath, cameraNo, readFirst, readCount, samples, samplesPerChannel, true)) {
+            if (toEnd)
+                point_num = samplesPerChannel - timeFrom;
 
             //扣基线，调整数据
-            qint16 baseline_ch = DataAnalysisWorker::calculateBaseline(ch[cameraNo]);
-            QVector<qint16> baselineAdjustData = DataAnalysisWorker::adjustDataWithBaseline(ch[cameraNo], baseline_ch, deviceIndex, cameraNo + 1);
+            qint16 baseline_ch = DataAnalysisWorker::calculateBaseline(samples);
+            QVector<qint16> baselineAdjustData = DataAnalysisWorker::adjustDataWithBaseline(samples, baseline_ch, deviceIndex, cameraNo + 1);
 
             //提取通道号的数据cameraNo
-            QVector<qint16> waveform = baselineAdjustData.mid(packPos, point_num);
+            QVector<qint16> waveform = baselineAdjustData.mid(int(packPos - readFirst), int(point_num));
 
             for (int i=0;i<waveform.size();++i)
                 waveformPair.insert((quint64)((id-startFileId)* PACKET_TIMELENGTH + timeStart) * 1000 * 1000  + i*2, waveform[i]);
@@ -1189,8 +1250,10 @@ bool PCIeCommSdk::writeData(quint8 physicalNo, HANDLE fd, quint64 offset, const
         return false;
     }
  #else
-    lseek(fd, offset, SEEK_SET);
-    write(fd, data.data(), data.size());
+    if (pwrite(fd, data.constData(), data.size(), offset) != data.size()) {
+        fprintf(stderr, "pwrite failed with errno: %d\n", errno);
+        return false;
+    }
 #endif
 
     qDebug() << "采集卡[" << physicalNo << "] writeData" << QString("0x%1").arg((quint64)offset, 8, 16, QLatin1Char('0')) << data.toHex(' ');
@@ -1238,8 +1301,10 @@ bool PCIeCommSdk::readData(HANDLE fd, quint64 offset, const QByteArray& data)
     // double time_usec = (double)(stop.QuadPart - start.QuadPart) / (double)freq.QuadPart;
     // qDebug().nospace() << data.size() << " bytes received in " << time_usec << "s";
 #else
-    lseek(fd, offset, SEEK_SET);
-    read(fd, (char*)data.data(), data.size());
+    if (pread(fd, (char*)data.data(), data.size(), offset) != data.size()) {
+        qDebug() << "pread fail, errno:" << errno;
+        return false;
+    }
 #endif
 
     return true;
@@ -1263,7 +1328,13 @@ HANDLE PCIeCommSdk::getHandle(QString path, quint32 dwDesiredAccess, quint32 dwF
                             dwFlagsAndAttributes,
                             NULL);
 #else
-    int fd = open(devicePath.toStdString().c_str(), flags/*O_RDWR*/);
+    int flags = O_RDONLY;
+    if ((dwDesiredAccess & GENERIC_READ) && (dwDesiredAccess & GENERIC_WRITE))
+        flags = O_RDWR;
+    else if (dwDesiredAccess & GENERIC_WRITE)
+        flags = O_WRONLY;
+    Q_UNUSED(dwFlagsAndAttributes);
+    int fd = ::open(path.toStdString().c_str(), flags/*O_RDWR*/);
     //int fd_usr = open("/dev/xdma0_user",O_RDWR);
 #endif
 
@@ -1315,6 +1386,8 @@ void PCIeCommSdk::initCaptureThreads()
             mMapDeviceCaptureThread.remove(deviceIndex);
             mDeviceThreadRunning[deviceIndex] = false;
         });
+        connect(captureThread, &CaptureThread::captureFailOccurred, this, &PCIeCommSdk::captureFailOccurred);
+        updateFrameForwarding(captureThread);
         connect(captureThread, &CaptureThread::captureFinished, this, [=](quint32 /*index*/, bool isDDR1){
             mDeviceThreadRunning[deviceIndex] = false;
 
@@ -1330,27 +1403,43 @@ void PCIeCommSdk::initCaptureThreads()
 
             if (allCaptureFinished)
             {
+                reportReadySkew();
                 emit captureFinished();
                 qInfo() << "数据采集完毕！";
             }
         }, Qt::DirectConnection);
 
-    // 设置线程亲和性(小于64核)
-#ifdef _WIN32
-        SetThreadAffinityMask(captureThread->currentThreadId(), deviceIndex << 1ULL);
-#else
-        cpu_set_t mask;// cpu核的集合
-        CPU_ZERO(&mask);// 将集合置为空集
-        CPU_SET(cardIndex, &mask);// 设置亲和力值
-        sched_setaffinity(0,sizeof(cpu_set_t),&mask);// 设置线程cpu亲和力
-
-#endif
-
+        // 线程亲和性和调度策略在线程内部设置（CaptureThread::applySchedulePolicy），这里设置只会作用于调用线程
         mMapDeviceCaptureThread[deviceIndex] = captureThread;
         mMapDeviceCaptureThread[deviceIndex]->start();
     }
 }
 
+void PCIeCommSdk::reportReadySkew()
+{
+    // DDR2晚于DDR1开始检测，包序号不对应，两侧分开统计
+    for (int side=0; side<2; ++side){
+        QList<QVector<qint64>> readyClockNs;
+        for (CaptureThread* captureThread : mMapDeviceCaptureThread){
+            if (captureThread->isDDR1() == (side == 0))
+                readyClockNs.append(captureThread->shotTiming().readyClockNs);
+        }
+        if (readyClockNs.size() < 2)
+            continue;
+
+        QVector<qint64> skews = ReadyDispatcher::edgeSkewNs(readyClockNs);
+        if (skews.isEmpty())
+            continue;
+
+        std::sort(skews.begin(), skews.end());
+        qInfo().nospace() << (side == 0 ? "DDR1" : "DDR2")
+                          << " 板间就绪偏差(us) 帧数：" << skews.size()
+                          << " 中位数：" << skews.at(skews.size() / 2) / 1000
+                          << " P99：" << skews.at((skews.size() - 1) * 99 / 100) / 1000
+                          << " 最大：" << skews.last() / 1000;
+    }
+}
+
 QByteArray PCIeCommSdk::reverseArray(const QByteArray& data, quint8 offset)
 {
     QByteArray result;
@@ -1367,6 +1456,12 @@ QByteArray PCIeCommSdk::reverseArray(const QByteArray& data, quint8 offset)
  * CaptureThread 采集数据线程====================================================
 */
 
+// 当前线程占用的CPU时间（us）
+static inline qint64 threadCpuTimeUs()
+{
+    return ThreadScheduler::currentThreadCpuTimeUs();
+}
+
 /**
 * @function name: CaptureThread
 * @brief 构造函数
@@ -1379,100 +1474,17 @@ QByteArray PCIeCommSdk::reverseArray(const QByteArray& data, quint8 offset)
 * @param[out]
 * @return
 */
-// 分配大页内存（需要管理员权限运行程序）
-static char* allocLargePhysicsPage(int size) {
-    // 获取大页最小粒度
-    ULONG largePageSize = GetLargePageMinimum();
-    // 对齐大小到大页粒度
-    int alignedSize = (size + largePageSize - 1) & ~(largePageSize - 1);
-    // 分配大页内存
-    char* buffer = reinterpret_cast<char*>(VirtualAlloc(NULL,
-                                                      alignedSize,
-                                                      MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES,
-                                                      PAGE_READWRITE));
-    return buffer;
-}
-
-static char* allocVirtualAlignedBuffer(size_t size,size_t alignment = 0){
-    if (alignment == 0){
-        SYSTEM_INFO sys_info;
-        GetSystemInfo(&sys_info);
-        alignment = sys_info.dwPageSize;
-    }
-
-    char* buffer = (char*)_aligned_malloc(size, alignment);
-    if (buffer){
-        for (int i=0; i<size; i+=alignment){
-            buffer[i] = 0;
-        }
-    }
-
-    return buffer;
-}
-
-static char* allocPhysicsAlignedBuffer(size_t size){
-    char* buffer = reinterpret_cast<char*>(VirtualAlloc(NULL,
-                                                         size,
-                                                         MEM_COMMIT | MEM_RESERVE,
-                                                         PAGE_READWRITE));
-    if (buffer){
-        bool lockOk= VirtualLock(buffer, size);
-        if (!lockOk){
-            // 内存锁定失败，通过逐页访问确保所有页都被提交到物理内存
-            SYSTEM_INFO sysInfo;
-            GetSystemInfo(&sysInfo);
-            const DWORD PAGE_SIZE = sysInfo.dwPageSize; // 使用系统实际页面大小更可靠
-            for (int i=0; i<size; i+=PAGE_SIZE){
-                buffer[i] = 0;
-            }
-        }
-    }
-
-    return buffer;
-}
-
-#include <processthreadsapi.h>
-static bool enableLargePagePrivilege(){
-    HANDLE hToken;
-    TOKEN_PRIVILEGES tp;
-    LUID luid;
-
-    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken)){
-        return false;
-    }
-
-    if (!LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME, &luid)){
-        CloseHandle(hToken);
-        return false;
-    }
-
-    tp.PrivilegeCount = 1;
-    tp.Privileges[0].Luid = luid;
-    tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
-    if (!AdjustTokenPrivileges(hToken, FALSE, &tp, sizeof(tp), NULL, NULL)){
-        CloseHandle(hToken);
-        return false;
-    }
-
-    CloseHandle(hToken);
-    return TRUE;
-}
-static char* allocLargePhysicalAlignedBuffer(size_t size){
-    ULONG largePageSize = GetLargePageMinimum();
-    int alignedSize = (size + largePageSize - 1) & ~(largePageSize - 1);
-    char *buf = reinterpret_cast<char*>(VirtualAlloc(NULL,
-                                                      alignedSize,
-                                                      MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES,
-                                                      PAGE_READWRITE));
-    return buf;
-}
-
 CaptureThread::CaptureThread(const quint32 deviceIndex, const quint32 physicalNo, const QString& deviceName, bool isDDR1/* = true*/)
     : mDeviceName(deviceName)
     , mDeviceIndex(deviceIndex)
     , mPhysicalNo(physicalNo)
     , mIsDDR1(isDDR1)
 {
+    mDevice = XdmaDevice::create(deviceName);
+    for (int i=0; i<4; ++i){
+        mStepReaders[i] = new FrameReaderThread(i);
+    }
+
 #if ENABLE_IOCP
     mPcieReader = new PcieIocpReader(this);
     // 初始化：4个分区，总大小800MB，每个分区默认200MB
@@ -1490,39 +1502,465 @@ CaptureThread::CaptureThread(const quint32 deviceIndex, const quint32 physicalNo
 #else
 #endif //ENABLE_IOCP
 
-    int capacity = 260;// 40ms, 4s共100帧，10s共250帧
+    // 帧缓冲不在这里分配：一次性内存模式在首次采集时分配，边采集边存储模式只分配环形缓冲
+    connect(this, &QThread::finished, this, &QThread::deleteLater);
+}
+
+bool CaptureThread::allocMemoryBuffers()
+{
+    // 按本炮帧数申请（40ms一帧，1s共25帧），保存完成后由releaseMemoryBuffers归还
+    int capacity = qMax<int>(1, mCaptureCount);
+    if (mDDRWaveformDatas.size() >= capacity)
+        return true;
+
     mDDRWaveformDatas.reserve(capacity);
     mRAMSpectrumDatas.reserve(capacity);
+    mWaveformBuffers.reserve(capacity);
+    mSpectrumBuffers.reserve(capacity);
     try{
-        for (int i=0; i < capacity; ++i){
-            // mDDRWaveformDatas.push_back(QByteArray(0x07270E00, 0));//200MB=0x0BEBC200 150MB=0x09600000 12*10e70=0x07270E00
-            // mRAMSpectrumDatas.push_back(QByteArray(0xA000, 0));
-            {
-                char* alignedBuffer = allocPhysicsAlignedBuffer(0x07270E00);//allocate_buffer(0x07270E00, 4096);
-                if (!alignedBuffer)
-                    qCritical() << i+1 << "allocate_buffer fail. err:" << GetLastError();
-                else{
-                    if ((ULONG64)alignedBuffer % 4096 != 0)
-                        qCritical() << i+1 << "allocate_buffer align fail.";
+        // 从共用缓冲池按采集卡所在NUMA节点申请，超出缓冲池预算时只采集已申请到的帧数
+        int numaNode = mDevice->numaNode();
+        for (int i=mDDRWaveformDatas.size(); i < capacity; ++i){
+            FrameBufferHandle waveformBuffer = FrameBufferPool::instance().acquire(XdmaRegDef::DDR_FRAME_SIZE, numaNode);
+            FrameBufferHandle spectrumBuffer = FrameBufferPool::instance().acquire(XdmaRegDef::RAM_FRAME_SIZE, numaNode);
+            if (!waveformBuffer || !spectrumBuffer){
+                // 上一炮还在后台写盘时，等它写完归还缓冲后再申请
+                int pending = mPendingFlushes.load();
+                if (pending > 0 && waitForFlushes(pending - 1)){
+                    --i;
+                    continue;
                 }
-
-                mDDRWaveformDatas.push_back(QByteArray::fromRawData(alignedBuffer, 0x07270E00));
+                qCritical() << i+1 << "allocate_buffer fail.";
+                break;
             }
 
-            {
-                char* alignedBuffer = allocPhysicsAlignedBuffer(0xA000);//allocate_buffer(0xA000, 4096);
-                if (!alignedBuffer)
-                    qCritical() << i+1 << "allocate_buffer fail. err:" << GetLastError();
-
-                mRAMSpectrumDatas.push_back(QByteArray::fromRawData(alignedBuffer, 0xA000));
-            }
+            mWaveformBuffers.push_back(waveformBuffer);
+            mSpectrumBuffers.push_back(spectrumBuffer);
+            mDDRWaveformDatas.push_back(waveformBuffer->toByteArray());
+            mRAMSpectrumDatas.push_back(spectrumBuffer->toByteArray());
         }
     }
     catch (const std::bad_alloc& e){
         qDebug() << "Memory allocation failed:" << e.what();
     }
 
-    connect(this, &QThread::finished, this, &QThread::deleteLater);
+    qInfo().nospace() << "[" << mPhysicalNo << "] " << (mIsDDR1 ? "DDR1" : "DDR2") << " " << FrameBufferPool::instance().statisticsText();
+
+    return !mDDRWaveformDatas.isEmpty();
+}
+
+void CaptureThread::releaseMemoryBuffers()
+{
+    // 帧缓冲和环形缓冲都归还缓冲池，下一炮按需重新申请（缓冲池中有缓存时不需要重新锁页）
+    mDDRWaveformDatas.clear();
+    mRAMSpectrumDatas.clear();
+    mWaveformBuffers.clear();
+    mSpectrumBuffers.clear();
+    mFrames.fill(CaptureFrameHandle());// 其他模块仍持有的帧在它们释放后才归还
+
+    if (mPreTriggerRing)
+        mPreTriggerRing->disarm();
+    delete mStreamWriter;
+    mStreamWriter = nullptr;
+    mFrameRing.reset();
+}
+
+bool CaptureThread::prepareStreaming()
+{
+    // 预触发时环中一直保留触发前的帧，另外留出边采集边存储的帧数给触发后的数据
+    int ringFrames = mStreamingRingFrames + (mPreTriggerEnabled ? mPreTriggerFrames : 0);
+    if (mFrameRing && mFrameRing->capacity() != ringFrames){
+        // 环形缓冲大小变了，重新创建
+        delete mStreamWriter;
+        mStreamWriter = nullptr;
+        mFrameRing.reset();
+    }
+
+    if (!mFrameRing){
+        mFrameRing = QSharedPointer<CaptureFrameRing>::create(ringFrames, XdmaRegDef::DDR_FRAME_SIZE, XdmaRegDef::RAM_FRAME_SIZE, mDevice->numaNode());
+        if (!mFrameRing->isValid()){
+            mFrameRing.reset();
+            return false;
+        }
+    }
+
+    if (!mStreamWriter){
+        mStreamWriter = new ShotStreamWriter();
+        mStreamWriter->setFrameWrittenCallback([this](quint32 frameNo, bool ok){
+            if (ok && frameNo < (quint32)mShotTiming.diskDoneNs.size())
+                mShotTiming.diskDoneNs[frameNo] = mShotTimer.nsecsElapsed();
+        });
+    }
+    mStreamWriter->setWriterOptions(mWriteQueueDepth, mWriteDirectIO);
+    mStreamWriter->setZeroSuppression(mZeroSuppress, mZeroSuppressOptions);
+    mStreamWriter->setLosslessCompression(mLosslessSave);
+    mStreamWriter->setContainerMode(mContainerSave);
+    mStreamWriter->setPlanarLayout(mPlanarSave);
+
+    mFrameRing->resetStatistics();
+    // 测试模式不保存数据，写盘线程只负责归还缓冲
+    mStreamWriter->beginShot(mSaveFilePath, mPhysicalNo, mIsDDR1, mEnableTestMode);
+
+    if (mPreTriggerEnabled){
+        if (!mPreTriggerRing)
+            mPreTriggerRing = new PreTriggerRing();
+        mPreTriggerRing->arm(mStreamWriter, mPreTriggerFrames);
+    }
+    return true;
+}
+
+void CaptureThread::recordFrameHeader(quint32 capturedRef, const QByteArray& waveform, const QByteArray& spectrum)
+{
+    if (capturedRef >= (quint32)mFrameHeaders.size())
+        return;
+
+    FrameHeader& header = mFrameHeaders[capturedRef];
+    if (waveform.size() >= 12){
+        memcpy(header.waveformHead, waveform.constData(), 12);
+        memcpy(header.waveformTail, waveform.constData() + waveform.size() - 12, 12);
+    }
+    if (spectrum.size() >= 16)
+        memcpy(header.spectrumHead, spectrum.constData(), 16);
+}
+
+quint32 CaptureThread::validateFrame(quint32 capturedRef, const QByteArray& waveform, const QByteArray& spectrum, bool readOk)
+{
+    if (capturedRef >= (quint32)mFrameHeaders.size())
+        return FrameValidator::NoFault;
+
+    quint32 faults = FrameValidator::NoFault;
+    if (!readOk){
+        faults = FrameValidator::ReadFailed;
+    }
+    else{
+        const FrameHeader& header = mFrameHeaders[capturedRef];
+        faults = FrameValidator::checkFrame(capturedRef, header.waveformHead, header.waveformTail, header.spectrumHead);
+
+        // 缓冲还在读线程手里，趁热计算CRC，写盘后离线读取时可以直接校验文件
+        if (mFrameCrcEnabled){
+            FrameCrc& crc = mFrameCrcs[capturedRef];
+            crc.frameNo = capturedRef;
+            crc.waveformCrc = FrameValidator::crc32c(waveform.constData(), waveform.size());
+            crc.spectrumCrc = FrameValidator::crc32c(spectrum.constData(), spectrum.size());
+        }
+    }
+
+    if (faults == FrameValidator::NoFault)
+        return faults;
+
+    // 只上报第一个异常帧，后面的异常帧只计数，避免刷屏
+    if (mFaultFrames++ == 0){
+        mFirstFaultFrame.store(capturedRef);
+        qCritical().nospace() << "[" << mPhysicalNo << "] " << (mIsDDR1 ? "DDR1" : "DDR2")
+                              << " 在线校验失败，帧序号:" << capturedRef << " " << FrameValidator::faultText(faults);
+        emit captureFailOccurred(mDeviceIndex, capturedRef);
+    }
+    return faults;
+}
+
+void CaptureThread::saveCrcFile()
+{
+    if (!mFrameCrcEnabled)
+        return;
+
+    QString crcFileName = FrameValidator::crcFileName(mSaveFilePath, mPhysicalNo, mIsDDR1);
+    int count = qMax<int>(0, mCapturedRef - mSavedFirstFrame + 1);
+
+    // 预触发时文件从mSavedFirstFrame开始重新编号，旁路文件按文件序号记录
+    QVector<FrameCrc> crcs = mFrameCrcs.mid(mSavedFirstFrame, count);
+    for (FrameCrc& crc : crcs){
+        if (crc.frameNo != 0)
+            crc.frameNo = crc.frameNo - mSavedFirstFrame + 1;
+    }
+    if (!FrameValidator::writeCrcFile(crcFileName, crcs)){
+        qWarning().nospace() << "[" << mPhysicalNo << "] " << (mIsDDR1 ? "DDR1" : "DDR2") << " CRC文件保存失败：" << crcFileName;
+    }
+}
+
+void CaptureThread::finishPreTrigger()
+{
+    QString ddrName = (mIsDDR1 ? "DDR1" : "DDR2");
+    if (!mPreTriggerRing->isFrozen()){
+        // 没有收到触发（等待超时或者采集卡停止测量），保存最后一段数据
+        qWarning().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 未收到触发，保存最后" << mPreTriggerFrames << "帧";
+    }
+    quint32 firstFrameNo = mPreTriggerRing->freeze();
+    mSavedFirstFrame = (firstFrameNo != 0) ? firstFrameNo : mCapturedRef + 1;
+    mPreTriggerRing->disarm();
+
+    // 文件序号从保存的第一帧开始编为1，记录触发帧对应的文件序号
+    quint32 triggerFileNo = (mTriggerFrameNo >= mSavedFirstFrame) ? mTriggerFrameNo - mSavedFirstFrame + 1 : 0;
+    if (!mEnableTestMode){
+        QSettings settings(QString("%1/%2%3trigger.ini").arg(mSaveFilePath).arg(mPhysicalNo).arg(mIsDDR1 ? 'A' : 'B'), QSettings::IniFormat);
+        settings.beginGroup("PreTrigger");
+        settings.setValue("Triggered", mTriggerFrameNo != 0);
+        settings.setValue("TriggerFileNo", triggerFileNo);
+        settings.setValue("PreTriggerFrames", mPreTriggerFrames);
+        settings.setValue("PostTriggerFrames", mCaptureCount);
+        settings.setValue("ArmedFrames", mSavedFirstFrame - 1);
+        settings.setValue("SavedFrames", mCapturedRef >= mSavedFirstFrame ? mCapturedRef - mSavedFirstFrame + 1 : 0);
+        settings.setValue("FrameTimeLength", PACKET_TIMELENGTH);
+        settings.endGroup();
+    }
+
+    qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 预触发采集结束，保存帧序号：" << mSavedFirstFrame << "~" << mCapturedRef
+                      << " 触发文件序号：" << triggerFileNo;
+}
+
+void CaptureThread::beginFrameRead(quint32 capturedRef, qint64 postNs)
+{
+    qint64 nowNs = mShotTimer.nsecsElapsed();
+    mDispatchLatencyUs[capturedRef] = (nowNs - postNs) / 1000;
+    mBeforeReadTime[capturedRef] = nowNs / 1000000;
+    mShotTiming.dmaStartNs[capturedRef] = nowNs;
+}
+
+qint64 CaptureThread::frameUtcNs(quint32 capturedRef) const
+{
+    // 就绪寄存器跳变时该包40ms的数据刚好采完，帧开始时刻向前推一个包时长
+    if (capturedRef >= (quint32)mShotTiming.readyNs.size() || mShotTiming.readyNs[capturedRef] <= 0)
+        return 0;
+    return mShotStartUtcNs + mShotTiming.readyNs[capturedRef] - qint64(PACKET_TIMELENGTH) * 1000000;
+}
+
+void CaptureThread::endFrameRead(quint32 capturedRef, quint8 step, const QByteArray& waveform, const QByteArray& spectrum, CaptureFrameSlot* slot, bool ok)
+{
+    qint64 nowNs = mShotTimer.nsecsElapsed();
+    mReadLatencyUs[capturedRef] = (nowNs - mShotTiming.dmaStartNs[capturedRef]) / 1000;
+    mAfterReadTime[capturedRef] = nowNs / 1000000;
+    mShotTiming.dmaEndNs[capturedRef] = nowNs;
+
+    recordFrameHeader(capturedRef, waveform, spectrum);
+    quint32 faults = validateFrame(capturedRef, waveform, spectrum, ok);
+
+    // 帧句柄直接引用DMA缓冲，写盘和在线分析共享，不复制
+    CaptureFrame* frame = new CaptureFrame;
+    frame->physicalNo = mPhysicalNo;
+    frame->isDDR1 = mIsDDR1;
+    frame->frameNo = capturedRef;
+    frame->step = step;
+    frame->readOk = ok;
+    frame->faults = faults;
+    frame->readyNs = mShotTiming.readyNs[capturedRef];
+    frame->captureUtcNs = frameUtcNs(capturedRef);
+    frame->dmaStartNs = mShotTiming.dmaStartNs[capturedRef];
+    frame->dmaEndNs = nowNs;
+    frame->waveformBuffer = slot ? slot->waveformBuffer : mWaveformBuffers.at(capturedRef-1);
+    frame->spectrumBuffer = slot ? slot->spectrumBuffer : mSpectrumBuffers.at(capturedRef-1);
+    frame->waveformSize = waveform.size();
+    frame->spectrumSize = spectrum.size();
+
+    CaptureFrameHandle handle;
+    if (slot){
+        // 最后一个持有者释放时归还环形缓冲槽位，所有帧释放之前环不会析构
+        QSharedPointer<CaptureFrameRing> ring = mFrameRing;
+        handle = CaptureFrameHandle(frame, [ring, slot](CaptureFrame* frame){
+            delete frame;
+            ring->release(slot);
+        });
+        if (mPreTriggerEnabled)
+            mPreTriggerRing->push(handle);
+        else
+            mStreamWriter->push(handle);
+    }
+    else{
+        handle = CaptureFrameHandle(frame);
+        mFrames[capturedRef] = handle;
+    }
+
+    if (isSignalConnected(QMetaMethod::fromSignal(&CaptureThread::frameCaptured)))
+        emit frameCaptured(mDeviceIndex, handle);
+}
+
+bool CaptureThread::openDataChannels()
+{
+    bool ok = mDevice->openChannel(XdmaDevice::chBypass);
+    for (int i=0; i<4; ++i){
+        ok &= mDevice->openChannel(XdmaDevice::c2hChannel(i));
+    }
+    return ok;
+}
+
+void CaptureThread::reportReadLatency()
+{
+    qint64 total = 0;
+    qint64 maxLatency = 0;
+    qint64 minLatency = std::numeric_limits<qint64>::max();
+    quint32 count = 0;
+    for (quint32 i=1; i<=mCapturedRef && i<(quint32)mReadLatencyUs.size(); ++i){
+        qint64 latency = mReadLatencyUs[i];
+        if (latency <= 0)
+            continue;
+
+        total += latency;
+        maxLatency = qMax(maxLatency, latency);
+        minLatency = qMin(minLatency, latency);
+        count++;
+    }
+
+    if (count == 0)
+        return;
+
+    QString ddrName = (mIsDDR1 ? "DDR1" : "DDR2");
+    qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 单帧DMA读取耗时(us)"
+                      << " 最小：" << minLatency
+                      << " 平均：" << total / count
+                      << " 最大：" << maxLatency;
+}
+
+void CaptureThread::reportEngineThroughput()
+{
+    // 忙时速度为该引擎读取字节数/读取耗时：条带读取时各引擎忙时速度比单引擎读取时明显下降，说明受PCIe链路限制；
+    // 忙时速度不变而占用率接近100%，说明受单个DMA引擎限制
+    QString ddrName = (mIsDDR1 ? "DDR1" : "DDR2");
+    QString engineText;
+    qint64 totalBytes = 0;
+    for (int i=0; i<4; ++i){
+        qint64 bytes = mShotTiming.engineBytes[i];
+        qint64 busyNs = mShotTiming.engineBusyNs[i];
+        double busyRate = busyNs > 0 ? bytes / 1e6 / (busyNs / 1e9) : 0.0;
+        double usage = mReadyWallTimeUs > 0 ? busyNs / 10.0 / mReadyWallTimeUs : 0.0;
+        engineText += QString(" c2h_%1 %2MB/s 占用%3%").arg(i).arg(busyRate, 0, 'f', 0).arg(usage, 0, 'f', 1);
+        totalBytes += bytes;
+    }
+
+    double totalRate = mReadyWallTimeUs > 0 ? totalBytes / 1e6 / (mReadyWallTimeUs / 1e6) : 0.0;
+    qInfo().noquote().nospace() << "[" << mPhysicalNo << "] " << ddrName
+                                << " 读取方式：" << (mStripedRead ? "条带" : "按区域")
+                                << " 平均速度：" << QString::number(totalRate, 'f', 0) << "MB/s"
+                                << engineText;
+}
+
+void CaptureThread::reportReadyDetection()
+{
+    qint64 total = 0;
+    qint64 maxLatency = 0;
+    quint32 count = 0;
+    for (quint32 i=1; i<=mCapturedRef && i<(quint32)mDetectLatencyUs.size(); ++i){
+        if (mDetectLatencyUs[i] <= 0)
+            continue;
+
+        total += mDetectLatencyUs[i];
+        maxLatency = qMax(maxLatency, mDetectLatencyUs[i]);
+        count++;
+    }
+
+    qint64 maxSchedLatency = 0;
+    qint64 maxDispatchLatency = 0;
+    for (quint32 i=1; i<=mCapturedRef && i<(quint32)mSchedLatencyUs.size(); ++i){
+        maxSchedLatency = qMax(maxSchedLatency, mSchedLatencyUs[i]);
+        maxDispatchLatency = qMax(maxDispatchLatency, mDispatchLatencyUs[i]);
+    }
+
+    QString ddrName = (mIsDDR1 ? "DDR1" : "DDR2");
+    double cpuUsage = mReadyWallTimeUs > 0 ? mReadyCpuTimeUs * 100.0 / mReadyWallTimeUs : 0.0;
+    qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName
+                      << " 就绪检测方式：" << (mReadyByInterrupt ? "中断" : (mSharedReadyPoll ? "共享轮询" : "轮询"))
+                      << " 检测延迟(us) 平均：" << (count > 0 ? total / count : 0)
+                      << " 最大：" << maxLatency
+                      << " 采集线程CPU占用：" << QString::number(cpuUsage, 'f', 1) << "%"
+                      << " 学习周期(us)：" << mReadyWaiter.periodNs() / 1000
+                      << " 周期抖动(us)：" << mReadyWaiter.jitterNs() / 1000
+                      << " 最大调度延迟(us) 采集线程：" << maxSchedLatency
+                      << " 读线程：" << maxDispatchLatency;
+}
+
+void CaptureThread::setWriterOptions(int queueDepth, bool directIO)
+{
+    this->mWriteQueueDepth = queueDepth;
+    this->mWriteDirectIO = directIO;
+}
+
+void CaptureThread::setValidateMode(bool crcEnabled)
+{
+    this->mFrameCrcEnabled = crcEnabled;
+}
+
+void CaptureThread::setFlushMode(bool async, bool keepBufferCache)
+{
+    this->mAsyncFlush = async;
+    this->mKeepBufferCache = keepBufferCache;
+}
+
+void CaptureThread::setZeroSuppression(bool enable, const ZeroSuppressOptions& options)
+{
+    this->mZeroSuppress = enable;
+    this->mZeroSuppressOptions = options;
+}
+
+void CaptureThread::setLosslessMode(bool enable)
+{
+    this->mLosslessSave = enable;
+}
+
+void CaptureThread::setContainerMode(bool enable)
+{
+    this->mContainerSave = enable;
+}
+
+void CaptureThread::setPlanarMode(bool enable)
+{
+    this->mPlanarSave = enable;
+}
+
+void CaptureThread::setPreTriggerMode(bool enable, quint32 preTriggerMs, quint32 maxArmMs)
+{
+    this->mPreTriggerEnabled = enable;
+    this->mPreTriggerFrames = qMax(1u, (preTriggerMs + PACKET_TIMELENGTH - 1) / PACKET_TIMELENGTH);
+    this->mArmFrames = qMax(mPreTriggerFrames, maxArmMs / PACKET_TIMELENGTH);
+    this->mTriggerRequested.store(false);
+}
+
+void CaptureThread::setSchedulePolicy(ThreadScheduler::Policy policy, int priority, int pollerCpu, const QVector<int>& readerCpus)
+{
+    this->mSchedPolicy = policy;
+    this->mSchedPriority = priority;
+    this->mPollerCpu = pollerCpu;
+    for (int i=0; i<4; ++i)
+        this->mReaderCpus[i] = readerCpus.value(i, -1);
+}
+
+void CaptureThread::applySchedulePolicy()
+{
+    QString ddrName = (mIsDDR1 ? "DDR1" : "DDR2");
+    QString error;
+    if (!ThreadScheduler::applyToCurrentThread(mPollerCpu, mSchedPolicy, mSchedPriority, &error))
+        qWarning().noquote().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 采集线程调度策略设置失败：" << error;
+
+    for (int i=0; i<4; ++i){
+        int cpu = mReaderCpus[i];
+        ThreadScheduler::Policy policy = mSchedPolicy;
+        int priority = mSchedPriority;
+        quint32 physicalNo = mPhysicalNo;
+        mStepReaders[i]->post([=](){
+            QString error;
+            if (!ThreadScheduler::applyToCurrentThread(cpu, policy, priority, &error))
+                qWarning().noquote().nospace() << "[" << physicalNo << "] " << ddrName << " 读线程" << i << "调度策略设置失败：" << error;
+        });
+    }
+
+    qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName
+                      << " 调度策略：" << ThreadScheduler::policyName(mSchedPolicy)
+                      << " 优先级：" << mSchedPriority
+                      << " 采集线程CPU：" << mPollerCpu
+                      << " 读线程CPU：" << mReaderCpus[0] << "," << mReaderCpus[1] << "," << mReaderCpus[2] << "," << mReaderCpus[3];
+}
+
+void CaptureThread::setReadMode(bool striped)
+{
+    this->mStripedRead = striped;
+}
+
+void CaptureThread::setReadyMode(bool byInterrupt, bool sharedPoll)
+{
+    this->mReadyByInterruptEnabled = byInterrupt;
+    this->mSharedReadyPollEnabled = sharedPoll;
+}
+
+void CaptureThread::setStreamingMode(bool enable, int ringFrames)
+{
+    this->mStreamingSave = enable;
+    this->mStreamingRingFrames = qMax(1, ringFrames);
 }
 
 CaptureThread::~CaptureThread()
@@ -1531,17 +1969,24 @@ CaptureThread::~CaptureThread()
     quit();
     wait();
 
-    for (auto& buf : mDDRWaveformDatas) {
-        VirtualUnlock(buf.data(), buf.size());
-        VirtualFree(buf.data(), 0, MEM_RELEASE);
-        //_aligned_free(buf.data());
-    }
-    for (auto& buf : mRAMSpectrumDatas) {
-        VirtualUnlock(buf.data(), buf.size());
-        VirtualFree(buf.data(), 0, MEM_RELEASE);
-        //_aligned_free(buf.data());
+    for (int i=0; i<4; ++i){
+        delete mStepReaders[i];
+        mStepReaders[i] = nullptr;
     }
 
+    releaseMemoryBuffers();
+    delete mFileWriter;
+    mFileWriter = nullptr;
+    if (mFlushWriter && mInterruptSave)
+        mFlushWriter->cancelPending();
+    delete mFlushWriter;// 等待后台写盘完成，写盘回调会访问本对象
+    mFlushWriter = nullptr;
+    delete mPreTriggerRing;
+    mPreTriggerRing = nullptr;
+
+    delete mDevice;
+    mDevice = nullptr;
+
     //关闭句柄
 #if ENABLE_IOCP
     if (mPcieReader) {
@@ -1562,94 +2007,46 @@ void CaptureThread::setParamter(const QString &saveFilePath, quint32 captureTime
 
 bool CaptureThread::startMeasure()
 {
-    auto writeData = [=](quint8 cardIndex, HANDLE fd, quint64 offset, const char* data, int size){
-#ifdef _WIN32
-        LARGE_INTEGER address;
-        address.QuadPart = offset;
-        if (INVALID_SET_FILE_POINTER == SetFilePointerEx(fd, address, NULL, FILE_BEGIN)) {
-            fprintf(stderr, "Error setting file pointer, win32 error code: %ld\n", GetLastError());
-            return false;
-        }
-
-        DWORD dwNumberOfBytesWritten;
-        if (!WriteFile(fd, data, size, &dwNumberOfBytesWritten, NULL)) {
-            fprintf(stderr, "WriteFile failed with Win32 error code: %d\n", GetLastError());
-            return false;
-        }
-#else
-        lseek(fd, offset, SEEK_SET);
-        write(fd, data.data(), data.size());
-#endif
-
-        return true;
-    };
-
-    HANDLE fHandle = PCIeCommSdk::getHandle(mDeviceName + XDMA_FILE_USER,
-                                         GENERIC_READ | GENERIC_WRITE,
-                                         FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE);
-    if (fHandle == INVALID_HANDLE_VALUE)
+    if (!mDevice->openChannel(XdmaDevice::chUser))
         return false;
 
     //QByteArray cmdClear = QByteArray::fromHex("00 00 00 00");
-    char cmdClear[4] = {0x00, 0x00, 0x00, 0x00};
-    writeData(mPhysicalNo, fHandle, 0x20000, cmdClear, 4);
+    mDevice->writeRegister(XdmaRegDef::USER_CTRL_ADDR, XdmaRegDef::CMD_CLEAR);
 
     //::QThread::msleep(1);
     this->delay(1000);
 
     // QByteArray cmdStart = QByteArray::fromHex("01 E0 34 12");
-    unsigned char cmdStart[4] = {0x01, 0xE0, 0x34, 0x12};
-    writeData(mPhysicalNo, fHandle, 0x20000, (const char*)cmdStart, 4);
-
-    CloseHandle(fHandle);
+    mDevice->writeRegister(XdmaRegDef::USER_CTRL_ADDR, XdmaRegDef::CMD_START_MEASURE);
     return true;
 }
 
 void CaptureThread::stopMeasure()
 {
     mInterruptSave = true;
+    // 后台写盘中还没开始写的波形一并丢弃，析构时不用等它们写完
+    if (mFlushWriter)
+        mFlushWriter->cancelPending();
 }
 
 void CaptureThread::clear()
 {
-    HANDLE fHandle = PCIeCommSdk::getHandle(mDeviceName + XDMA_FILE_USER,
-                                            GENERIC_READ | GENERIC_WRITE,
-                                            FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE);
-    if (fHandle == INVALID_HANDLE_VALUE)
+    if (!mDevice->writeRegister(XdmaRegDef::USER_CTRL_ADDR, XdmaRegDef::CMD_CLEAR))
         return ;
-
-    PCIeCommSdk::writeData(mPhysicalNo, fHandle, 0x20000, QByteArray::fromHex("00 00 00 00"));
-    CloseHandle(fHandle);
+    qDebug() << "采集卡[" << mPhysicalNo << "] writeData" << QString("0x%1").arg(XdmaRegDef::USER_CTRL_ADDR, 8, 16, QLatin1Char('0')) << "00 00 00 00";
 }
 
 void CaptureThread::empty()
 {
-    HANDLE fHandle = PCIeCommSdk::getHandle(mDeviceName + XDMA_FILE_USER,
-                                            GENERIC_READ | GENERIC_WRITE,
-                                            FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE);
-    if (fHandle == INVALID_HANDLE_VALUE)
+    if (!mDevice->writeRegister(XdmaRegDef::USER_CTRL_ADDR, XdmaRegDef::CMD_EMPTY))
         return ;
-
-    PCIeCommSdk::writeData(mPhysicalNo, fHandle, 0x20000, QByteArray::fromHex("01 F0 34 12"));
-    CloseHandle(fHandle);
+    qDebug() << "采集卡[" << mPhysicalNo << "] writeData" << QString("0x%1").arg(XdmaRegDef::USER_CTRL_ADDR, 8, 16, QLatin1Char('0')) << "01 f0 34 12";
 }
 
-#include <QEventLoop>
 void CaptureThread::delay(quint32 us)
 {
-    LARGE_INTEGER start;
-    LARGE_INTEGER stop;
-    LARGE_INTEGER freq;
-    QueryPerformanceFrequency(&freq);
-    QueryPerformanceCounter(&start);
-    while (true) {
-        QueryPerformanceCounter(&stop);
-        quint32 time_usec = (unsigned long long)(stop.QuadPart - start.QuadPart) / (double)freq.QuadPart * 1e6;
-        if (time_usec >= us)
-            break;
-
-        qApp->processEvents();
-    }
+    // 系统睡眠+自旋，工作线程中不能调用processEvents
+    mReadyWaiter.sleepFor((qint64)us * 1000);
 }
 
 bool CaptureThread::checkDataError()
@@ -1666,8 +2063,8 @@ bool CaptureThread::checkDataError()
     // 检测波形序号
     int lastSeq = 0;
     for (int i=0; i<this->mCapturedRef; ++i){
-        QByteArray pkgHead = PCIeCommSdk::reverseArray(mDDRWaveformDatas.at(i).left(12));
-        QByteArray pkgTail = PCIeCommSdk::reverseArray(mDDRWaveformDatas.at(i).right(12));
+        QByteArray pkgHead = PCIeCommSdk::reverseArray(QByteArray(mFrameHeaders[i+1].waveformHead, 12));
+        QByteArray pkgTail = PCIeCommSdk::reverseArray(QByteArray(mFrameHeaders[i+1].waveformTail, 12));
         int headSeq = (quint8)pkgHead[7];
         int tailSeq = (quint8)pkgTail[7];
         int currentSeq = headSeq;
@@ -1688,7 +2085,7 @@ bool CaptureThread::checkDataError()
     // 检测能谱序号
     lastSeq = 0;
     for (int i=0; i<this->mCapturedRef; ++i){
-        QByteArray pkgHead = PCIeCommSdk::reverseArray(mRAMSpectrumDatas.at(i).left(16), 16);
+        QByteArray pkgHead = PCIeCommSdk::reverseArray(QByteArray(mFrameHeaders[i+1].spectrumHead, 16), 16);
         bool ok = false;
         int currentSeq = pkgHead.mid(4, 2).toHex().toUInt(&ok, 16);
         if ((currentSeq - lastSeq) != 1){
@@ -1703,6 +2100,11 @@ bool CaptureThread::checkDataError()
     mDataError = waveformError | spectrumError | mIsRegisterInvalid;
     printDebugInfo();
 
+    if (mFaultFrames.load() > 0){
+        qCritical().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 在线校验失败帧数：" << mFaultFrames.load()
+                              << " 第一个异常帧序号：" << mFirstFaultFrame.load();
+    }
+
     if (!waveformError && !mIsRegisterInvalid){
         qDebug().nospace() << ">>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>> [" << mPhysicalNo << "] " << ddrName << " 波形正常";
         qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 波形正常";
@@ -1727,58 +2129,243 @@ bool CaptureThread::checkDataError()
         qCritical().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 能谱帧序号异常, 索引 = " << spectrumErrorIndex;
     }
 
-    if (!mEnableTestMode/*测试模式*/ || mDataError/*数据出现错误*/){
+    if (mRingCapture){
+        // 边采集边存储，数据在采集过程中已经写入硬盘
+        if (!mEnableTestMode && mStreamWriter){
+            qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << "数据已经全部存储到硬盘中！"
+                              << " 写入帧数：" << mStreamWriter->writtenFrames()
+                              << " 写入失败：" << mStreamWriter->failedFrames()
+                              << " 丢弃帧数：" << mDroppedFrames.load()
+                              << " 零压缩帧数：" << mStreamWriter->suppressedFrames()
+                              << " " << mStreamWriter->diskStatisticsText();
+            saveCrcFile();
+        }
+    }
+    else if (!mEnableTestMode/*测试模式*/ || mDataError/*数据出现错误*/){
+        saveMemoryBuffers();
+        saveCrcFile();
+    }
 
-        qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << "数据正在存储到硬盘中，请等待...";
+    // 清空内存耗时，暂时屏蔽
+    // for (int i=0; i<this->mCapturedRef; ++i){
+    //     memset(mDDRWaveformDatas[i].data(), 0, mDDRWaveformDatas[i].size());
+    //     memset(mRAMSpectrumDatas[i].data(), 0, mRAMSpectrumDatas[i].size());
+    // }
 
-        for (int i = 0; i < mCapturedRef; ++i)
-        {
-            if (mInterruptSave)
-                break;
+    return mDataError;
+}
 
-            {
-                QString filename = QString("%1/%2%3data%4.bin").arg(mSaveFilePath).arg(mPhysicalNo).arg(mIsDDR1 ? 'A' : 'B').arg(i+1);
-                QFile file(filename);
-                if (!file.open(QIODevice::WriteOnly)) {
-                    qDebug() << "Cannot open file for writing";
-                }
-                else{
-                    uchar *mappedBuffer = file.map(0, mRAMSpectrumDatas.at(i).size());
-                    if (mappedBuffer){
-                        memcpy(mappedBuffer, mRAMSpectrumDatas.at(i).data(), mRAMSpectrumDatas.at(i).size());
-                        file.unmap(mappedBuffer);
-                    }
-                    else {
-                        file.write(mDDRWaveformDatas.at(i));
-                    }
-                    file.close();
-                }
-            }
+void CaptureThread::saveMemoryBuffers()
+{
+    QString ddrName = (mIsDDR1 ? "DDR1" : "DDR2");
 
-            {
-                QString filename = QString("%1/%2%3spec%4.bin").arg(mSaveFilePath).arg(mPhysicalNo).arg(mIsDDR1 ? 'A' : 'B').arg(i+1);
-                QFile file(filename);
-                if (!file.open(QIODevice::WriteOnly)) {
-                    qDebug() << "Cannot open file for writing";
+    qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << "数据正在存储到硬盘中，请等待...";
+
+    if (!mFileWriter)
+        mFileWriter = new ShotFileWriter();
+    mFileWriter->setQueueDepth(mWriteQueueDepth);
+    mFileWriter->setDirectIO(mWriteDirectIO);
+    mFileWriter->resetStatistics();
+
+    // 异步写盘：波形交给后台写盘，写盘任务持有缓冲池句柄，写完后缓冲才归还；本炮所有波形写完时记录一次
+    struct ShotFlush {
+        std::atomic<int> remaining{1};// 提交完之前多占一个计数
+        std::atomic<int> written{0};
+        std::atomic<int> failed{0};
+        std::atomic<qint64> bytes{0};// 实际写入的字节数
+        QSharedPointer<std::atomic<quint32>> suppressed;
+        QSharedPointer<ShotContainerWriter> container;
+        quint32 frames = 0;
+        QString savePath;
+        QElapsedTimer timer;
+    };
+    QSharedPointer<ShotFlush> flush;
+    ShotFileWriter* waveformWriter = mFileWriter;
+    if (mAsyncFlush){
+        if (!mFlushWriter)
+            mFlushWriter = new ShotFileWriter();
+        mFlushWriter->setQueueDepth(mWriteQueueDepth);
+        mFlushWriter->setDirectIO(mWriteDirectIO);
+        waveformWriter = mFlushWriter;
+
+        flush = QSharedPointer<ShotFlush>::create();
+        flush->savePath = mSaveFilePath;
+        flush->timer.start();
+        mPendingFlushes++;
+    }
+    auto finishFlush = [this, ddrName](const QSharedPointer<ShotFlush>& flush){
+        double seconds = flush->timer.nsecsElapsed() / 1e9;
+        qInfo().noquote().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 后台写盘完成：" << flush->savePath
+                                    << " 帧数：" << flush->frames
+                                    << " 写入：" << flush->written.load()
+                                    << " 失败：" << flush->failed.load()
+                                    << " 零压缩：" << flush->suppressed->load()
+                                    << " 耗时(s)：" << QString::number(seconds, 'f', 2)
+                                    << " 速度：" << QString::number(seconds > 0 ? flush->bytes.load() / 1048576.0 / seconds : 0.0, 'f', 0) << "MB/s";
+        if (flush->container)
+            flush->container->close();
+        QMutexLocker locker(&mFlushMutex);
+        mPendingFlushes--;
+        mFlushDone.wakeAll();
+    };
+
+    // 零压缩、无损压缩和分平面的帧在写盘线程中转换，压缩没有意义时仍写原始数据
+    QSharedPointer<std::atomic<quint32>> suppressed = QSharedPointer<std::atomic<quint32>>::create(0);
+    if (flush)
+        flush->suppressed = suppressed;
+
+    // 整炮容器：异步写盘时在本炮波形全部写完后关闭
+    QSharedPointer<ShotContainerWriter> container;
+    if (mContainerSave){
+        container = QSharedPointer<ShotContainerWriter>::create();
+        QString containerPath = ShotContainer::containerPath(mSaveFilePath, mPhysicalNo, mIsDDR1);
+        if (!container->open(containerPath, mPhysicalNo, mIsDDR1, mWriteDirectIO, QDateTime::currentMSecsSinceEpoch())){
+            qCritical() << "创建整炮容器失败：" << containerPath;
+            container.reset();
+        }
+        if (flush)
+            flush->container = container;
+    }
+
+    ZeroSuppressOptions zeroSuppressOptions = mZeroSuppressOptions;
+    // done的第二个参数为实际写入的字节数（零压缩、无损压缩、分平面后的大小）
+    auto submitWaveform = [=](ShotFileWriter* writer, QString fileName, const QByteArray& waveform, quint32 frameNo, qint64 timeNs, quint32 faults,
+                              std::function<void(bool, qint64)> done){
+        std::function<QByteArray()> produce;
+        if (mZeroSuppress && !ZeroSuppressor::keepRaw(frameNo, faults, zeroSuppressOptions)){
+            produce = [=](){
+                QByteArray data = ZeroSuppressor::encode(waveform.constData(), waveform.size(), zeroSuppressOptions);
+                if (data.isEmpty())
+                    return waveform;
+
+                (*suppressed)++;
+                return data;
+            };
+        }
+        else if (mLosslessSave){
+            fileName = WaveformCodec::encodedFileName(fileName);
+            produce = [=](){
+                QByteArray data = WaveformCodec::encode(waveform.constData(), waveform.size());
+                return data.isEmpty() ? waveform : data;
+            };
+        }
+        else if (mPlanarSave){
+            produce = [=](){
+                QByteArray data = PlanarFrame::encode(waveform.constData(), waveform.size());
+                return data.isEmpty() ? waveform : data;
+            };
+        }
+
+        QSharedPointer<qint64> written = QSharedPointer<qint64>::create(waveform.size());
+        if (produce){
+            std::function<QByteArray()> encode = produce;
+            produce = [=](){
+                QByteArray data = encode();
+                *written = data.size();
+                return data;
+            };
+        }
+        std::function<void(bool)> onDone = [=](bool ok){
+            done(ok, *written);
+        };
+
+        if (container){
+            ShotContainer::IndexEntry entry = ShotContainer::makeEntry(ShotContainer::Waveform, frameNo, frameNo, timeNs);
+            if (produce)
+                writer->submit(container.data(), entry, produce, onDone);
+            else
+                writer->submit(container.data(), entry, waveform.constData(), waveform.size(), onDone);
+        }
+        else if (produce){
+            writer->submit(fileName, produce, onDone);
+        }
+        else{
+            writer->submit(fileName, waveform.constData(), waveform.size(), onDone);
+        }
+    };
+    auto submitSpectrum = [=](const QString& fileName, const QByteArray& spectrum, quint32 frameNo, qint64 timeNs, std::function<void(bool)> done){
+        if (container)
+            mFileWriter->submit(container.data(), ShotContainer::makeEntry(ShotContainer::Spectrum, frameNo, frameNo, timeNs), spectrum.constData(), spectrum.size(), done);
+        else
+            mFileWriter->submit(fileName, spectrum.constData(), spectrum.size(), done);
+    };
+
+    // 所有文件一次提交，由写盘线程池并发写入
+    for (quint32 i = 0; i < mCapturedRef && !mInterruptSave; ++i)
+    {
+        // 写盘任务持有帧句柄，两个文件都写完记为该帧落盘时刻；超时没有读的帧照旧写出缓冲内容，保持文件连续
+        quint32 frameNo = i + 1;
+        CaptureFrameHandle frame = mFrames.value(frameNo);
+        QByteArray waveform = frame ? frame->waveform() : mDDRWaveformDatas.at(i);
+        QByteArray spectrum = frame ? frame->spectrum() : mRAMSpectrumDatas.at(i);
+        qint64 timeNs = frame ? frame->captureUtcNs : frameUtcNs(frameNo);
+        QString dataFileName = QString("%1/%2%3data%4.bin").arg(mSaveFilePath).arg(mPhysicalNo).arg(mIsDDR1 ? 'A' : 'B').arg(i+1);
+        QString specFileName = QString("%1/%2%3spec%4.bin").arg(mSaveFilePath).arg(mPhysicalNo).arg(mIsDDR1 ? 'A' : 'B').arg(i+1);
+
+        if (flush){
+            // 下一炮开始后计时数组会重新分配，后台写盘不记录落盘时刻
+            // 计数在写盘任务释放时结算：中断保存时被丢弃的任务不执行回调，也要归还缓冲并结束本炮
+            FrameBufferHandle buffer = mWaveformBuffers.at(i);
+            flush->remaining++;
+            flush->frames++;
+            QSharedPointer<int> ticket(new int(0), [=](int* p){
+                delete p;
+                if (--flush->remaining == 0)
+                    finishFlush(flush);
+            });
+            submitWaveform(waveformWriter, dataFileName, waveform, frameNo, timeNs, frame ? frame->faults : 0, [=](bool ok, qint64 bytes){
+                Q_UNUSED(buffer)
+                Q_UNUSED(ticket)
+                if (ok){
+                    flush->written++;
+                    flush->bytes += bytes;
                 }
                 else{
-                    file.write(mRAMSpectrumDatas.at(i));
-                    file.close();
+                    flush->failed++;
                 }
-            }
+            });
+            submitSpectrum(specFileName, spectrum, frameNo, timeNs, nullptr);
+            continue;
+        }
+
+        QSharedPointer<std::atomic<int>> remaining = QSharedPointer<std::atomic<int>>::create(2);
+        auto onWritten = [=](bool ok){
+            if (--(*remaining) == 0 && ok && frameNo < (quint32)mShotTiming.diskDoneNs.size())
+                mShotTiming.diskDoneNs[frameNo] = mShotTimer.nsecsElapsed();
+        };
+        submitWaveform(mFileWriter, dataFileName, waveform, frameNo, timeNs, frame ? frame->faults : 0, [=](bool ok, qint64){ onWritten(ok); });
+        submitSpectrum(specFileName, spectrum, frameNo, timeNs, onWritten);
+    }
 
+    while (!mFileWriter->waitForDone(100)){
+        if (mInterruptSave){
+            mFileWriter->cancelPending();
+            if (mFlushWriter)
+                mFlushWriter->cancelPending();
         }
+    }
+    if (container && !flush)
+        container->close();
 
-        qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << "数据已经全部存储到硬盘中！";
+    if (flush){
+        if (--flush->remaining == 0)
+            finishFlush(flush);
+        qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << "能谱已经存储到硬盘中，波形在后台写盘，后台写盘炮数：" << mPendingFlushes.load();
+        return;
     }
 
-    // 清空内存耗时，暂时屏蔽
-    // for (int i=0; i<this->mCapturedRef; ++i){
-    //     memset(mDDRWaveformDatas[i].data(), 0, mDDRWaveformDatas[i].size());
-    //     memset(mRAMSpectrumDatas[i].data(), 0, mRAMSpectrumDatas[i].size());
-    // }
+    qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << "数据已经全部存储到硬盘中！ 零压缩帧数：" << suppressed->load() << " " << mFileWriter->statisticsText();
+}
 
-    return mDataError;
+bool CaptureThread::waitForFlushes(int maxPending)
+{
+    QMutexLocker locker(&mFlushMutex);
+    while (mPendingFlushes.load() > maxPending){
+        if (mIsStopped.load())
+            return false;
+        mFlushDone.wait(&mFlushMutex, 100);
+    }
+    return true;
 }
 
 void CaptureThread::printDebugInfo()
@@ -1800,8 +2387,8 @@ void CaptureThread::printDebugInfo()
 
     // 先输出包头信息
     for (int i=0; i<this->mCapturedRef; ++i){
-        QByteArray pkgHead = PCIeCommSdk::reverseArray(mDDRWaveformDatas.at(i).left(12));
-        QByteArray pkgTail = PCIeCommSdk::reverseArray(mDDRWaveformDatas.at(i).right(12));
+        QByteArray pkgHead = PCIeCommSdk::reverseArray(QByteArray(mFrameHeaders[i+1].waveformHead, 12));
+        QByteArray pkgTail = PCIeCommSdk::reverseArray(QByteArray(mFrameHeaders[i+1].waveformTail, 12));
         int headSeq = (quint8)pkgHead[7];
         int tailSeq = (quint8)pkgTail[7];
 
@@ -1833,21 +2420,23 @@ void CaptureThread::printDebugInfo()
     out << "================================================================================================\n\n";
 
     // 寄存器0值出现的时间段
-    out << QStringLiteral("数据来到之前寄存器0值出现的时间段\n");
-    for (int i = 0; i < zeroTime.size(); ++i){
-        out << "[" << mPhysicalNo << "] " << ddrName << " " << zeroTime[i] << "\n";
+    out << QStringLiteral("数据来到之前寄存器0值出现的时间段（µs）\n");
+    for (quint32 i = 0; i < mRegisterTrace.size(); ++i){
+        const CaptureTraceRecord& record = mRegisterTrace.at(i);
+        if (record.flags & CaptureTraceRing::ZeroBeforeData)
+            out << "[" << mPhysicalNo << "] " << ddrName << " " << QString::number(record.after / 1000.0, 'f', 3) << "\n";
     }
 
     // 读寄存器时间
-    for (const auto &outerPair : mRAMReadTime.toStdMap()){
-        quint16 outerKey = outerPair.first;
-        const auto& pairVec = outerPair.second;
-        for (int idx=0; idx<pairVec.size(); ++idx){
-            const auto& pair = pairVec[idx];
-            out << "[" << mPhysicalNo << "] " << ddrName << " " << outerKey << " " <<
-                QStringLiteral(" 读寄存器时刻：") << pair.first << "-" << pair.second.first <<
-                QStringLiteral(" 返回值：0x") << QString::number(pair.second.second, 16) << "\n";
-        }
+    if (mRegisterTrace.overwritten() > 0){
+        out << "[" << mPhysicalNo << "] " << ddrName <<
+            QStringLiteral(" 读寄存器记录已满，最早的") << mRegisterTrace.overwritten() << QStringLiteral("条被覆盖\n");
+    }
+    for (quint32 i = 0; i < mRegisterTrace.size(); ++i){
+        const CaptureTraceRecord& record = mRegisterTrace.at(i);
+        out << "[" << mPhysicalNo << "] " << ddrName << " " << record.frame << " " <<
+            QStringLiteral(" 读寄存器时刻（µs）：") << QString::number(record.before / 1000.0, 'f', 3) << "-" << QString::number(record.after / 1000.0, 'f', 3) <<
+            QStringLiteral(" 返回值：0x") << QString::number(record.value, 16) << "\n";
     }
 
     out << "================================================================================================\n\n";
@@ -1860,10 +2449,27 @@ void CaptureThread::printDebugInfo()
             QStringLiteral(" 读完数据时刻：") << mAfterReadTime[i] <<
             QStringLiteral(" 开始读延迟：") << (mRamChangedTime[i]-i*40) <<
             QStringLiteral(" 读花费时间：") << (mAfterReadTime[i]-mBeforeReadTime[i]) <<
+            QStringLiteral(" DMA耗时(us)：") << mReadLatencyUs[i] <<
+            QStringLiteral(" 检测延迟(us)：") << mDetectLatencyUs[i] <<
+            QStringLiteral(" 调度延迟(us)：") << mSchedLatencyUs[i] << "/" << mDispatchLatencyUs[i] <<
             QStringLiteral(" 累积延迟：") << (mAfterReadTime[i]-i*40) << (((mAfterReadTime[i]-i*40)>120) ? " ******\n" : "\n");
     }
 
     out << "================================================================================================\n\n";
+    out << "[" << mPhysicalNo << "] " << ddrName <<
+        QStringLiteral(" 就绪检测方式：") << (mReadyByInterrupt ? QStringLiteral("中断") : (mSharedReadyPoll ? QStringLiteral("共享轮询") : QStringLiteral("轮询"))) <<
+        QStringLiteral(" 采集线程CPU时间(us)：") << mReadyCpuTimeUs <<
+        QStringLiteral(" 采集时长(us)：") << mReadyWallTimeUs << "\n";
+    if (mRingCapture && mFrameRing && mStreamWriter){
+        out << "[" << mPhysicalNo << "] " << ddrName <<
+            QStringLiteral(" 环形缓冲帧数：") << mFrameRing->capacity() <<
+            QStringLiteral(" 最少空闲帧数：") << mFrameRing->minFreeCount() <<
+            QStringLiteral(" 丢弃帧数：") << mDroppedFrames.load() <<
+            QStringLiteral(" 写入帧数：") << mStreamWriter->writtenFrames() <<
+            QStringLiteral(" 写入字节数：") << mStreamWriter->writtenBytes() <<
+            QStringLiteral(" 写盘速度：") << mStreamWriter->diskStatisticsText() << "\n";
+    }
+
     if (!ok){
         out << "[" << mPhysicalNo << "] " << ddrName << " frames sequence exception, index = " << index;
     }
@@ -1884,65 +2490,26 @@ bool CaptureThread::dataExistError()
 // 参数：filePath - 文件路径，data - 要写入的数据，size - 数据大小（必须是扇区大小的整数倍，通常是512或4096字节）
 bool CaptureThread::writeFileWithNoBuffering(const QString &filePath, const char *data, qint64 size)
 {
-    // 1. 获取磁盘扇区大小（必须按扇区对齐写入，否则无缓存模式会失败）
-    DWORD bytesPerSector = 0;
-    QString drive = filePath.left(2) + "\\"; // 提取盘符如 "C:\\"
-    if (!GetDiskFreeSpaceA(drive.toLocal8Bit().constData(), nullptr, &bytesPerSector, nullptr, nullptr)) {
-        qWarning() << "获取扇区大小失败，错误码：" << GetLastError();
-        return false;
-    }
-
-    // 校验数据大小必须是扇区大小的整数倍
-    if (size % bytesPerSector != 0) {
-        qWarning() << "数据大小必须是扇区大小的整数倍，当前扇区大小：" << bytesPerSector;
-        return false;
-    }
-
-    // 2. 用Windows API创建带无缓存标记的文件句柄
-    HANDLE hFile = CreateFileW(
-        (LPCWSTR)filePath.utf16(),
-        GENERIC_WRITE,
-        0, // 独占访问
-        nullptr,
-        CREATE_ALWAYS, // 覆盖现有文件，需要追加用OPEN_ALWAYS
-        FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, // 无缓存+直写，完全绕过系统缓存
-        nullptr
-        );
-
-    if (hFile == INVALID_HANDLE_VALUE) {
-        qWarning() << "创建文件失败，错误码：" << GetLastError();
-        return false;
-    }
-
-    // 3. 将原生句柄交给QFile管理
-    QFile file;
-    if (!file.open(reinterpret_cast<intptr_t>(hFile), QIODevice::WriteOnly, QFile::AutoCloseHandle)) {
-        qWarning() << "QFile打开原生句柄失败：" << file.errorString();
-        CloseHandle(hFile);
-        return false;
-    }
-
-    // 4. 写入数据（QFile的写入接口和普通使用完全一致）
-    qint64 written = file.write(data, size);
-    file.flush();
-    file.close();
-
-    return written == size;
+    return ShotFileWriter::writeFile(filePath, data, size, true);
 }
 
 void CaptureThread::run()
 {
     qRegisterMetaType<QByteArray>("QByteArray");
+    qRegisterMetaType<CaptureFrameHandle>("CaptureFrameHandle");
     qRegisterMetaType<QVector<QPair<double,double>>>("QVector<QPair<double,double>>");
     //提升线程优先级
+#ifdef _WIN32
     timeBeginPeriod(1);// 可提高精度到2ms 需引用-lwinmm
+#endif
 
     const quint32 PACKING_DURATION = 50; // 打包时长
+    const qint64 READY_WAIT_TIMEOUT = 50;// 等待数据就绪超时（ms）
     const int IRQ_WAIT_TIMEOUT = 1;      // 中断等待超时（ms）
     const std::chrono::microseconds IRQ_POLL_INTERVAL = std::chrono::microseconds(1);
 
-    quint64 memOffet = mIsDDR1 ? 0 : 0x40000000;
-    quint64 memRamOffet = mIsDDR1 ? 0 : 0x40000;
+    quint64 memOffet = mIsDDR1 ? XdmaRegDef::DDR1_BASE : XdmaRegDef::DDR2_BASE;
+    quint64 memRamOffet = mIsDDR1 ? XdmaRegDef::RAM1_BASE : XdmaRegDef::RAM2_BASE;
 
     QElapsedTimer elapsedTimer;
     QByteArray readBuf(1, 0);
@@ -1954,30 +2521,13 @@ void CaptureThread::run()
 
     qDebug().nospace() << "[" << mPhysicalNo << (mIsDDR1 ? "] DDR1" : "] DDR2") << " 数据采集线程 id:" << this->currentThreadId();
 
-    // 创建线程池
-    QThreadPool* threadPool = new QThreadPool(this);
-    // 获取默认最大线程数（等于 CPU 核心数）
-    //int defaultThreads = QThreadPool::globalInstance()->maxThreadCount();
-    int defaultThreads = QThread::idealThreadCount() * 2;//()->maxThreadCount();
-    // 为 I/O 密集型任务调整最大线程数
-    threadPool->setMaxThreadCount(defaultThreads);
-    //threadPool->setExpiryTimeout(-1);//过期超时不收回
+    // 每个DDR区域一个专用读线程，读线程只使用自己对应的c2h通道
+    for (int i=0; i<4; ++i){
+        if (!mStepReaders[i]->isRunning())
+            mStepReaders[i]->start(QThread::HighestPriority);
+    }
 	QString ddrName = (mIsDDR1 ? "DDR1" : "DDR2");
 
-    mRamChangedTime.resize(500);// RAM值改变的时间
-    mBeforeReadTime.resize(500);// DDR读之前的时间
-    mAfterReadTime.resize(500);// DDR读之后的时间
-    mCreateThreadTime.resize(500);// DDR读之后的时间
-    mAfterCreateThreadTime.resize(500);// DDR读之后的时间
-
-    // 设置线程为实时优先级，确保采集不被打断
-    //SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
-
-    // 卡0绑定核心2，卡1绑定核心3，...，卡5绑定核心7
-    //DWORD_PTR affinityMask = 1LL << (mDeviceIndex + 2);
-    //SetThreadAffinityMask(GetCurrentThread(), affinityMask);
-    //SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
-
     while (true)
     {
         if (mIsStopped.load())
@@ -1992,10 +2542,10 @@ void CaptureThread::run()
                            << ddrName
                            << " 苏醒";
 
-        HANDLE fUserHandle = PCIeCommSdk::getHandle(mDeviceName + XDMA_FILE_USER,
-                                                GENERIC_READ | GENERIC_WRITE,
-                                                FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE);
-        if (fUserHandle == INVALID_HANDLE_VALUE)
+        // 每炮开始时按当前配置设置线程亲和性和实时优先级
+        applySchedulePolicy();
+
+        if (!mDevice->openChannel(XdmaDevice::chUser))
         {
             qCritical().noquote() << "[" << QString("0x%1").arg((quint64)QThread::currentThreadId(), 8, 16, QLatin1Char('0')) << "]"
                                << "[" << mPhysicalNo << "] "
@@ -2005,26 +2555,112 @@ void CaptureThread::run()
             continue ;
         }
 
+        // 数据通道每炮只打开一次，整炮采集过程中复用句柄
+        if (!openDataChannels()){
+            qCritical().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 数据通道打开失败，改为每次读取时临时打开";
+        }
+        qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName
+                          << " 寄存器访问：" << (mDevice->isBarMapped(XdmaDevice::chUser) ? "BAR映射" : "读写句柄")
+                          << " 能谱读取：" << (mDevice->isBarMapped(XdmaDevice::chBypass) ? "BAR映射" : "读写句柄");
+
         readBuf[0] = 0u;
         bool isFirstPacket = true;// 第一个数据包标识
         bool isOver = false;// 结束指令标识
         bool isTimeout = false;// 超时标识
         bool isPrintedTimeoutInfo = false; // 超时消息是否已经打印过一次
 
+        mRingCapture = mStreamingSave || mPreTriggerEnabled;
+        if (mRingCapture){
+            if (!prepareStreaming()){
+                qCritical().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 环形缓冲分配失败";
+                pause();
+                continue;
+            }
+        }
+        else{
+            // 双缓冲：一组在后台写盘，一组采集；前面还有两炮没写完说明硬盘跟不上，等最早的一炮写完
+            if (mAsyncFlush && mPendingFlushes.load() > 1){
+                QElapsedTimer waitTimer;
+                waitTimer.start();
+                waitForFlushes(1);
+                qWarning().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 硬盘写入速度跟不上，等待上一炮写盘(ms)：" << waitTimer.elapsed();
+            }
+
+            if (!allocMemoryBuffers()){
+                qCritical().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 内存分配失败";
+                pause();
+                continue;
+            }
+
+            // 一次性内存模式，采集帧数受缓冲数量限制
+            if (mCaptureCount > (quint32)mDDRWaveformDatas.size()){
+                qWarning().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 采集帧数超过内存缓冲数量，截断为" << mDDRWaveformDatas.size();
+                mCaptureCount = mDDRWaveformDatas.size();
+            }
+        }
+
+        // 预触发时先等待触发（最多mArmFrames帧），触发后再采集mCaptureCount帧
+        quint32 frameLimit = mCaptureCount + (mPreTriggerEnabled ? mArmFrames : 0);
+        mTriggerFrameNo = 0;
+        mSavedFirstFrame = 1;
+
+        // 按本次采集帧数分配计时和包头记录，多留1帧给结束标志
+        int recordSize = qMax<int>(500, frameLimit + 2);
+        mRamChangedTime.resize(recordSize);// RAM值改变的时间
+        mBeforeReadTime.resize(recordSize);// DDR读之前的时间
+        mAfterReadTime.resize(recordSize);// DDR读之后的时间
+        mCreateThreadTime.resize(recordSize);// DDR读之后的时间
+        mAfterCreateThreadTime.resize(recordSize);// DDR读之后的时间
+        mFrameHeaders.resize(recordSize);
+        mFrameHeaders.fill(FrameHeader());
+        mReadLatencyUs.resize(recordSize);
+        mReadLatencyUs.fill(0);
+        mDetectLatencyUs.resize(recordSize);
+        mDetectLatencyUs.fill(0);
+        mSchedLatencyUs.resize(recordSize);
+        mSchedLatencyUs.fill(0);
+        mDispatchLatencyUs.resize(recordSize);
+        mDispatchLatencyUs.fill(0);
+        mFrameCrcs.resize(recordSize);
+        mFrameCrcs.fill(FrameCrc());
+        mFrames.fill(CaptureFrameHandle(), recordSize);
+        mShotTiming.readyNs.fill(0, recordSize);
+        mShotTiming.readyClockNs.fill(0, recordSize);
+        mShotTiming.dmaStartNs.fill(0, recordSize);
+        mShotTiming.dmaEndNs.fill(0, recordSize);
+        mShotTiming.diskDoneNs.fill(0, recordSize);
+        for (int i=0; i<4; ++i){
+            mShotTiming.engineBytes[i] = 0;
+            mShotTiming.engineBusyNs[i] = 0;
+        }
+        mFaultFrames.store(0);
+        mFirstFaultFrame.store(0);
+        mDroppedFrames.store(0);
+
         mCapturedRef = 1;
         mIsRegisterInvalid = false;
         mRegisterInvalidPosition = 0;
         lastRegisterValue = 0x00;
-        quint64 offsetRegister = mIsDDR1 ? 0x0 : 0x10000;
+        quint64 offsetRegister = mIsDDR1 ? XdmaRegDef::DDR1_READY_ADDR : XdmaRegDef::DDR2_READY_ADDR;
 
         mRamChangedTime.fill(0);
         mBeforeReadTime.fill(0);
         mAfterReadTime.fill(0);
         mCreateThreadTime.fill(0);
         mAfterCreateThreadTime.fill(0);
-        mDDRReadTime.clear();
-        mRAMReadTime.clear();
-		zeroTime.clear();
+        mRegisterTrace.clear();
+
+        // 就绪检测方式：中断事件打不开时退回寄存器轮询
+        quint8 eventIndex = mIsDDR1 ? XdmaRegDef::DDR1_READY_EVENT : XdmaRegDef::DDR2_READY_EVENT;
+        mReadyByInterrupt = mReadyByInterruptEnabled;
+        if (mReadyByInterrupt && !mDevice->openEvent(eventIndex)){
+            qWarning().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 就绪中断事件打开失败，改用寄存器轮询";
+            mReadyByInterrupt = false;
+        }
+        mReadyWaiter.setNominalPeriodNs(mDevice->framePeriodNs());
+        mReadyWaiter.reset();
+        qint64 prevSampleNs = 0;// 上一次读寄存器（或中断唤醒）时刻
+        qint64 lastSampleNs = 0;// 本次读寄存器时刻
 
         this->mInterruptSave = false;
         qInfo().nospace() << "采集卡[" << mPhysicalNo << "] " << "发送开始测量指令";
@@ -2040,26 +2676,84 @@ void CaptureThread::run()
         // pause();
         // continue;
 
+        mReadyWaiter.takeMaxOvershootNs();// 开始测量前的睡眠不计入调度延迟
+        for (int i=0; i<4; ++i){
+            mStepReaders[i]->post([=](){
+                mReaderCpuStartUs[i] = threadCpuTimeUs();
+            });
+        }
         elapsedTimer.start();
+        mShotTimer = elapsedTimer;
+        mShotClockOffsetNs = ReadyDispatcher::instance().nowNs() - elapsedTimer.nsecsElapsed();
+        mShotStartUtcNs = QDateTime::currentMSecsSinceEpoch() * 1000000 - elapsedTimer.nsecsElapsed();
+        mReadyCpuTimeUs = threadCpuTimeUs();
+
+        // 轮询方式下交给共享轮询线程，本线程只等待跳变队列；在原来开始轮询的时刻接入，第一次读到的值与自己轮询时一致
+        mSharedReadyPoll = mSharedReadyPollEnabled && !mReadyByInterrupt;
+        if (mSharedReadyPoll)
+            mReadySource = ReadyDispatcher::instance().attach(mDevice, offsetRegister, mDevice->framePeriodNs());
         qDebug().nospace() << "[" << mPhysicalNo << "] "
                            << ddrName
                            << " 开始测量>>>>>>>>>>>>>>>>>>>>>>>>"
                            << elapsedTimer.elapsed();
 
-        for (;mCapturedRef <= this->mCaptureCount/* && !isTimeout*//*超时是否继续*/; ++mCapturedRef)
+        for (;mCapturedRef <= frameLimit/* && !isTimeout*//*超时是否继续*/; ++mCapturedRef)
         {
-            quint32 failCount = 0;
+            if (mPreTriggerEnabled){
+                // 外触发到达：冻结预触发缓冲，保留的帧开始写盘，再采集mCaptureCount帧
+                if (mTriggerFrameNo == 0 && mTriggerRequested.load()){
+                    mTriggerFrameNo = mCapturedRef;
+                    quint32 firstFrameNo = mPreTriggerRing->freeze();
+                    qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 收到触发，帧序号:" << mTriggerFrameNo
+                                      << " 保存触发前帧数：" << (firstFrameNo ? mTriggerFrameNo - firstFrameNo : 0);
+                }
+                if (mTriggerFrameNo != 0 && mCapturedRef >= mTriggerFrameNo + mCaptureCount)
+                    break;
+                if (mTriggerFrameNo == 0 && mCapturedRef > mArmFrames)// 等待触发超时
+                    break;
+            }
+
+            qint64 waitStartTime = elapsedTimer.elapsed();
+            qint64 maxHandoffNs = 0;// 共享轮询线程读到跳变到本线程被唤醒的最大延迟
             isTimeout = false;
 
             while (true)
             {
                 readBuf[0] = 0u;
-                qint64 innerKey = elapsedTimer.elapsed();
-                if (PCIeCommSdk::readData(fUserHandle, offsetRegister, readBuf))
+                qint64 traceBeforeNs = elapsedTimer.nsecsElapsed();
+                bool sampled = true;// 共享轮询时等待超时没有新值
+                bool readOk = true;
+                if (mReadySource){
+                    ReadyEdge edge;
+                    sampled = mReadySource->waitEdge(edge, READY_WAIT_TIMEOUT - (elapsedTimer.elapsed() - waitStartTime));
+                    if (sampled){
+                        readOk = edge.ok;
+                        readBuf[0] = edge.value;
+                        prevSampleNs = edge.prevSampleNs > 0 ? edge.prevSampleNs - mShotClockOffsetNs : 0;
+                        lastSampleNs = edge.sampleNs - mShotClockOffsetNs;
+                        traceBeforeNs = lastSampleNs;
+                        maxHandoffNs = qMax(maxHandoffNs, elapsedTimer.nsecsElapsed() - lastSampleNs);
+                    }
+                }
+                else{
+                    readOk = mDevice->read(XdmaDevice::chUser, offsetRegister, readBuf.data(), 1);
+                    if (readOk){
+                        prevSampleNs = lastSampleNs;
+                        lastSampleNs = elapsedTimer.nsecsElapsed();
+                    }
+                }
+
+                if (!sampled)
+                {
+                    // 寄存器值没有变化，下面检查超时
+                    readBuf[0] = lastRegisterValue;
+                }
+                else if (readOk)
                 {
-                    // 记录读数前后时刻
-                    qint64 outnerKey = elapsedTimer.elapsed();
-                    mRAMReadTime[mCapturedRef].push_back(qMakePair(innerKey, qMakePair(outnerKey, (quint8)readBuf[0])));
+                    // 记录读数前后时刻（正式数据包之前出现的0x00单独标记）
+                    qint64 outnerKey = lastSampleNs / 1000000;
+                    quint8 traceFlags = ((quint8)readBuf[0] == 0x00 && isFirstPacket) ? CaptureTraceRing::ZeroBeforeData : 0;
+                    mRegisterTrace.push(mCapturedRef, (quint8)readBuf[0], traceBeforeNs, lastSampleNs, traceFlags);
                     if ((quint8)readBuf[0] == 0x00){
                         // 数据还没准备好
                         if (!isFirstPacket){
@@ -2073,10 +2767,6 @@ void CaptureThread::run()
                                                   << " 帧序号:" << mCapturedRef;// 测试停止，最后一个数据包序号无效，所以减1
                             break;
                         }
-                        else{
-                            // 记录正式数据包之前，寄存器值0x00出现的时间
-                            zeroTime.push_back(outnerKey);
-                        }
                     }
                     else if ((quint8)readBuf[0] == 0x10){
                         if (!isFirstPacket){
@@ -2122,7 +2812,8 @@ void CaptureThread::run()
                     break;
                 }
 
-                if (++failCount>=50)//50ms
+                qint64 waitedTime = elapsedTimer.elapsed() - waitStartTime;
+                if (waitedTime >= READY_WAIT_TIMEOUT)//50ms
                 {
                     isTimeout = true;
                     mIsRegisterInvalid = true;
@@ -2137,10 +2828,27 @@ void CaptureThread::run()
                     break;
                 }
 
-                //QThread::msleep(1);//精度2ms
-                delay(1000);//精度1us
+                if (mReadyByInterrupt){
+                    // 阻塞等待就绪中断，唤醒后回到循环开头读寄存器确认
+                    XdmaDevice::WaitResult ret = mDevice->waitEvent(eventIndex, READY_WAIT_TIMEOUT - waitedTime);
+                    if (ret == XdmaDevice::wrSignaled){
+                        lastSampleNs = elapsedTimer.nsecsElapsed();
+                    }
+                    else if (ret == XdmaDevice::wrError){
+                        qWarning().nospace() << "[" << mPhysicalNo << "] " << ddrName << " 等待就绪中断失败，改用寄存器轮询";
+                        mReadyByInterrupt = false;
+                    }
+                }
+                else if (!mReadySource){
+                    // 按学到的节拍等待：离预计跳变较远时睡眠，临近时自旋
+                    mReadyWaiter.waitBeforePoll(elapsedTimer);
+                }
             }
 
+            // 等待本帧期间的最大唤醒延迟，超时帧也记录，用于对比调度策略的效果；共享轮询时为跳变交接到本线程的延迟
+            qint64 overshootNs = mReadyWaiter.takeMaxOvershootNs();
+            mSchedLatencyUs[mCapturedRef] = (mReadySource ? maxHandoffNs : overshootNs) / 1000;
+
             if (isOver)
                 break;
 
@@ -2148,11 +2856,18 @@ void CaptureThread::run()
                 continue;
             }
 
+            // 检测延迟：轮询方式为两次读寄存器的间隔（上限），中断方式为中断唤醒到读寄存器确认的时间
+            if (prevSampleNs > 0)
+                mDetectLatencyUs[mCapturedRef] = (lastSampleNs - prevSampleNs) / 1000;
+            mReadyWaiter.onTransition(lastSampleNs);
+            mShotTiming.readyNs[mCapturedRef] = lastSampleNs;
+            mShotTiming.readyClockNs[mCapturedRef] = lastSampleNs + mShotClockOffsetNs;
+
 #if ENABLE_IOCP
             mPcieReader->submitReadRequestByStep(readBuf[0]);
 #else
             //读原始数据
-            quint16 capturedRef = mCapturedRef;
+            quint32 capturedRef = mCapturedRef;
             quint8 step = 0;
             if (lastRegisterValue == 0x11)
                 step = 0;
@@ -2165,29 +2880,69 @@ void CaptureThread::run()
             else
                 continue;
 
+            // 边采集边存储：从环形缓冲取空闲帧，硬盘跟不上时最多等待一个采集周期，仍然没有就丢弃该帧
+            CaptureFrameSlot* slot = nullptr;
+            if (mRingCapture){
+                slot = mFrameRing->acquire(PACKET_TIMELENGTH);
+                if (!slot){
+                    if (mDroppedFrames++ == 0){
+                        qCritical().nospace() << "[" << mPhysicalNo << "] " << ddrName
+                                              << " 环形缓冲已满，硬盘写入速度跟不上，丢弃帧序号:" << capturedRef;
+                    }
+                    continue;
+                }
+            }
+
 			mCreateThreadTime[capturedRef] = elapsedTimer.elapsed();
-            threadPool->start([=](){
-                // 设置线程为实时优先级，确保采集不被打断
-                //SetThreadPriority(QThread::currentThreadId(), THREAD_PRIORITY_TIME_CRITICAL);
+            qint64 postNs = elapsedTimer.nsecsElapsed();
+            if (mStripedRead){
+                // 条带读取：一帧拆成4段，由4个读线程分别在c2h_0~3上并行读取，最后读完的一段负责校验和提交
+                QSharedPointer<std::atomic<int>> remaining = QSharedPointer<std::atomic<int>>::create(XdmaRegDef::C2H_ENGINE_COUNT);
+                QSharedPointer<std::atomic<bool>> started = QSharedPointer<std::atomic<bool>>::create(false);
+                QSharedPointer<std::atomic<bool>> failed = QSharedPointer<std::atomic<bool>>::create(false);
+                for (quint8 engine=0; engine<XdmaRegDef::C2H_ENGINE_COUNT; ++engine){
+                    mStepReaders[engine]->post([=](){
+                        if (!started->exchange(true))
+                            beginFrameRead(capturedRef, postNs);
+
+                        const QByteArray& waveform = slot ? slot->waveform : mDDRWaveformDatas.at(capturedRef-1);
+                        const QByteArray& spectrum = slot ? slot->spectrum : mRAMSpectrumDatas.at(capturedRef-1);
+
+                        qint64 partOffset = (qint64)engine * XdmaRegDef::C2H_STRIPE_SIZE;
+                        qint64 partSize = qBound<qint64>(0, waveform.size() - partOffset, XdmaRegDef::C2H_STRIPE_SIZE);
+                        bool ok = readWaveformRange(engine, (char*)waveform.constData() + partOffset, partSize,
+                                                    memOffet + step * XdmaRegDef::DDR_STEP_STRIDE + partOffset);
+                        //能谱数据很小，由就绪区域对应的读线程顺带读取
+                        if (engine == step)
+                            ok &= readSpectrumData(step, spectrum, memRamOffet + step * XdmaRegDef::RAM_STEP_STRIDE);
+                        if (!ok)
+                            failed->store(true);
+
+                        if (--(*remaining) == 0)
+                            endFrameRead(capturedRef, step, waveform, spectrum, slot, !failed->load());
+                    });
+                }
+            }
+            else{
+                mStepReaders[step]->post([=](){
+                    beginFrameRead(capturedRef, postNs);
 
-                // 绑定到固定CPU核心，避免核心切换开销
-                //SetThreadAffinityMask(QThread::currentThreadId(), step << 1ULL);
+                    const QByteArray& waveform = slot ? slot->waveform : mDDRWaveformDatas.at(capturedRef-1);
+                    const QByteArray& spectrum = slot ? slot->spectrum : mRAMSpectrumDatas.at(capturedRef-1);
 
-                mBeforeReadTime[capturedRef] = elapsedTimer.elapsed();
-                //读波形数据
-                readWaveformData(step, mDDRWaveformDatas.at(capturedRef-1), memOffet + step * 0x07271400);
-                //读能谱数据
-                readSpectrumData(step, mRAMSpectrumDatas.at(capturedRef-1), memRamOffet + step * 0xA000);
-				mAfterReadTime[capturedRef] = elapsedTimer.elapsed();
+                    //读波形数据
+                    bool ok = readWaveformData(step, waveform, memOffet + step * XdmaRegDef::DDR_STEP_STRIDE);
+                    //读能谱数据
+                    ok &= readSpectrumData(step, spectrum, memRamOffet + step * XdmaRegDef::RAM_STEP_STRIDE);
 
-            }, QThread::HighestPriority);
+                    endFrameRead(capturedRef, step, waveform, spectrum, slot, ok);
+                });
+            }
 
             mAfterCreateThreadTime[capturedRef] = elapsedTimer.elapsed();
         }
 #endif //ENABLE_IOCP
 
-        CloseHandle(fUserHandle);
-
         if (!isOver)// 循环次数到了，最后一个异常数据包计数减1
             mCapturedRef--;
 
@@ -2198,10 +2953,34 @@ void CaptureThread::run()
 
             //emit captureFinished(mDeviceIndex, mIsDDR1);
 
-            threadPool->waitForDone();
+            for (int i=0; i<4; ++i){
+                mStepReaders[i]->post([=](){
+                    mShotTiming.readerCpuUs[i] = threadCpuTimeUs() - mReaderCpuStartUs[i];
+                });
+                mStepReaders[i]->waitForDone();
+            }
+            if (mReadySource){
+                ReadyDispatcher::instance().detach(mReadySource);
+                mReadySource = nullptr;
+            }
+            mDevice->closeAll();
+
+            if (mPreTriggerEnabled)
+                finishPreTrigger();
+            if (mRingCapture)
+                mStreamWriter->finishShot();
+            mReadyCpuTimeUs = threadCpuTimeUs() - mReadyCpuTimeUs;
+            mReadyWallTimeUs = elapsedTimer.nsecsElapsed() / 1000;
             qInfo().nospace() << "[" << mPhysicalNo << "] " << ddrName << "采集结束，共采集：" << mCapturedRef;
+            reportReadLatency();
+            reportEngineThroughput();
+            reportReadyDetection();
 
             checkDataError();
+            releaseMemoryBuffers();
+            // 单次测量保存完成后释放缓冲池缓存，不长期占用锁页内存
+            if (!mKeepBufferCache)
+                FrameBufferPool::instance().trim();
             emit captureFinished(mPhysicalNo, mIsDDR1);
 
             pause();
@@ -2217,7 +2996,9 @@ void CaptureThread::run()
         }
     }
 
+#ifdef _WIN32
     timeEndPeriod(1);
+#endif
 
     // 报告线程退出
     emit threadExitOccurred(mDeviceIndex);
@@ -2226,6 +3007,9 @@ void CaptureThread::run()
 
 bool CaptureThread::readDataAsync(HANDLE fd, quint64 offset, const QByteArray& data)
 {
+#ifndef _WIN32
+    return pread(fd, (char*)data.constData(), data.size(), offset) == data.size();
+#else
     OVERLAPPED overlapped = {0};
     overlapped.hEvent = CreateEvent(nullptr, true, false, nullptr);
     overlapped.Offset = offset;
@@ -2256,6 +3040,7 @@ bool CaptureThread::readDataAsync(HANDLE fd, quint64 offset, const QByteArray& d
     CloseHandle(overlapped.hEvent);
 
     return true;
+#endif
 }
 
 /**
@@ -2267,10 +3052,20 @@ bool CaptureThread::readDataAsync(HANDLE fd, quint64 offset, const QByteArray& d
 */
 bool CaptureThread::readWaveformData(quint8 index, const QByteArray& data, const quint64 offset)
 {
-    HANDLE fHandle = PCIeCommSdk::getHandle(mDeviceName + XDMA_FILE_C2H + "_" + QString::number(index));//, FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_FLAG_OVERLAPPED);
-    bool ret = PCIeCommSdk::readData(fHandle, offset, data);
-    CloseHandle(fHandle);
-    return ret;
+    return readWaveformRange(index, (char*)data.constData(), data.size(), offset);
+}
+
+bool CaptureThread::readWaveformRange(quint8 engine, char* data, qint64 size, quint64 offset)
+{
+    // c2h_N只由第N个读线程访问，引擎统计不需要加锁
+    engine &= 0x03;
+    QElapsedTimer busyTimer;
+    busyTimer.start();
+    bool ok = mDevice->read(XdmaDevice::c2hChannel(engine), offset, data, size);
+    mShotTiming.engineBusyNs[engine] += busyTimer.nsecsElapsed();
+    if (ok)
+        mShotTiming.engineBytes[engine] += size;
+    return ok;
 }
 
 /**
@@ -2282,10 +3077,6 @@ bool CaptureThread::readWaveformData(quint8 index, const QByteArray& data, const
 */
 bool CaptureThread::readSpectrumData(quint8 index, const QByteArray& data, const quint64 offset)
 {
-    HANDLE fHandle = PCIeCommSdk::getHandle(mDeviceName + XDMA_FILE_BYPASS,
-                                           GENERIC_READ | GENERIC_WRITE,
-                                           FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE);
-    bool ret = PCIeCommSdk::readData(fHandle, offset, data);
-    CloseHandle(fHandle);
-    return ret;
+    Q_UNUSED(index);
+    return mDevice->read(XdmaDevice::chBypass, offset, (char*)data.constData(), data.size());
 }
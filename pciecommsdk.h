@@ -4,8 +4,15 @@
 #include <QObject>
 #include <QDebug>
 #include <QVector>
-#include "pcieiocpreader.h"
 #include "globalsettings.h"
+#include "xdmadevice.h"
+#include "deadlinewaiter.h"
+#include "capturetrace.h"
+#include "framevalidator.h"
+#include "framebufferpool.h"
+#include "threadscheduler.h"
+#include "captureframe.h"
+#include "zerosuppressor.h"
 
 #ifdef _WIN32
 #include <direct.h>
@@ -13,15 +20,26 @@
 #include <setupapi.h>
 #include <cfgmgr32.h>
 #include <devguid.h>
+#include "pcieiocpreader.h"
 #else
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
 
 typedef int HANDLE;
 #define CloseHandle close
+#define INVALID_HANDLE_VALUE (-1)
+#define GENERIC_READ    0x80000000
+#define GENERIC_WRITE   0x40000000
+#define FILE_ATTRIBUTE_NORMAL       0x00000080
+#define FILE_SHARE_READ             0x00000001
+#define FILE_SHARE_WRITE            0x00000002
+#define FILE_FLAG_NO_BUFFERING      0x20000000
 #endif
 
 #include <QFile>
@@ -41,6 +59,14 @@ public:
     bool open(const QString &fileName, QIODevice::OpenMode mode);
 };
 
+class CaptureFrameRing;
+struct CaptureFrameSlot;
+class ReadySource;
+class ShotStreamWriter;
+class PreTriggerRing;
+class FrameReaderThread;
+class ShotFileWriter;
+
 
 #include <cstring>
 class CaptureThread : public QThread {
@@ -53,6 +79,25 @@ public:
         QMutex mutex;                   // 条件变量必须配合互斥锁（Qt要求）
     };
 
+    // 每帧的包头包尾快照，校验和日志只依赖快照，不要求整帧数据仍在内存中
+    struct FrameHeader {
+        char waveformHead[12];
+        char waveformTail[12];
+        char spectrumHead[16];
+    };
+
+    // 一炮的逐帧时刻（相对开始测量，ns，下标为包序号）和读线程CPU时间，用于性能基准测试
+    struct ShotTiming {
+        QVector<qint64> readyNs;    // 检测到就绪寄存器跳变
+        QVector<qint64> readyClockNs;// 同上，取自ReadyDispatcher共用时钟，用于比较板间偏差
+        QVector<qint64> dmaStartNs; // 读线程开始DMA
+        QVector<qint64> dmaEndNs;   // DMA完成
+        QVector<qint64> diskDoneNs; // 波形和能谱文件都写完，没有写盘为0
+        qint64 readerCpuUs[4] = {0};// 本炮各读线程CPU时间
+        qint64 engineBytes[4] = {0};// c2h_0~3读取字节数
+        qint64 engineBusyNs[4] = {0};// c2h_0~3读取耗时
+    };
+
     /**
     * @function name: CaptureThread
     * @brief 构造函数
@@ -76,6 +121,34 @@ public:
     bool writeFileWithNoBuffering(const QString &filePath, const char *data, qint64 size);
 
     void setParamter(const QString &saveFilePath, quint32 captureTimeSeconds, bool testMode);
+    /*边采集边存储：ringFrames为环形缓冲帧数*/
+    void setStreamingMode(bool enable, int ringFrames);
+    /*数据就绪检测方式：byInterrupt为true时等待用户中断事件，否则轮询寄存器；sharedPoll为true时由共享轮询线程统一轮询*/
+    void setReadyMode(bool byInterrupt, bool sharedPoll = true);
+    /*写盘：queueDepth为同时写入的文件数，directIO为是否绕过系统缓存*/
+    void setWriterOptions(int queueDepth, bool directIO);
+    /*在线校验：crcEnabled为是否计算每帧CRC32C并写旁路文件*/
+    void setValidateMode(bool crcEnabled);
+    /*外触发预触发采集：触发前一直采集，只保留最近preTriggerMs的数据，触发后再采集一炮的采集时长；最多等待maxArmMs*/
+    void setPreTriggerMode(bool enable, quint32 preTriggerMs, quint32 maxArmMs);
+    /*外触发到达，冻结预触发缓冲，可以在任意线程调用*/
+    void trigger(){ mTriggerRequested.store(true); }
+    /*一次性内存模式写盘：async为true时能谱同步写完，波形交给后台写盘，下一炮使用另一组缓冲同时开始采集；
+      keepBufferCache为false时一炮保存完成后释放缓冲池缓存（单次测量），否则保留给下一炮复用（连续测量）*/
+    void setFlushMode(bool async, bool keepBufferCache = true);
+    int pendingFlushes() const { return mPendingFlushes.load(); }
+    /*零压缩保存：波形文件只保存超过阈值的脉冲窗口和每块基线，每隔rawEvery帧及校验出错的帧保存原始数据*/
+    void setZeroSuppression(bool enable, const ZeroSuppressOptions& options);
+    /*无损压缩保存：波形文件写成.nbin（差分+位打包），离线读取时自动解码*/
+    void setLosslessMode(bool enable);
+    /*整炮容器保存：每个DDR一炮写成一个%1%2shot.nsc（带帧索引），代替每帧一个的.bin文件*/
+    void setContainerMode(bool enable);
+    /*通道分平面保存：没有零压缩/无损压缩的波形帧按通道连续存放，单相机读取只读一个通道*/
+    void setPlanarMode(bool enable);
+    /*读取方式：striped为true时每帧拆成4段在c2h_0~3上并行读取，否则整帧在就绪区域对应的c2h通道上读取*/
+    void setReadMode(bool striped);
+    /*调度策略：pollerCpu为采集线程绑定的核心，readerCpus为4个读线程绑定的核心，小于0不绑定*/
+    void setSchedulePolicy(ThreadScheduler::Policy policy, int priority, int pollerCpu, const QVector<int>& readerCpus);
 
     void pause(){
         QMutexLocker locker(&mMutex);
@@ -119,17 +192,53 @@ public:
 
     bool readDataAsync(HANDLE fd, quint64 offset, const QByteArray& data);
 
+    /*每帧DMA读取耗时（us），下标为包序号*/
+    const QVector<qint64>& frameReadLatencyUs() const { return mReadLatencyUs; }
+    /*上一炮的逐帧时刻和CPU时间，采集结束（captureFinished）以后读取*/
+    const ShotTiming& shotTiming() const { return mShotTiming; }
+    qint64 pollerCpuTimeUs() const { return mReadyCpuTimeUs; }
+    qint64 captureWallTimeUs() const { return mReadyWallTimeUs; }
+    quint32 capturedFrames() const { return mCapturedRef; }
+    quint32 droppedFrames() const { return mDroppedFrames.load(); }
+    quint32 faultFrames() const { return mFaultFrames.load(); }
+    quint32 physicalNo() const { return mPhysicalNo; }
+    bool isDDR1() const { return mIsDDR1; }
+    bool streamingMode() const { return mStreamingSave; }
+    bool stripedRead() const { return mStripedRead; }
+
     Q_SIGNAL void captureFailOccurred(quint32, quint32);
+    /*每帧DMA完成（在读线程中发出），接收者持有句柄即可零拷贝使用整帧数据，用完尽快释放*/
+    Q_SIGNAL void frameCaptured(quint32 deviceIndex, CaptureFrameHandle frame);
     Q_SIGNAL void threadExitOccurred(quint32);
     Q_SIGNAL void captureWaveformDataChanged(quint8,quint32,const QByteArray& data);
     Q_SIGNAL void captureSpectrumDataChanged(quint8,bool,quint32,const QByteArray& data);
     Q_SIGNAL void captureFinished(quint32, bool);
 
 private:
+    bool allocMemoryBuffers();/*一次性内存模式，按本炮帧数从缓冲池申请*/
+    void releaseMemoryBuffers();/*采集保存完成后归还缓冲池*/
+    bool prepareStreaming();/*边采集边存储，准备环形缓冲和写盘线程*/
+    void recordFrameHeader(quint32 capturedRef, const QByteArray& waveform, const QByteArray& spectrum);
+    quint32 validateFrame(quint32 capturedRef, const QByteArray& waveform, const QByteArray& spectrum, bool readOk);/*DMA完成后立即校验，在读线程中调用*/
+    void saveCrcFile();
+    void beginFrameRead(quint32 capturedRef, qint64 postNs);/*读线程开始读一帧，条带读取时由最先开始的一段调用*/
+    void endFrameRead(quint32 capturedRef, quint8 step, const QByteArray& waveform, const QByteArray& spectrum, CaptureFrameSlot* slot, bool ok);/*一帧全部读完，校验后生成帧句柄交给写盘和在线分析*/
+    qint64 frameUtcNs(quint32 capturedRef) const;/*按实测就绪时刻换算的帧开始时刻（UTC，ns），没有就绪记录返回0*/
+    bool readWaveformRange(quint8 engine, char* data, qint64 size, quint64 offset);/*在c2h_engine上读一段波形并计入该引擎的统计*/
+    void applySchedulePolicy();/*在采集线程中调用，读线程的设置以任务形式投递到各自线程*/
+    void saveMemoryBuffers();
+    void finishPreTrigger();/*采集结束时冻结预触发缓冲（没有触发时保存最后一段），写触发信息文件*/
+    bool waitForFlushes(int maxPending);/*等待后台写盘的炮数不超过maxPending，停止采集时返回false*/
+    bool openDataChannels();/*打开c2h_0~3和bypass通道，整炮复用*/
+    void reportReadLatency();
+    void reportReadyDetection();
+    void reportEngineThroughput();
+
     quint32 mIsDDR1 = true;//
     quint32 mDeviceIndex;//采集卡索引 1~6
     quint32 mPhysicalNo;//采集卡编号 1~3
     QString mDeviceName;//采集卡设备名称
+    XdmaDevice* mDevice = nullptr;//采集卡设备访问层
 #if ENABLE_IOCP
     PcieIocpReader* mPcieReader = nullptr;
 #else
@@ -138,14 +247,66 @@ private:
     int mRegisterInvalidPosition = 0;
 
     QString mSaveFilePath;//保存路径
-    quint16 mCaptureCount = 1;//需要采集的总包数据
-    quint16 mCapturedRef = 1;//已经采集的包数
+    quint32 mCaptureCount = 1;//需要采集的总包数据
+    quint32 mCapturedRef = 1;//已经采集的包数
     quint32 mTimeout = 5000;//超时微秒
     bool mEnableTestMode = false;//启用测试模式
     bool mInterruptSave = false;//是否终止
     bool mIsException = false;//数据是否出现异常
     QVector<QByteArray> mDDRWaveformDatas;
     QVector<QByteArray> mRAMSpectrumDatas;
+    QVector<FrameBufferHandle> mWaveformBuffers;//mDDRWaveformDatas引用的缓冲池内存
+    QVector<FrameBufferHandle> mSpectrumBuffers;
+    QVector<CaptureFrameHandle> mFrames;//一次性内存模式DMA完成的帧，下标为包序号，保存完成后释放
+    QVector<FrameHeader> mFrameHeaders;//每帧包头包尾，下标为包序号
+    QVector<FrameCrc> mFrameCrcs;//每帧CRC32C，下标为包序号
+    bool mFrameCrcEnabled = true;//计算每帧CRC32C
+    std::atomic<quint32> mFaultFrames{0};//在线校验失败的帧数
+    std::atomic<quint32> mFirstFaultFrame{0};//第一个校验失败的包序号
+
+    bool mStreamingSave = false;//边采集边存储
+    int mStreamingRingFrames = 16;//环形缓冲帧数
+    QSharedPointer<CaptureFrameRing> mFrameRing;//帧句柄释放时归还槽位，帧句柄持有环的引用
+    ShotStreamWriter* mStreamWriter = nullptr;
+    std::atomic<quint32> mDroppedFrames{0};//环形缓冲耗尽丢弃的帧数
+    bool mRingCapture = false;//本炮经环形缓冲采集（边采集边存储或预触发）
+    bool mPreTriggerEnabled = false;//预触发采集
+    quint32 mPreTriggerFrames = 25;//触发前保留的帧数
+    quint32 mArmFrames = 15000;//最长等待触发的帧数
+    PreTriggerRing* mPreTriggerRing = nullptr;
+    std::atomic<bool> mTriggerRequested{false};//外触发已到达
+    quint32 mTriggerFrameNo = 0;//触发时的包序号，0为未触发
+    quint32 mSavedFirstFrame = 1;//保存的第一帧包序号，文件序号从这一帧开始编为1
+    ShotFileWriter* mFileWriter = nullptr;//一次性内存模式的并发写盘
+    ShotFileWriter* mFlushWriter = nullptr;//异步写盘，波形文件在后台写，与下一炮采集重叠
+    bool mAsyncFlush = false;//异步写盘
+    bool mKeepBufferCache = true;//保存完成后保留缓冲池缓存
+    std::atomic<int> mPendingFlushes{0};//还在后台写盘的炮数
+    QMutex mFlushMutex;
+    QWaitCondition mFlushDone;
+    int mWriteQueueDepth = 4;//同时写入的文件数
+    bool mZeroSuppress = false;//零压缩保存
+    ZeroSuppressOptions mZeroSuppressOptions;
+    bool mLosslessSave = false;//无损压缩保存
+    bool mContainerSave = false;//整炮容器保存
+    bool mPlanarSave = false;//通道分平面保存
+    bool mWriteDirectIO = false;//直接I/O写盘
+    FrameReaderThread* mStepReaders[4] = {nullptr};//每个DDR区域一个专用读线程
+    bool mStripedRead = false;//条带读取
+    bool mReadyByInterruptEnabled = false;//配置的就绪检测方式
+    bool mReadyByInterrupt = false;//本次采集实际使用的就绪检测方式
+    bool mSharedReadyPollEnabled = false;//配置的共享就绪轮询
+    bool mSharedReadyPoll = false;//本次采集是否由共享轮询线程检测就绪
+    ReadySource* mReadySource = nullptr;//共享轮询线程分发给本DDR的跳变队列
+    qint64 mShotClockOffsetNs = 0;//开始测量时刻在共用时钟上的值
+    qint64 mShotStartUtcNs = 0;//开始测量时刻（UTC，ns），写入容器索引的帧时刻以此为基准
+    qint64 mReadyCpuTimeUs = 0;//本次采集线程CPU时间
+    qint64 mReadyWallTimeUs = 0;//本次采集时长
+    DeadlineWaiter mReadyWaiter;//就绪寄存器轮询等待器，按学到的周期睡眠/自旋
+    ThreadScheduler::Policy mSchedPolicy = ThreadScheduler::Normal;//调度策略
+    int mSchedPriority = 50;//实时优先级
+    int mPollerCpu = -1;//采集线程绑定的核心
+    int mReaderCpus[4] = {-1, -1, -1, -1};//读线程绑定的核心
 
     QMutex mMutex;
     QWaitCondition mCondition;
@@ -158,37 +319,21 @@ private:
     bool mDataError = false;
     QMutex mReadLocker;
 
-    QVector<qint64> zeroTime;//记录0时刻
     QVector<qint64> mRamChangedTime;// RAM值改变的时间
     QVector<qint64> mBeforeReadTime;// DDR读之前的时间
     QVector<qint64> mAfterReadTime;// DDR读之后的时间
     QVector<qint64> mCreateThreadTime;// 创建线程时间
     QVector<qint64> mAfterCreateThreadTime;// 创建线程时间
-    QMap<quint16, QVector<QPair<qint64, quint8>>> mDDRReadTime; // 记录DDR读取时间
-    QMap<quint16/*包序号*/, QVector<QPair<qint64/*读寄存器前时刻*/, QPair<qint64/*读寄存器前时刻*/, quint8/*寄存器值*/>>>> mRAMReadTime; // 记录RAM读取时间
+    QVector<qint64> mReadLatencyUs;// 每帧DMA读取耗时（us）
+    QVector<qint64> mDetectLatencyUs;// 每帧就绪检测延迟（us）
+    QVector<qint64> mSchedLatencyUs;// 每帧等待期间采集线程的最大唤醒延迟（us）
+    QVector<qint64> mDispatchLatencyUs;// 每帧从投递到读线程开始执行的延迟（us）
+    ShotTiming mShotTiming;// 逐帧时刻，基准测试用
+    QElapsedTimer mShotTimer;// 开始测量时启动，写盘回调也用它计时
+    qint64 mReaderCpuStartUs[4] = {0};// 读线程本炮开始时的CPU时间
+    CaptureTraceRing mRegisterTrace; // 读寄存器记录（包序号、读前/读后时刻、寄存器值），预分配，轮询时不分配内存
 };
 
-// 首先把所有硬件相关常量统一定义在PCIe底层头文件，不要散落在业务代码
-namespace XdmaRegDef {
-    // 寄存器映射定义，和FPGA文档一一对应
-    constexpr quint64 USER_CTRL_ADDR = 0x20000; // 寄存器地址
-    constexpr quint8 REG_CMD_BASE = 0x12340000; // 寄存器命令基值
-
-    constexpr quint8 THRESHOLD_LOW_OFS = 0xF7;// 触发阈值低位
-    constexpr quint8 THRESHOLD_HIGH_OFS = 0xF8;// 触发阈值高位
-
-    constexpr quint8 CARD1_PSD_THRESHOLD_OFS = 0xF1;// 卡#1PSD阈值
-    constexpr quint8 CARD2_PSD_THRESHOLD_OFS = 0xF2;// 卡#2PSD阈值
-    constexpr quint8 CARD3_PSD_THRESHOLD_OFS = 0xF3;// 卡#3PSD阈值
-    constexpr quint8 CARD4_PSD_THRESHOLD_OFS = 0xF4;// 卡#4PSD阈值
-    constexpr quint8 CARD5_PSD_THRESHOLD_OFS = 0xF5;// 卡#5PSD阈值
-    constexpr quint8 CARD6_PSD_THRESHOLD_OFS = 0xF6;// 卡#6PSD阈值
-
-    // 操作延时配置，单位毫秒
-    constexpr int REG_OP_WAIT_MS = 10;  // 操作
-    constexpr int REG_CLEAR_WAIT_MS = 5;// 清零
-}
-
 #define CAMNUMBER_DDR_PER   3   // 每张PCIe对应一个Fpga数采板，每个数采板对应的是8个探测器（但是考虑带宽可能只用到了6路，分2个DDR存储数据，所以每个DDR存储3路）
 #define DETNUMBER_PCIE_PER  6   // 每张PCIe对应一个Fpga数采板，每个数采板对应的是8个探测器（但是考虑带宽可能只用到了6路，分2个DDR存储数据，所以每个DDR存储3路）
 #define DETNUMBER_MAX       18  // 探测器有效数只用到了18路（11路水平+7路垂直）
@@ -223,6 +368,7 @@ public:
     Q_SIGNAL void reportNotFoundDevices();
     Q_SIGNAL void reportOpenDeviceFail(quint8);
     Q_SIGNAL void captureFailOccurred(quint32, quint32);
+    Q_SIGNAL void frameCaptured(quint32 deviceIndex, CaptureFrameHandle frame);// 在读线程中发出，见CaptureThread::frameCaptured
     Q_SIGNAL void captureFinished();
     Q_SIGNAL void reportNeutronSpectrum(quint8/*时刻*/, quint8/*相机索引*/, QVector<QPair<double,double>>&);
     Q_SIGNAL void reportGammaSpectrum(quint8/*时刻*/, quint8/*相机索引*/, QVector<QPair<double,double>>&);
@@ -233,6 +379,7 @@ public:
     void startAllCapture(QString fileSavePath/*文件存储大路径*/, quint32 captureTimeSeconds/*保存时长*/, QString shotNum/*炮号*/);
     void stopCapture(quint32 deviceIndex);
     void stopAllCapture();
+    void triggerAllCapture();/*预触发采集：外触发到达，各采集线程冻结预触发缓冲并继续采集触发后的数据*/
 
     void init(); /* 初始化 */
     void reset();/* 重置 */
@@ -240,7 +387,6 @@ public:
     void setPSDThreshold();/* 设置PSD甄别阈值 */
     void setTriggerThreshold();/* 设置触发阈值 */
     bool test();
-    inline bool writeRegAndClear(int physicalNo, HANDLE handle, quint64 addr, quint32 regValue);
 
     /*获取设备数量*/
     quint32 numberOfDevices();
@@ -264,6 +410,8 @@ public:
 
     /*初始化*/
     void initCaptureThreads();
+    /*所有DDR采集结束后统计同一帧在各采集卡上检测到就绪的时刻差*/
+    void reportReadySkew();
 
     /*解析能谱数据*/
     static bool analyzeHistorySpectrumData(const quint8& cameraIndex,
@@ -363,6 +511,7 @@ public:
         mmTest          = 0x01,// 测试模式
         mmSingle        = 0x02,// 单次测量
         mmContinue      = 0x04,// 连续测量
+        mmPreTrigger    = 0x08,// 外触发预触发采集
         mmSingleTest    = mmTest | mmSingle,// 单次测量
         mmContinueTest  = mmTest | mmContinue,// 连续测量
     };
@@ -370,7 +519,14 @@ public:
 
 signals:
 
+protected:
+    /*有接收者连接/断开frameCaptured时建立/撤销采集线程的转发连接，没有接收者时采集线程不发出逐帧信号*/
+    void connectNotify(const QMetaMethod& signal) override;
+    void disconnectNotify(const QMetaMethod& signal) override;
+
 private:
+    void updateFrameForwarding(CaptureThread* captureThread);
+
     QMap<quint32, CaptureThread*> mMapDeviceCaptureThread;/*3张卡，6个设备*/
     QMap<quint32, bool> mDeviceThreadRunning;
 
@@ -0,0 +1,123 @@
+﻿#include "planarframe.h"
+#include <cstring>
+
+namespace {
+    const char kMagic[8] = {'N','C','P','L','A','N','0','1'};
+    const qint64 kHeadBytes = 12;   // 帧头帧尾各12字节
+    const int kChannels = 3;
+
+    qint64 alignUp(qint64 size)
+    {
+        return (size + PlanarFrame::kHeaderPage - 1) / PlanarFrame::kHeaderPage * PlanarFrame::kHeaderPage;
+    }
+}
+
+QByteArray PlanarFrame::encode(const char* frame, qint64 size)
+{
+    const qint64 payloadBytes = size - 2 * kHeadBytes;
+    if (!frame || payloadBytes <= 0 || payloadBytes % 12 != 0)
+        return QByteArray();
+
+    const qint64 samples = payloadBytes / 2 / kChannels;
+    const qint64 planeBytes = alignUp(samples * 2);
+
+    PlanarHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.channels = kChannels;
+    header.headBytes = kHeadBytes;
+    header.tailBytes = kHeadBytes;
+    header.samplesPerChannel = quint64(samples);
+    for (int ch = 0; ch < kChannels; ++ch)
+        header.planeOffset[ch] = quint64(kHeaderPage + ch * planeBytes);
+    header.rawSize = quint64(size);
+
+    // 最后一个平面不补齐，文件只比原始帧多头页和两段对齐填充
+    QByteArray out(int(header.planeOffset[kChannels - 1] + samples * 2), Qt::Uninitialized);
+    char* base = out.data();
+    std::memset(base, 0, kHeaderPage);
+    std::memcpy(base, &header, sizeof(header));
+    std::memcpy(base + sizeof(header), frame, kHeadBytes);
+    std::memcpy(base + sizeof(header) + kHeadBytes, frame + size - kHeadBytes, kHeadBytes);
+
+    // 原始帧每6个采样一组：ch0 ch0 ch1 ch1 ch2 ch2，与readBin3Ch_fast的解交织一致
+    const quint16* src = reinterpret_cast<const quint16*>(frame + kHeadBytes);
+    quint16* planes[kChannels];
+    for (int ch = 0; ch < kChannels; ++ch){
+        planes[ch] = reinterpret_cast<quint16*>(base + header.planeOffset[ch]);
+        if (ch < kChannels - 1)
+            std::memset(base + header.planeOffset[ch] + samples * 2, 0, planeBytes - samples * 2);
+    }
+    for (qint64 i = 0, j = 0; j < samples; j += 2, i += 6){
+        planes[0][j] = src[i + 0]; planes[0][j + 1] = src[i + 1];
+        planes[1][j] = src[i + 2]; planes[1][j + 1] = src[i + 3];
+        planes[2][j] = src[i + 4]; planes[2][j + 1] = src[i + 5];
+    }
+    return out;
+}
+
+bool PlanarFrame::readHeader(const char* data, qint64 size, PlanarHeader& header)
+{
+    if (!data || size < (qint64)sizeof(PlanarHeader))
+        return false;
+
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.channels != kChannels)
+        return false;
+    if (header.samplesPerChannel % 2 != 0 || sizeof(header) + header.headBytes + header.tailBytes > quint64(kHeaderPage))
+        return false;
+    return header.rawSize == header.headBytes + header.tailBytes + header.samplesPerChannel * kChannels * 2;
+}
+
+bool PlanarFrame::isPlanar(const QByteArray& fileData)
+{
+    PlanarHeader header;
+    return readHeader(fileData.constData(), fileData.size(), header);
+}
+
+bool PlanarFrame::decodeChannels(const QByteArray& fileData, QVector<quint16>& ch0, QVector<quint16>& ch1, QVector<quint16>& ch2)
+{
+    PlanarHeader header;
+    if (!readHeader(fileData.constData(), fileData.size(), header))
+        return false;
+
+    const qint64 planeBytes = qint64(header.samplesPerChannel) * 2;
+    QVector<quint16>* chs[kChannels] = {&ch0, &ch1, &ch2};
+    for (int ch = 0; ch < kChannels; ++ch){
+        if (qint64(header.planeOffset[ch]) + planeBytes > fileData.size())
+            return false;
+
+        chs[ch]->resize(int(header.samplesPerChannel));
+        std::memcpy(chs[ch]->data(), fileData.constData() + header.planeOffset[ch], planeBytes);
+    }
+    return true;
+}
+
+QByteArray PlanarFrame::decode(const QByteArray& fileData)
+{
+    PlanarHeader header;
+    if (!readHeader(fileData.constData(), fileData.size(), header))
+        return QByteArray();
+
+    const qint64 samples = qint64(header.samplesPerChannel);
+    const quint16* planes[kChannels];
+    for (int ch = 0; ch < kChannels; ++ch){
+        if (qint64(header.planeOffset[ch]) + samples * 2 > fileData.size())
+            return QByteArray();
+        planes[ch] = reinterpret_cast<const quint16*>(fileData.constData() + header.planeOffset[ch]);
+    }
+
+    QByteArray out(int(header.rawSize), Qt::Uninitialized);
+    char* base = out.data();
+    const char* saved = fileData.constData() + sizeof(header);
+    std::memcpy(base, saved, header.headBytes);
+    std::memcpy(base + header.rawSize - header.tailBytes, saved + header.headBytes, header.tailBytes);
+
+    quint16* dst = reinterpret_cast<quint16*>(base + header.headBytes);
+    for (qint64 i = 0, j = 0; j < samples; j += 2, i += 6){
+        dst[i + 0] = planes[0][j]; dst[i + 1] = planes[0][j + 1];
+        dst[i + 2] = planes[1][j]; dst[i + 3] = planes[1][j + 1];
+        dst[i + 4] = planes[2][j]; dst[i + 5] = planes[2][j + 1];
+    }
+    return out;
+}
@@ -0,0 +1,48 @@
+﻿#ifndef PLANARFRAME_H
+#define PLANARFRAME_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QVector>
+
+/**
+ * PlanarFrame 波形帧按通道分平面存储
+ * 原始帧按 ch0 ch0 ch1 ch1 ch2 ch2 逐点交织，只看一个相机也要读整帧。分平面后每个通道的采样连续存放，
+ * 单通道查询只需要读文件头页和该通道的平面，读盘量约为原来的1/3。
+ *
+ * 文件格式（小端），文件名不变（%1%2data%3.bin）：
+ *   第0页（4096字节）：PlanarHeader + 原始帧头 headBytes 字节 + 帧尾 tailBytes 字节，其余填0
+ *   通道0~2平面：各 samplesPerChannel 个quint16，起始偏移4096对齐（planeOffset）
+ *
+ * DataAnalysisWorker::readBin3Ch_fast自动识别，DataAnalysisWorker::readBinChannel只读需要的平面。
+ */
+class PlanarFrame
+{
+public:
+    static const int kHeaderPage = 4096;
+
+#pragma pack(push, 1)
+    struct PlanarHeader {
+        char magic[8];              // "NCPLAN01"
+        quint16 channels;           // 3
+        quint16 headBytes;          // 12
+        quint16 tailBytes;          // 12
+        quint16 reserved;
+        quint64 samplesPerChannel;
+        quint64 planeOffset[3];
+        quint64 rawSize;            // 原始帧字节数
+    };
+#pragma pack(pop)
+
+    /*原始帧转成分平面格式，帧格式不符合时返回空，调用者应保存原始数据*/
+    static QByteArray encode(const char* frame, qint64 size);
+    /*从文件开头的数据（至少sizeof(PlanarHeader)字节）解析文件头，不是分平面格式返回false*/
+    static bool readHeader(const char* data, qint64 size, PlanarHeader& header);
+    static bool isPlanar(const QByteArray& fileData);
+    /*解码成三个通道（与readBin3Ch_fast小端解交织结果相同），失败返回false*/
+    static bool decodeChannels(const QByteArray& fileData, QVector<quint16>& ch0, QVector<quint16>& ch1, QVector<quint16>& ch2);
+    /*还原成原始交织帧（含帧头帧尾），失败返回空*/
+    static QByteArray decode(const QByteArray& fileData);
+};
+
+#endif // PLANARFRAME_H
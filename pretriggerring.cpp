@@ -0,0 +1,93 @@
+﻿#include "pretriggerring.h"
+#include <algorithm>
+
+void PreTriggerRing::arm(ShotStreamWriter* writer, quint32 preFrames)
+{
+    QMutexLocker locker(&mMutex);
+    mFrames.clear();
+    mWriter = writer;
+    mPreFrames = qMax(1u, preFrames);
+    mFirstFrameNo = 0;
+    mArmed = true;
+    mFrozen = false;
+}
+
+void PreTriggerRing::push(const CaptureFrameHandle& frame)
+{
+    CaptureFrameHandle evicted;// 在锁外释放，归还槽位会唤醒采集线程
+    {
+        QMutexLocker locker(&mMutex);
+        if (!mArmed)
+            return;
+
+        if (!mFrozen){
+            mFrames.enqueue(frame);
+            if ((quint32)mFrames.size() > mPreFrames)
+                evicted = mFrames.dequeue();
+            return;
+        }
+
+        // 冻结时还没有帧，第一个到达的帧作为保存的第一帧
+        if (mFirstFrameNo == 0){
+            mFirstFrameNo = frame->frameNo;
+            mWriter->setFirstFrameNo(mFirstFrameNo);
+        }
+    }
+
+    mWriter->push(frame);
+}
+
+quint32 PreTriggerRing::freeze()
+{
+    QList<CaptureFrameHandle> frames;
+    {
+        QMutexLocker locker(&mMutex);
+        if (!mArmed || mFrozen)
+            return mFirstFrameNo;
+
+        mFrozen = true;
+        frames = mFrames;
+        mFrames.clear();
+
+        // 读线程并行完成，队列中的顺序不一定是包序号顺序
+        std::sort(frames.begin(), frames.end(), [](const CaptureFrameHandle& a, const CaptureFrameHandle& b){
+            return a->frameNo < b->frameNo;
+        });
+        if (!frames.isEmpty()){
+            mFirstFrameNo = frames.first()->frameNo;
+            mWriter->setFirstFrameNo(mFirstFrameNo);
+        }
+    }
+
+    for (const CaptureFrameHandle& frame : frames)
+        mWriter->push(frame);
+
+    return mFirstFrameNo;
+}
+
+void PreTriggerRing::disarm()
+{
+    QQueue<CaptureFrameHandle> frames;// 在锁外释放
+    QMutexLocker locker(&mMutex);
+    frames.swap(mFrames);
+    mArmed = false;
+    mWriter = nullptr;
+}
+
+bool PreTriggerRing::isArmed() const
+{
+    QMutexLocker locker(&mMutex);
+    return mArmed;
+}
+
+bool PreTriggerRing::isFrozen() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFrozen;
+}
+
+quint32 PreTriggerRing::firstFrameNo() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFirstFrameNo;
+}
@@ -0,0 +1,44 @@
+﻿#ifndef PRETRIGGERRING_H
+#define PRETRIGGERRING_H
+
+#include <QMutex>
+#include <QQueue>
+#include "captureframe.h"
+#include "shotstreamwriter.h"
+
+/**
+ * PreTriggerRing 预触发环形缓冲
+ * 外触发之前一直采集，只保留最近preFrames帧：帧句柄占着CaptureFrameRing的槽位，淘汰最旧的帧即归还槽位，
+ * 所以内存占用固定，与等待触发的时长无关。触发时冻结，保留的帧按包序号顺序交给ShotStreamWriter写盘，
+ * 文件序号从保留的第一帧开始编为1；冻结以后的帧直接写盘。
+ */
+class PreTriggerRing
+{
+public:
+    PreTriggerRing() = default;
+
+    /*开始等待触发，之前保留的帧全部释放*/
+    void arm(ShotStreamWriter* writer, quint32 preFrames);
+    /*DMA完成的一帧，可以在任意线程调用*/
+    void push(const CaptureFrameHandle& frame);
+    /*冻结并把保留的帧提交写盘，返回保存的第一帧包序号，还没有帧时为下一个到达的帧*/
+    quint32 freeze();
+    /*释放保留的帧，不写盘*/
+    void disarm();
+
+    bool isArmed() const;
+    bool isFrozen() const;
+    quint32 firstFrameNo() const;
+    quint32 preFrames() const { return mPreFrames; }
+
+private:
+    ShotStreamWriter* mWriter = nullptr;
+    QQueue<CaptureFrameHandle> mFrames;
+    quint32 mPreFrames = 0;
+    quint32 mFirstFrameNo = 0;
+    bool mArmed = false;
+    bool mFrozen = false;
+    mutable QMutex mMutex;
+};
+
+#endif // PRETRIGGERRING_H
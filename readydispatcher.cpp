@@ -0,0 +1,203 @@
+﻿#include "readydispatcher.h"
+#include "xdmadevice.h"
+#include <QDeadlineTimer>
+#include <QDebug>
+#include <limits>
+
+namespace {
+    const qint64 kIdleSleepNs = 1000 * 1000;    // 所有寄存器都读失败时的轮询间隔
+    const qint64 kCpuSampleNs = 100 * 1000;     // 睡眠超过该时长时才更新CPU时间，自旋阶段不额外调用系统时钟
+}
+
+/**
+ * ReadySource 一个DDR的就绪寄存器====================================================
+*/
+ReadySource::ReadySource(XdmaDevice* device, quint64 address, qint64 periodNs)
+    : mDevice(device)
+    , mAddress(address)
+    , mWaiter(periodNs)
+{
+}
+
+bool ReadySource::waitEdge(ReadyEdge& edge, qint64 timeoutMs)
+{
+    QMutexLocker locker(&mMutex);
+    QDeadlineTimer deadline(qMax<qint64>(0, timeoutMs));
+    while (mEdges.isEmpty()){
+        if (!mNotEmpty.wait(&mMutex, deadline))
+            break;
+    }
+    if (mEdges.isEmpty())
+        return false;
+
+    edge = mEdges.dequeue();
+    return true;
+}
+
+void ReadySource::push(const ReadyEdge& edge)
+{
+    QMutexLocker locker(&mMutex);
+    mEdges.enqueue(edge);
+    mNotEmpty.wakeOne();
+}
+
+/**
+ * ReadyDispatcher 共享就绪轮询线程====================================================
+*/
+ReadyDispatcher& ReadyDispatcher::instance()
+{
+    static ReadyDispatcher dispatcher;
+    return dispatcher;
+}
+
+ReadyDispatcher::ReadyDispatcher()
+{
+    mClock.start();
+}
+
+ReadyDispatcher::~ReadyDispatcher()
+{
+    stop();
+    wait();
+
+    qDeleteAll(mSources);
+    mSources.clear();
+}
+
+ReadySource* ReadyDispatcher::attach(XdmaDevice* device, quint64 address, qint64 periodNs)
+{
+    ReadySource* source = new ReadySource(device, address, periodNs);
+    {
+        QMutexLocker locker(&mMutex);
+        mSources.append(source);
+        mHasSources.wakeAll();
+    }
+
+    if (!isRunning())
+        start(QThread::HighestPriority);
+    return source;
+}
+
+void ReadyDispatcher::detach(ReadySource* source)
+{
+    if (!source)
+        return;
+
+    // 轮询一遍期间持有锁，拿到锁说明轮询线程不在访问该设备
+    QMutexLocker locker(&mMutex);
+    mSources.removeOne(source);
+    delete source;
+}
+
+void ReadyDispatcher::setSchedulePolicy(ThreadScheduler::Policy policy, int priority, int cpu)
+{
+    QMutexLocker locker(&mMutex);
+    mSchedPolicy = policy;
+    mSchedPriority = priority;
+    mCpu = cpu;
+    mScheduleChanged = true;
+}
+
+void ReadyDispatcher::stop()
+{
+    QMutexLocker locker(&mMutex);
+    mStopped = true;
+    mHasSources.wakeAll();
+}
+
+QVector<qint64> ReadyDispatcher::edgeSkewNs(const QList<QVector<qint64>>& readyClockNs)
+{
+    int frames = 0;
+    for (const QVector<qint64>& times : readyClockNs)
+        frames = qMax(frames, times.size());
+
+    QVector<qint64> skews;
+    for (int i=1; i<frames; ++i){
+        qint64 earliest = std::numeric_limits<qint64>::max();
+        qint64 latest = 0;
+        int count = 0;
+        for (const QVector<qint64>& times : readyClockNs){
+            qint64 t = times.value(i, 0);
+            if (t <= 0)
+                continue;
+            earliest = qMin(earliest, t);
+            latest = qMax(latest, t);
+            count++;
+        }
+
+        // 至少两个DDR都收到该帧才有偏差
+        if (count >= 2)
+            skews.append(latest - earliest);
+    }
+
+    return skews;
+}
+
+void ReadyDispatcher::run()
+{
+    qDebug() << "共享就绪轮询线程 id:" << currentThreadId();
+
+    char value = 0;
+    while (true)
+    {
+        qint64 nextPollNs = std::numeric_limits<qint64>::max();
+        {
+            QMutexLocker locker(&mMutex);
+            while (!mStopped && mSources.isEmpty()){
+                mCpuTimeUs.store(ThreadScheduler::currentThreadCpuTimeUs());
+                mHasSources.wait(&mMutex);
+            }
+            if (mStopped)
+                break;
+
+            if (mScheduleChanged){
+                mScheduleChanged = false;
+                QString error;
+                if (!ThreadScheduler::applyToCurrentThread(mCpu, mSchedPolicy, mSchedPriority, &error))
+                    qWarning().noquote() << "共享就绪轮询线程调度策略设置失败：" << error;
+            }
+
+            for (ReadySource* source : mSources){
+                if (source->mFailed)
+                    continue;
+
+                bool ok = source->mDevice->read(XdmaDevice::chUser, source->mAddress, &value, 1);
+                qint64 nowNs = mClock.nsecsElapsed();
+                if (!ok){
+                    source->mFailed = true;
+                    ReadyEdge edge;
+                    edge.ok = false;
+                    edge.sampleNs = nowNs;
+                    edge.prevSampleNs = source->mLastSampleNs;
+                    source->push(edge);
+                    continue;
+                }
+
+                if ((int)(quint8)value != source->mLastValue){
+                    // 第一次读到的值不算跳变，不参与节拍学习
+                    if (source->mLastValue >= 0)
+                        source->mWaiter.onTransition(nowNs);
+                    source->mLastValue = (quint8)value;
+
+                    ReadyEdge edge;
+                    edge.value = (quint8)value;
+                    edge.sampleNs = nowNs;
+                    edge.prevSampleNs = source->mLastSampleNs;
+                    source->push(edge);
+                }
+                source->mLastSampleNs = nowNs;
+                nextPollNs = qMin(nextPollNs, source->mWaiter.nextPollNs(nowNs));
+            }
+        }
+        mSweeps++;
+
+        qint64 nowNs = mClock.nsecsElapsed();
+        if (nextPollNs == std::numeric_limits<qint64>::max())
+            nextPollNs = nowNs + kIdleSleepNs;
+        if (nextPollNs - nowNs >= kCpuSampleNs)
+            mCpuTimeUs.store(ThreadScheduler::currentThreadCpuTimeUs());
+        mSleeper.sleepUntil(mClock, nextPollNs);
+    }
+
+    mCpuTimeUs.store(ThreadScheduler::currentThreadCpuTimeUs());
+}
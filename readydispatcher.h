@@ -0,0 +1,106 @@
+﻿#ifndef READYDISPATCHER_H
+#define READYDISPATCHER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QList>
+#include <QVector>
+#include <QElapsedTimer>
+#include <atomic>
+#include "deadlinewaiter.h"
+#include "threadscheduler.h"
+
+class XdmaDevice;
+
+// 就绪寄存器的一次跳变
+struct ReadyEdge {
+    quint8 value = 0;           // 跳变后的寄存器值
+    bool ok = true;             // 读寄存器失败时为false，之后该寄存器不再轮询
+    qint64 sampleNs = 0;        // 读到新值的时刻（ReadyDispatcher::nowNs，所有采集卡共用一个时钟）
+    qint64 prevSampleNs = 0;    // 上一次读该寄存器的时刻，0表示没有
+};
+
+/**
+ * ReadySource 一个DDR的就绪寄存器
+ * 由ReadyDispatcher轮询，寄存器值变化时放入队列，采集线程阻塞等待队列，不再自己轮询。
+ */
+class ReadySource
+{
+public:
+    /*等待下一次跳变，timeoutMs内没有跳变返回false*/
+    bool waitEdge(ReadyEdge& edge, qint64 timeoutMs);
+
+private:
+    friend class ReadyDispatcher;
+    ReadySource(XdmaDevice* device, quint64 address, qint64 periodNs);
+    void push(const ReadyEdge& edge);
+
+    XdmaDevice* mDevice;
+    quint64 mAddress;
+    DeadlineWaiter mWaiter;     // 只学习本寄存器的节拍，只在轮询线程中访问
+    int mLastValue = -1;
+    qint64 mLastSampleNs = 0;
+    bool mFailed = false;
+
+    QMutex mMutex;
+    QWaitCondition mNotEmpty;
+    QQueue<ReadyEdge> mEdges;
+};
+
+/**
+ * ReadyDispatcher 共享就绪轮询线程
+ * 一个线程依次读取所有采集卡所有DDR的就绪寄存器，把跳变分发到各DDR的队列，
+ * 代替每个采集线程各自自旋轮询：6个DDR只占用一个核心，且所有跳变时刻取自同一个时钟，可以直接比较板间偏差。
+ * 每个寄存器各自学习节拍，轮询线程按最早一个预计跳变时刻睡眠/自旋。
+ * 中断方式检测就绪时采集线程本来就阻塞等待事件，不经过这里。
+ */
+class ReadyDispatcher : public QThread
+{
+    Q_OBJECT
+public:
+    static ReadyDispatcher& instance();
+    ~ReadyDispatcher();
+
+    /*开始轮询一个就绪寄存器（user通道需已打开），返回的对象在detach之前有效*/
+    ReadySource* attach(XdmaDevice* device, quint64 address, qint64 periodNs);
+    /*停止轮询并释放，返回后轮询线程不会再访问该设备*/
+    void detach(ReadySource* source);
+
+    /*轮询线程的CPU绑定和调度策略，下次轮询时生效*/
+    void setSchedulePolicy(ThreadScheduler::Policy policy, int priority, int cpu);
+
+    /*共用时钟（ns）*/
+    qint64 nowNs() const { return mClock.nsecsElapsed(); }
+    /*轮询线程累计CPU时间（us）和轮询次数*/
+    qint64 cpuTimeUs() const { return mCpuTimeUs.load(); }
+    quint64 sweeps() const { return mSweeps.load(); }
+
+    /*按包序号对齐多个DDR的就绪时刻（共用时钟，0表示没有），返回每帧最早与最晚的差（ns）*/
+    static QVector<qint64> edgeSkewNs(const QList<QVector<qint64>>& readyClockNs);
+
+protected:
+    void run() override;
+
+private:
+    ReadyDispatcher();
+    void stop();
+
+    QElapsedTimer mClock;
+    DeadlineWaiter mSleeper;    // 只用来睡眠和学习唤醒误差
+    QList<ReadySource*> mSources;
+    bool mStopped = false;
+    QMutex mMutex;
+    QWaitCondition mHasSources;
+
+    bool mScheduleChanged = false;
+    ThreadScheduler::Policy mSchedPolicy = ThreadScheduler::Normal;
+    int mSchedPriority = 0;
+    int mCpu = -1;
+
+    std::atomic<qint64> mCpuTimeUs{0};
+    std::atomic<quint64> mSweeps{0};
+};
+
+#endif // READYDISPATCHER_H
@@ -0,0 +1,128 @@
+﻿#include "registertransaction.h"
+#include "deadlinewaiter.h"
+#include <QElapsedTimer>
+#include <QScopedPointer>
+#include <QtConcurrent>
+#include <QDebug>
+
+RegisterTransaction::RegisterTransaction(quint8 physicalNo, const QString& deviceName)
+    : mPhysicalNo(physicalNo)
+    , mDeviceName(deviceName)
+{
+}
+
+void RegisterTransaction::command(quint32 cmd, int holdMs, const QString& note)
+{
+    Step step;
+    step.command = cmd;
+    step.holdMs = holdMs;
+    step.note = note;
+    mSteps.append(step);
+}
+
+bool RegisterTransaction::exec()
+{
+    using namespace XdmaRegDef;
+    mElapsedUs = 0;
+    mMaxWriteNs = 0;
+    mViolations = 0;
+    mError.clear();
+
+    QScopedPointer<XdmaDevice> device(XdmaDevice::create(mDeviceName));
+    if (!device->openChannel(XdmaDevice::chUser)){
+        mError = QStringLiteral("user通道打开失败");
+        return false;
+    }
+
+    DeadlineWaiter waiter;
+    QElapsedTimer timer;
+    timer.start();
+    auto writeCtrl = [&](quint32 value){
+        qint64 startNs = timer.nsecsElapsed();
+        bool ok = device->writeRegister(USER_CTRL_ADDR, value);
+        mMaxWriteNs = qMax(mMaxWriteNs, timer.nsecsElapsed() - startNs);
+        return ok;
+    };
+
+    bool ok = writeCtrl(CMD_CLEAR);
+    if (!ok)
+        mError = QStringLiteral("清零失败");
+    qint64 clearNs = timer.nsecsElapsed();
+    for (Step& step : mSteps){
+        if (!ok)
+            break;
+
+        waiter.sleepUntil(timer, clearNs + REG_CLEAR_WAIT_MS * 1000000LL);
+        step.gapNs = timer.nsecsElapsed() - clearNs;
+        step.ok = writeCtrl(step.command);
+        qint64 writeNs = timer.nsecsElapsed();
+        if (!step.ok){
+            mError = QStringLiteral("命令0x%1写入失败").arg(step.command, 8, 16, QLatin1Char('0'));
+            ok = false;
+            break;
+        }
+
+        waiter.sleepUntil(timer, writeNs + step.holdMs * 1000000LL);
+        step.heldNs = timer.nsecsElapsed() - writeNs;
+        if (!writeCtrl(CMD_CLEAR)){
+            mError = QStringLiteral("命令0x%1清零失败").arg(step.command, 8, 16, QLatin1Char('0'));
+            ok = false;
+            break;
+        }
+        clearNs = timer.nsecsElapsed();
+
+        // 保持时间从写完算到开始清零，清零间隔从清零写完算到开始写下一条命令，都是FPGA实际看到的下限
+        if (step.heldNs < step.holdMs * 1000000LL || step.gapNs < REG_CLEAR_WAIT_MS * 1000000LL)
+            mViolations++;
+    }
+
+    mElapsedUs = timer.nsecsElapsed() / 1000;
+    device->closeAll();
+    return ok;
+}
+
+bool RegisterTransaction::execAll(QList<RegisterTransaction>& transactions, const QString& name)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QList<QFuture<bool>> futures;
+    for (RegisterTransaction& transaction : transactions){
+        if (transaction.isEmpty())
+            continue;
+        RegisterTransaction* pTransaction = &transaction;
+        futures.append(QtConcurrent::run([pTransaction](){ return pTransaction->exec(); }));
+    }
+
+    bool allOk = true;
+    for (QFuture<bool>& future : futures){
+        future.waitForFinished();
+        allOk &= future.result();
+    }
+
+    for (const RegisterTransaction& transaction : transactions){
+        if (transaction.isEmpty())
+            continue;
+
+        qint64 minHeldUs = 0;
+        for (const Step& step : transaction.steps()){
+            if (step.ok && (minHeldUs == 0 || step.heldNs / 1000 < minHeldUs))
+                minHeldUs = step.heldNs / 1000;
+        }
+
+        if (!transaction.errorString().isEmpty()){
+            qCritical().noquote().nospace() << "采集卡#" << transaction.physicalNo() << " " << name << "失败：" << transaction.errorString();
+            continue;
+        }
+
+        qInfo().noquote().nospace() << "采集卡#" << transaction.physicalNo() << " " << name
+                                    << " 命令数：" << transaction.steps().size()
+                                    << " 耗时(ms)：" << transaction.elapsedUs() / 1000
+                                    << " 最短保持(us)：" << minHeldUs
+                                    << " 最长写入(us)：" << transaction.maxWriteUs()
+                                    << " 时序：" << (transaction.violations() == 0 ? QStringLiteral("正常") : QStringLiteral("违例%1处").arg(transaction.violations()));
+    }
+
+    qInfo().noquote().nospace() << name << "完成，" << futures.size() << "张卡并行，总耗时(ms)：" << timer.elapsed();
+    return allOk;
+}
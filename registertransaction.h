@@ -0,0 +1,58 @@
+﻿#ifndef REGISTERTRANSACTION_H
+#define REGISTERTRANSACTION_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QList>
+#include <QVector>
+#include "xdmadevice.h"
+
+/**
+ * RegisterTransaction 采集卡控制寄存器事务
+ * 把一张卡要写的控制命令排成队列一次执行，多张卡的事务由execAll并行执行。
+ * FPGA按"命令-清零"握手锁存USER_CTRL_ADDR上的命令：命令至少保持holdMs，清零后至少REG_CLEAR_WAIT_MS才能写下一条命令。
+ * 事务只在这两处等待：开头清零一次（上次操作可能留下未清零的命令，如开始测量），最后一条命令清零后不再等待。
+ * 等待按截止时刻计算，执行时记录每条命令实际的保持时间和清零间隔，不足要求时记为时序违例。
+ */
+class RegisterTransaction
+{
+public:
+    struct Step {
+        quint32 command = 0;
+        int holdMs = XdmaRegDef::REG_OP_WAIT_MS;
+        QString note;
+        qint64 gapNs = 0;   // 上一次清零完成到写命令的间隔
+        qint64 heldNs = 0;  // 命令写完到开始清零的间隔
+        bool ok = false;
+    };
+
+    RegisterTransaction(quint8 physicalNo = 0, const QString& deviceName = QString());
+
+    /*追加一条命令（写命令、保持holdMs、清零）*/
+    void command(quint32 cmd, int holdMs = XdmaRegDef::REG_OP_WAIT_MS, const QString& note = QString());
+
+    /*在当前线程顺序执行*/
+    bool exec();
+    /*各卡的事务并行执行，结束后逐卡输出耗时和时序检查结果*/
+    static bool execAll(QList<RegisterTransaction>& transactions, const QString& name);
+
+    quint8 physicalNo() const { return mPhysicalNo; }
+    bool isEmpty() const { return mSteps.isEmpty(); }
+    const QVector<Step>& steps() const { return mSteps; }
+    qint64 elapsedUs() const { return mElapsedUs; }
+    qint64 maxWriteUs() const { return mMaxWriteNs / 1000; }
+    int violations() const { return mViolations; }
+    QString errorString() const { return mError; }
+
+private:
+    quint8 mPhysicalNo;
+    QString mDeviceName;
+    QVector<Step> mSteps;
+
+    qint64 mElapsedUs = 0;
+    qint64 mMaxWriteNs = 0;// 单次写寄存器的最长耗时
+    int mViolations = 0;
+    QString mError;
+};
+
+#endif // REGISTERTRANSACTION_H
@@ -0,0 +1,537 @@
+﻿#include "shotcontainer.h"
+#include "globalsettings.h"
+#include "waveformcodec.h"
+#include "framevalidator.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QMap>
+#include <QRegularExpression>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+namespace {
+    const char kMagic[8] = {'N','C','S','H','O','T','0','1'};
+    const char kRecordMagic[8] = {'N','C','F','R','A','M','E','1'};
+    const quint32 kVersion = 2;
+    const qint64 kPageSize = 4096;               // 帧对齐，同时满足直接I/O的对齐要求
+    const qint64 kWriteChunk = 64 * 1024 * 1024; // 单次系统调用写入上限
+
+    qint64 alignUp(qint64 size)
+    {
+        return (size + kPageSize - 1) / kPageSize * kPageSize;
+    }
+
+#pragma pack(push, 1)
+    // 每帧数据前一页的记录，用于没有正常关闭时扫描恢复索引
+    struct RecordHeader {
+        char magic[8];                  // "NCFRAME1"
+        ShotContainer::IndexEntry entry;// offset指向记录页之后的帧数据
+        quint32 crc;                    // magic和entry的CRC32C
+    };
+#pragma pack(pop)
+
+    quint32 recordCrc(const RecordHeader& record)
+    {
+        return FrameValidator::crc32c(reinterpret_cast<const char*>(&record), offsetof(RecordHeader, crc));
+    }
+
+    bool entryLess(const ShotContainer::IndexEntry& a, const ShotContainer::IndexEntry& b)
+    {
+        return a.kind != b.kind ? a.kind < b.kind : a.frameId < b.frameId;
+    }
+
+    bool timeLess(const ShotContainer::IndexEntry& a, const ShotContainer::IndexEntry& b)
+    {
+        return a.kind != b.kind ? a.kind < b.kind : a.timeNs < b.timeNs;
+    }
+
+    // 原单帧文件名：采集卡序号 + A/B + data/spec + 文件序号
+    bool parseFrameFileName(const QString& binFilePath, QString& containerPath, ShotContainer::Kind& kind, quint32& frameId)
+    {
+        static const QRegularExpression re("^(\\d+)([AB])(data|spec)(\\d+)\\.n?bin$");
+        QFileInfo fi(binFilePath);
+        QRegularExpressionMatch match = re.match(fi.fileName());
+        if (!match.hasMatch())
+            return false;
+
+        containerPath = ShotContainer::containerPath(fi.path(), match.captured(1).toUInt(), match.captured(2) == "A");
+        kind = match.captured(3) == "data" ? ShotContainer::Waveform : ShotContainer::Spectrum;
+        frameId = match.captured(4).toUInt();
+        return true;
+    }
+
+    const ShotContainer::IndexEntry* findInContainer(const QString& binFilePath, QSharedPointer<ShotContainerReader>& reader)
+    {
+        QString containerPath;
+        ShotContainer::Kind kind;
+        quint32 frameId;
+        if (!parseFrameFileName(binFilePath, containerPath, kind, frameId))
+            return nullptr;
+
+        reader = ShotContainerReader::cached(containerPath);
+        return reader ? reader->find(kind, frameId) : nullptr;
+    }
+}
+
+/**
+ * ShotContainer 整炮容器文件====================================================
+*/
+ShotContainer::IndexEntry ShotContainer::makeEntry(Kind kind, quint32 frameId, quint32 frameSeq, qint64 timeNs)
+{
+    IndexEntry entry;
+    std::memset(&entry, 0, sizeof(entry));
+    entry.kind = kind;
+    entry.frameId = frameId;
+    entry.frameSeq = frameSeq;
+    entry.timeNs = timeNs;
+    return entry;
+}
+
+QString ShotContainer::containerPath(const QString& dirPath, quint32 physicalNo, bool isDDR1)
+{
+    return QString("%1/%2%3shot.nsc").arg(dirPath).arg(physicalNo).arg(isDDR1 ? 'A' : 'B');
+}
+
+bool ShotContainer::readFile(const QString& binFilePath, QByteArray& data)
+{
+    QFile f(binFilePath);
+    if (!f.exists())
+        f.setFileName(WaveformCodec::encodedFileName(binFilePath));
+    if (f.open(QIODevice::ReadOnly)){
+        data = f.readAll();
+        return true;
+    }
+
+    QSharedPointer<ShotContainerReader> reader;
+    const IndexEntry* entry = findInContainer(binFilePath, reader);
+    if (!entry)
+        return false;
+
+    data = reader->read(*entry);
+    return quint64(data.size()) == entry->size;
+}
+
+bool ShotContainer::readFileRange(const QString& binFilePath, qint64 offset, qint64 size, QByteArray& data)
+{
+    QFile f(binFilePath);
+    if (f.open(QIODevice::ReadOnly)){
+        if (!f.seek(offset))
+            return false;
+        data = f.read(size);
+        return true;
+    }
+    if (QFileInfo::exists(WaveformCodec::encodedFileName(binFilePath)))
+        return false;
+
+    QSharedPointer<ShotContainerReader> reader;
+    const IndexEntry* entry = findInContainer(binFilePath, reader);
+    if (!entry || offset < 0 || quint64(offset) > entry->size)
+        return false;
+
+    data = reader->read(*entry, offset, qMin(size, qint64(entry->size) - offset));
+    return true;
+}
+
+bool ShotContainer::locate(const QString& binFilePath, QString& filePath, qint64& offset, qint64& size)
+{
+    QFileInfo fi(binFilePath);
+    if (fi.exists()){
+        filePath = binFilePath;
+        offset = 0;
+        size = fi.size();
+        return true;
+    }
+    if (QFileInfo::exists(WaveformCodec::encodedFileName(binFilePath)))
+        return false;
+
+    QSharedPointer<ShotContainerReader> reader;
+    const IndexEntry* entry = findInContainer(binFilePath, reader);
+    if (!entry)
+        return false;
+
+    filePath = reader->fileName();
+    offset = qint64(entry->offset);
+    size = qint64(entry->size);
+    return true;
+}
+
+bool ShotContainer::exists(const QString& binFilePath)
+{
+    return fileSize(binFilePath) >= 0;
+}
+
+qint64 ShotContainer::fileSize(const QString& binFilePath)
+{
+    QFileInfo fi(binFilePath);
+    if (fi.exists())
+        return fi.size();
+    fi.setFile(WaveformCodec::encodedFileName(binFilePath));
+    if (fi.exists())
+        return fi.size();
+
+    QSharedPointer<ShotContainerReader> reader;
+    const IndexEntry* entry = findInContainer(binFilePath, reader);
+    return entry ? qint64(entry->size) : -1;
+}
+
+ShotContainer::FrameFiles ShotContainer::frameFiles(const QString& dirPath)
+{
+    FrameFiles frames;
+    QDir dir(dirPath);
+    for (const QFileInfo& fi : dir.entryInfoList(QStringList() << "*.nsc", QDir::Files | QDir::NoSymLinks)){
+        QSharedPointer<ShotContainerReader> reader = ShotContainerReader::cached(fi.filePath());
+        if (!reader)
+            continue;
+
+        const QDateTime modified = fi.lastModified();
+        for (const IndexEntry& entry : reader->entries()){
+            FrameFile frame;
+            frame.fileName = QString("%1%2%3%4.bin").arg(entry.board).arg(entry.ddr == 0 ? 'A' : 'B')
+                                                    .arg(entry.kind == Waveform ? "data" : "spec").arg(entry.frameId);
+            frame.size = qint64(entry.size);
+            frame.modified = modified;
+            frames.insert(frame.fileName, frame);
+        }
+    }
+    return frames;
+}
+
+/**
+ * ShotContainerWriter 整炮容器写入====================================================
+*/
+ShotContainerWriter::~ShotContainerWriter()
+{
+    if (isOpen())
+        close();
+}
+
+bool ShotContainerWriter::isOpen() const
+{
+    QMutexLocker locker(&mMutex);
+#ifdef _WIN32
+    return mBufferedHandle != nullptr;
+#else
+    return mBufferedFd >= 0;
+#endif
+}
+
+bool ShotContainerWriter::open(const QString& filePath, quint32 physicalNo, bool isDDR1, bool directIO, qint64 startTimeMs)
+{
+    if (isOpen())
+        close();
+
+    QMutexLocker locker(&mMutex);
+    mFilePath = filePath;
+    mEntries.clear();
+    mEnd = kPageSize;
+
+    std::memset(&mHeader, 0, sizeof(mHeader));
+    std::memcpy(mHeader.magic, kMagic, sizeof(kMagic));
+    mHeader.version = kVersion;
+    mHeader.physicalNo = physicalNo;
+    mHeader.ddr = isDDR1 ? 0 : 1;
+    mHeader.startTimeMs = startTimeMs;
+
+#ifdef _WIN32
+    // 同一个文件开两个句柄：对齐部分直接I/O，尾部和索引普通写入
+    LPCWSTR path = reinterpret_cast<LPCWSTR>(filePath.utf16());
+    HANDLE buffered = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (buffered == INVALID_HANDLE_VALUE){
+        qWarning() << "创建文件失败，错误码：" << GetLastError();
+        return false;
+    }
+    mBufferedHandle = buffered;
+
+    if (directIO){
+        HANDLE direct = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH, nullptr);
+        mDirectHandle = direct == INVALID_HANDLE_VALUE ? nullptr : direct;
+    }
+#else
+    QByteArray path = QFile::encodeName(filePath);
+    mBufferedFd = ::open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (mBufferedFd < 0){
+        qWarning() << "创建文件失败，errno：" << errno;
+        return false;
+    }
+    if (directIO)
+        mDirectFd = ::open(path.constData(), O_WRONLY | O_DIRECT);// tmpfs等不支持O_DIRECT时为-1
+#endif
+
+    // 文件头占第0页，正常关闭时回写索引位置
+    QByteArray page(kPageSize, 0);
+    std::memcpy(page.data(), &mHeader, sizeof(mHeader));
+    locker.unlock();
+    return writeAt(false, 0, page.constData(), page.size());
+}
+
+bool ShotContainerWriter::writeAt(bool direct, qint64 offset, const char* data, qint64 size)
+{
+#ifdef _WIN32
+    HANDLE handle = direct ? mDirectHandle : mBufferedHandle;
+    qint64 done = 0;
+    while (done < size){
+        OVERLAPPED overlapped;
+        std::memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = DWORD((offset + done) & 0xFFFFFFFF);
+        overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+        DWORD chunk = (DWORD)qMin(kWriteChunk, size - done);
+        DWORD written = 0;
+        if (!WriteFile(handle, data + done, chunk, &written, &overlapped) || written == 0){
+            qWarning() << "写文件失败，错误码：" << GetLastError();
+            return false;
+        }
+        done += written;
+    }
+    return true;
+#else
+    int fd = direct ? mDirectFd : mBufferedFd;
+    qint64 done = 0;
+    while (done < size){
+        ssize_t rc = ::pwrite(fd, data + done, qMin(kWriteChunk, size - done), offset + done);
+        if (rc < 0){
+            if (errno == EINTR)
+                continue;
+            if (!direct || errno != EINVAL)
+                qWarning() << "写文件失败，errno：" << errno;
+            return false;
+        }
+        if (rc == 0){
+            qWarning() << "写文件失败，没有写入数据，偏移：" << offset + done;
+            return false;
+        }
+        done += rc;
+    }
+    return true;
+#endif
+}
+
+bool ShotContainerWriter::write(ShotContainer::IndexEntry entry, const char* data, qint64 size)
+{
+    qint64 offset;
+    bool hasDirect;
+    {
+        QMutexLocker locker(&mMutex);
+#ifdef _WIN32
+        if (!mBufferedHandle)
+            return false;
+        hasDirect = mDirectHandle != nullptr;
+#else
+        if (mBufferedFd < 0)
+            return false;
+        hasDirect = mDirectFd >= 0;
+#endif
+        offset = mEnd + kPageSize;// 前一页为记录页
+        mEnd = alignUp(offset + size);
+    }
+
+    // 帧之间按页对齐，直接I/O和普通写入不会落在同一页；地址不对齐或设备不接受时整帧普通写入
+    qint64 alignedSize = (hasDirect && (quintptr)data % kPageSize == 0) ? (size & ~(kPageSize - 1)) : 0;
+    bool ok = alignedSize > 0 && writeAt(true, offset, data, alignedSize);
+    if (!ok)
+        alignedSize = 0;
+    ok = writeAt(false, offset + alignedSize, data + alignedSize, size - alignedSize);
+    if (!ok)
+        return false;
+
+    entry.board = quint16(mHeader.physicalNo);
+    entry.ddr = mHeader.ddr;
+    entry.offset = quint64(offset);
+    entry.size = quint64(size);
+    if (entry.timeNs == 0)// 没有实测时刻（超时未读的帧等）按帧序号推算
+        entry.timeNs = (mHeader.startTimeMs + qint64(entry.frameId - 1) * PACKET_TIMELENGTH) * 1000000;
+
+    // 帧数据写完后再写记录页，扫描恢复时有记录的帧数据一定完整
+    RecordHeader record;
+    std::memset(&record, 0, sizeof(record));
+    std::memcpy(record.magic, kRecordMagic, sizeof(kRecordMagic));
+    record.entry = entry;
+    record.crc = recordCrc(record);
+    if (!writeAt(false, offset - kPageSize, reinterpret_cast<const char*>(&record), sizeof(record)))
+        return false;
+
+    QMutexLocker locker(&mMutex);
+    mEntries.append(entry);
+    return true;
+}
+
+bool ShotContainerWriter::close()
+{
+    QMutexLocker locker(&mMutex);
+#ifdef _WIN32
+    if (!mBufferedHandle)
+        return false;
+#else
+    if (mBufferedFd < 0)
+        return false;
+#endif
+
+    std::sort(mEntries.begin(), mEntries.end(), entryLess);
+    mHeader.entryCount = quint32(mEntries.size());
+    mHeader.indexOffset = quint64(mEnd);
+    locker.unlock();
+
+    bool ok = writeAt(false, mHeader.indexOffset, reinterpret_cast<const char*>(mEntries.constData()), qint64(mEntries.size()) * sizeof(ShotContainer::IndexEntry))
+              && writeAt(false, 0, reinterpret_cast<const char*>(&mHeader), sizeof(mHeader));
+
+    locker.relock();
+#ifdef _WIN32
+    if (mDirectHandle)
+        CloseHandle(mDirectHandle);
+    CloseHandle(mBufferedHandle);
+    mDirectHandle = nullptr;
+    mBufferedHandle = nullptr;
+#else
+    if (mDirectFd >= 0)
+        ::close(mDirectFd);
+    ::close(mBufferedFd);
+    mDirectFd = -1;
+    mBufferedFd = -1;
+#endif
+    if (!ok)
+        qCritical() << "写容器索引失败：" << mFilePath;
+    return ok;
+}
+
+/**
+ * ShotContainerReader 整炮容器读取====================================================
+*/
+bool ShotContainerReader::open(const QString& filePath)
+{
+    QMutexLocker locker(&mMutex);
+    mFile.close();
+    mEntries.clear();
+    mTimeIndex.clear();
+
+    mFile.setFileName(filePath);
+    if (!mFile.open(QIODevice::ReadOnly))
+        return false;
+
+    bool ok = mFile.read(reinterpret_cast<char*>(&mHeader), sizeof(mHeader)) == sizeof(mHeader)
+              && std::memcmp(mHeader.magic, kMagic, sizeof(kMagic)) == 0
+              && mHeader.indexOffset >= quint64(kPageSize)
+              && mHeader.indexOffset + quint64(mHeader.entryCount) * sizeof(ShotContainer::IndexEntry) <= quint64(mFile.size());
+    if (ok){
+        mEntries.resize(mHeader.entryCount);
+        qint64 bytes = qint64(mHeader.entryCount) * sizeof(ShotContainer::IndexEntry);
+        ok = mFile.seek(mHeader.indexOffset) && mFile.read(reinterpret_cast<char*>(mEntries.data()), bytes) == bytes;
+    }
+    else if (mFile.size() >= qint64(sizeof(mHeader)) && std::memcmp(mHeader.magic, kMagic, sizeof(kMagic)) == 0
+             && mHeader.version >= 2 && mHeader.indexOffset == 0){
+        ok = recover();
+    }
+    if (!ok){
+        mFile.close();
+        mEntries.clear();
+        return false;
+    }
+
+    mTimeIndex = mEntries;
+    std::sort(mTimeIndex.begin(), mTimeIndex.end(), timeLess);
+    return true;
+}
+
+bool ShotContainerReader::recover()
+{
+    // 从第1页开始按记录页扫描，帧与帧之间跳过整帧；记录无效（正在写的帧）时逐页向后找下一条记录
+    const qint64 fileSize = mFile.size();
+    qint64 pos = kPageSize;
+    while (pos + qint64(sizeof(RecordHeader)) <= fileSize){
+        RecordHeader record;
+        if (!mFile.seek(pos) || mFile.read(reinterpret_cast<char*>(&record), sizeof(record)) != sizeof(record))
+            break;
+
+        const ShotContainer::IndexEntry& entry = record.entry;
+        bool valid = std::memcmp(record.magic, kRecordMagic, sizeof(kRecordMagic)) == 0
+                     && record.crc == recordCrc(record)
+                     && entry.offset == quint64(pos + kPageSize)
+                     && entry.offset + entry.size <= quint64(fileSize);
+        if (!valid){
+            pos += kPageSize;
+            continue;
+        }
+
+        mEntries.append(entry);
+        pos = alignUp(qint64(entry.offset + entry.size));
+    }
+
+    std::sort(mEntries.begin(), mEntries.end(), entryLess);
+    mHeader.entryCount = quint32(mEntries.size());
+    qWarning().noquote() << "整炮容器没有正常关闭，扫描恢复帧数：" << mEntries.size() << mFile.fileName();
+    return !mEntries.isEmpty();
+}
+
+const ShotContainer::IndexEntry* ShotContainerReader::find(ShotContainer::Kind kind, quint32 frameId) const
+{
+    ShotContainer::IndexEntry key = ShotContainer::makeEntry(kind, frameId, 0);
+    auto iter = std::lower_bound(mEntries.constBegin(), mEntries.constEnd(), key, entryLess);
+    if (iter == mEntries.constEnd() || iter->kind != kind || iter->frameId != frameId)
+        return nullptr;
+    return &(*iter);
+}
+
+QVector<ShotContainer::IndexEntry> ShotContainerReader::findByTime(ShotContainer::Kind kind, qint64 beginNs, qint64 endNs) const
+{
+    // 帧开始时刻在(beginNs - 一帧时长, endNs)之间的帧与时间范围有重叠
+    QVector<ShotContainer::IndexEntry> result;
+    ShotContainer::IndexEntry key = ShotContainer::makeEntry(kind, 0, 0, beginNs - qint64(PACKET_TIMELENGTH) * 1000000 + 1);
+    for (auto iter = std::lower_bound(mTimeIndex.constBegin(), mTimeIndex.constEnd(), key, timeLess);
+         iter != mTimeIndex.constEnd() && iter->kind == kind && iter->timeNs < endNs; ++iter)
+        result.append(*iter);
+    return result;
+}
+
+QByteArray ShotContainerReader::read(const ShotContainer::IndexEntry& entry)
+{
+    return read(entry, 0, entry.size);
+}
+
+QByteArray ShotContainerReader::read(const ShotContainer::IndexEntry& entry, qint64 offset, qint64 size)
+{
+    QMutexLocker locker(&mMutex);
+    if (!mFile.isOpen() || !mFile.seek(entry.offset + offset))
+        return QByteArray();
+    return mFile.read(size);
+}
+
+QSharedPointer<ShotContainerReader> ShotContainerReader::cached(const QString& filePath)
+{
+    struct CacheItem {
+        QSharedPointer<ShotContainerReader> reader;
+        qint64 size = -1;
+        QDateTime modified;
+    };
+    static QMutex cacheMutex;
+    static QMap<QString, CacheItem> cache;
+
+    QFileInfo fi(filePath);
+    QMutexLocker locker(&cacheMutex);
+    if (!fi.exists()){
+        cache.remove(filePath);
+        return QSharedPointer<ShotContainerReader>();
+    }
+
+    CacheItem& item = cache[filePath];
+    if (!item.reader || item.size != fi.size() || item.modified != fi.lastModified()){
+        item.reader = QSharedPointer<ShotContainerReader>::create();
+        item.size = fi.size();
+        item.modified = fi.lastModified();
+        if (!item.reader->open(filePath)){
+            cache.remove(filePath);// 不是容器文件，或没有正常关闭且扫描不到完整的帧
+            return QSharedPointer<ShotContainerReader>();
+        }
+    }
+    return item.reader;
+}
@@ -0,0 +1,156 @@
+﻿#ifndef SHOTCONTAINER_H
+#define SHOTCONTAINER_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+#include <QFile>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QHash>
+#include <QDateTime>
+
+/**
+ * ShotContainer 整炮容器文件 %1/%2%3shot.nsc（采集卡序号 + A/B面）
+ * 代替每帧一个的 %1%2data%3.bin / %1%2spec%3.bin，一个DDR一炮只有一个文件，采集线程之间互不影响。
+ *
+ * 文件格式（小端）：
+ *   第0页（4096字节）：Header，其余填0
+ *   每帧：一页记录页（RecordHeader：魔数 + 该帧的IndexEntry + CRC32C）+ 帧数据，帧数据从4096对齐的偏移开始，
+ *         对齐部分直接I/O写入，不足一页的尾部普通写入；帧数据写完后才写记录页
+ *   索引：所有帧写完后追加在文件末尾，按（类型, 文件序号）排序的IndexEntry数组，最后回写Header
+ *
+ * 帧内容与原来的单帧文件完全相同（原始、零压缩或.nbin），读取时按原文件名查找，
+ * ShotContainer::readFile依次尝试 .bin -> .nbin -> 容器，离线流程只需要改用readFile/exists。
+ * 没有正常关闭的容器（崩溃、断电，indexOffset为0）打开时按记录页扫描重建索引，只丢失正在写的帧。
+ */
+class ShotContainer
+{
+public:
+    enum Kind : quint8 {
+        Waveform = 0,
+        Spectrum = 1
+    };
+
+#pragma pack(push, 1)
+    struct Header {
+        char magic[8];              // "NCSHOT01"
+        quint32 version;            // 2（1没有记录页，只能按索引读取）
+        quint32 physicalNo;         // 采集卡序号
+        quint8 ddr;                 // 0:A面(DDR1) 1:B面(DDR2)
+        quint8 reserved[3];
+        quint32 entryCount;
+        quint64 indexOffset;        // 0为没有正常关闭
+        qint64 startTimeMs;         // 开始保存的时刻（UTC，ms）
+    };
+
+    struct IndexEntry {
+        quint16 board;              // 采集卡序号
+        quint8 ddr;                 // 0:A 1:B
+        quint8 kind;                // Kind
+        quint32 frameId;            // 文件序号，对应原文件名 %1%2data%3.bin 中的%3
+        quint32 frameSeq;           // 采集时的包序号
+        quint32 reserved;
+        quint64 offset;
+        quint64 size;
+        qint64 timeNs;              // 帧开始时刻（UTC，ns），实测就绪时刻推算；没有实测时为startTimeMs + (frameId-1)*PACKET_TIMELENGTH
+    };
+#pragma pack(pop)
+
+    static IndexEntry makeEntry(Kind kind, quint32 frameId, quint32 frameSeq, qint64 timeNs = 0);
+    static QString containerPath(const QString& dirPath, quint32 physicalNo, bool isDDR1);
+
+    /*按原单帧文件名读取：.bin -> .nbin -> 整炮容器*/
+    static bool readFile(const QString& binFilePath, QByteArray& data);
+    /*按原单帧文件名读取其中一段（.bin或容器中的帧），.nbin不支持返回false*/
+    static bool readFileRange(const QString& binFilePath, qint64 offset, qint64 size, QByteArray& data);
+    /*原单帧数据所在的文件和偏移：.bin为文件本身，容器中的帧为容器文件和帧偏移；.nbin返回false。用于按范围映射读取*/
+    static bool locate(const QString& binFilePath, QString& filePath, qint64& offset, qint64& size);
+    /*原单帧文件（或.nbin、容器中的帧）是否存在*/
+    static bool exists(const QString& binFilePath);
+    /*原单帧文件大小，容器中的帧返回索引记录的大小，不存在返回-1*/
+    static qint64 fileSize(const QString& binFilePath);
+    /*容器中的一帧，按原单帧文件名列出；modified为容器文件的修改时间*/
+    struct FrameFile {
+        QString fileName;
+        qint64 size = 0;
+        QDateTime modified;
+    };
+    typedef QHash<QString, FrameFile> FrameFiles;// 文件名 -> 帧
+
+    /*目录下所有容器中的帧，大小和时间取自索引，不再逐个查询文件系统*/
+    static FrameFiles frameFiles(const QString& dirPath);
+};
+
+/**
+ * ShotContainerWriter 整炮容器写入
+ * write可以在多个写盘线程中同时调用：偏移在锁内分配，数据在锁外按偏移写入。
+ */
+class ShotContainerWriter
+{
+public:
+    ShotContainerWriter() = default;
+    ~ShotContainerWriter();
+
+    bool open(const QString& filePath, quint32 physicalNo, bool isDDR1, bool directIO, qint64 startTimeMs);
+    bool isOpen() const;
+    QString filePath() const { return mFilePath; }
+
+    /*写一帧，entry只需要填kind/frameId/frameSeq和实测的timeNs（见ShotContainer::makeEntry），timeNs为0时按帧序号推算*/
+    bool write(ShotContainer::IndexEntry entry, const char* data, qint64 size);
+    /*写索引并回写文件头，调用前所有write必须已经返回*/
+    bool close();
+
+private:
+    Q_DISABLE_COPY(ShotContainerWriter)
+    bool writeAt(bool direct, qint64 offset, const char* data, qint64 size);
+
+    mutable QMutex mMutex;
+    QString mFilePath;
+    ShotContainer::Header mHeader;
+    QVector<ShotContainer::IndexEntry> mEntries;
+    qint64 mEnd = 0;
+#ifdef _WIN32
+    void* mDirectHandle = nullptr;      // FILE_FLAG_NO_BUFFERING
+    void* mBufferedHandle = nullptr;
+#else
+    int mDirectFd = -1;                 // O_DIRECT
+    int mBufferedFd = -1;
+#endif
+};
+
+/**
+ * ShotContainerReader 整炮容器读取
+ * 打开时只读文件头和索引，按文件序号二分查找，read可以在多个线程中调用。
+ */
+class ShotContainerReader
+{
+public:
+    bool open(const QString& filePath);
+    bool isOpen() const { return mFile.isOpen(); }
+    QString fileName() const { return mFile.fileName(); }
+    const ShotContainer::Header& header() const { return mHeader; }
+    const QVector<ShotContainer::IndexEntry>& entries() const { return mEntries; }
+
+    const ShotContainer::IndexEntry* find(ShotContainer::Kind kind, quint32 frameId) const;
+    /*时间范围[beginNs, endNs)内有数据的帧（UTC，ns，每帧按PACKET_TIMELENGTH计），按时间排序*/
+    QVector<ShotContainer::IndexEntry> findByTime(ShotContainer::Kind kind, qint64 beginNs, qint64 endNs) const;
+    QByteArray read(const ShotContainer::IndexEntry& entry);
+    /*读取帧内的一段，offset相对帧开头*/
+    QByteArray read(const ShotContainer::IndexEntry& entry, qint64 offset, qint64 size);
+
+    /*按路径缓存打开的容器，文件大小或修改时间变化时重新打开*/
+    static QSharedPointer<ShotContainerReader> cached(const QString& filePath);
+
+private:
+    bool recover();
+
+    QFile mFile;
+    QMutex mMutex;
+    ShotContainer::Header mHeader;
+    QVector<ShotContainer::IndexEntry> mEntries;
+    QVector<ShotContainer::IndexEntry> mTimeIndex;// 按（类型, 时刻）排序，供findByTime二分查找
+};
+
+#endif // SHOTCONTAINER_H
@@ -0,0 +1,254 @@
+﻿#include "shotfilewriter.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+namespace {
+    const qint64 kDirectAlign = 4096;            // 直接I/O地址和长度对齐（兼容512e和4K盘）
+    const qint64 kWriteChunk = 64 * 1024 * 1024; // 单次系统调用写入上限
+}
+
+ShotFileWriter::ShotFileWriter(int queueDepth, bool directIO)
+    : mDirectIO(directIO)
+{
+    setQueueDepth(queueDepth);
+    mPool.setExpiryTimeout(-1);
+    mTimer.start();
+}
+
+ShotFileWriter::~ShotFileWriter()
+{
+    waitForDone();
+}
+
+void ShotFileWriter::setQueueDepth(int queueDepth)
+{
+    mQueueDepth = qBound(1, queueDepth, 64);
+    mPool.setMaxThreadCount(mQueueDepth);
+}
+
+QString ShotFileWriter::diskOf(const QString& filePath)
+{
+    QString dir = QFileInfo(filePath).absolutePath();
+    QMutexLocker locker(&mMutex);
+    auto iter = mDiskOfDir.constFind(dir);
+    if (iter != mDiskOfDir.constEnd())
+        return iter.value();
+
+    locker.unlock();
+    QString disk = QStorageInfo(dir).rootPath();
+    if (disk.isEmpty())
+        disk = dir;
+    locker.relock();
+    mDiskOfDir.insert(dir, disk);
+    return disk;
+}
+
+void ShotFileWriter::submit(const QString& filePath, const char* data, qint64 size, std::function<void(bool)> done)
+{
+    QString disk = diskOf(filePath);
+    bool directIO = mDirectIO;
+    mPool.start([=](){
+        writeAndRecord(filePath, disk, size, [&](){ return writeFile(filePath, data, size, directIO); }, done);
+    });
+}
+
+void ShotFileWriter::submit(const QString& filePath, std::function<QByteArray()> produce, std::function<void(bool)> done)
+{
+    QString disk = diskOf(filePath);
+    bool directIO = mDirectIO;
+    mPool.start([=](){
+        QByteArray data = produce();
+        writeAndRecord(filePath, disk, data.size(), [&](){ return writeFile(filePath, data.constData(), data.size(), directIO); }, done);
+    });
+}
+
+void ShotFileWriter::submit(ShotContainerWriter* container, const ShotContainer::IndexEntry& entry, const char* data, qint64 size, std::function<void(bool)> done)
+{
+    QString filePath = container->filePath();
+    QString disk = diskOf(filePath);
+    mPool.start([=](){
+        writeAndRecord(filePath, disk, size, [&](){ return container->write(entry, data, size); }, done);
+    });
+}
+
+void ShotFileWriter::submit(ShotContainerWriter* container, const ShotContainer::IndexEntry& entry, std::function<QByteArray()> produce, std::function<void(bool)> done)
+{
+    QString filePath = container->filePath();
+    QString disk = diskOf(filePath);
+    mPool.start([=](){
+        QByteArray data = produce();
+        writeAndRecord(filePath, disk, data.size(), [&](){ return container->write(entry, data.constData(), data.size()); }, done);
+    });
+}
+
+void ShotFileWriter::writeAndRecord(const QString& filePath, const QString& disk, qint64 size, const std::function<bool()>& write, const std::function<void(bool)>& done)
+{
+    qint64 startNs = mTimer.nsecsElapsed();
+    bool ok = write();
+    qint64 finishNs = mTimer.nsecsElapsed();
+
+    if (!ok)
+        qCritical() << "写文件失败：" << filePath;
+
+    {
+        QMutexLocker locker(&mMutex);
+        DiskStats& stats = mStats[disk];
+        if (stats.firstStartNs < 0 || startNs < stats.firstStartNs)
+            stats.firstStartNs = startNs;
+        stats.lastFinishNs = qMax(stats.lastFinishNs, finishNs);
+        if (ok){
+            stats.bytes += size;
+            stats.files++;
+        }
+        else{
+            stats.failed++;
+        }
+    }
+
+    if (done)
+        done(ok);
+}
+
+bool ShotFileWriter::waitForDone(int msecs)
+{
+    return mPool.waitForDone(msecs);
+}
+
+void ShotFileWriter::cancelPending()
+{
+    mPool.clear();
+}
+
+void ShotFileWriter::resetStatistics()
+{
+    QMutexLocker locker(&mMutex);
+    mStats.clear();
+}
+
+QMap<QString, ShotFileWriter::DiskStats> ShotFileWriter::statistics() const
+{
+    QMutexLocker locker(&mMutex);
+    return mStats;
+}
+
+QString ShotFileWriter::statisticsText() const
+{
+    QStringList lst;
+    QMap<QString, DiskStats> stats = statistics();
+    for (auto iter = stats.constBegin(); iter != stats.constEnd(); ++iter){
+        lst << QString("%1 %2MB/s(%3个文件%4)")
+               .arg(iter.key())
+               .arg(iter.value().mbPerSecond(), 0, 'f', 1)
+               .arg(iter.value().files)
+               .arg(iter.value().failed > 0 ? QString("，失败%1个").arg(iter.value().failed) : QString());
+    }
+    return lst.join("; ");
+}
+
+bool ShotFileWriter::writeFile(const QString& filePath, const char* data, qint64 size, bool directIO)
+{
+    // 地址不对齐时不能使用直接I/O
+    if ((quintptr)data % kDirectAlign != 0)
+        directIO = false;
+
+#ifdef _WIN32
+    HANDLE hFile = CreateFileW(reinterpret_cast<LPCWSTR>(filePath.utf16()),
+                               GENERIC_WRITE,
+                               0,
+                               nullptr,
+                               CREATE_ALWAYS,
+                               FILE_ATTRIBUTE_NORMAL | (directIO ? (FILE_FLAG_NO_BUFFERING | FILE_FLAG_WRITE_THROUGH) : 0),
+                               nullptr);
+    if (hFile == INVALID_HANDLE_VALUE){
+        qWarning() << "创建文件失败，错误码：" << GetLastError();
+        return false;
+    }
+
+    // 预分配磁盘空间，减少写入过程中的元数据更新和碎片
+    FILE_ALLOCATION_INFO allocationInfo;
+    allocationInfo.AllocationSize.QuadPart = size;
+    SetFileInformationByHandle(hFile, FileAllocationInfo, &allocationInfo, sizeof(allocationInfo));
+
+    qint64 alignedSize = directIO ? (size & ~(kDirectAlign - 1)) : size;
+    qint64 done = 0;
+    bool ok = true;
+    while (ok && done < alignedSize){
+        DWORD chunk = (DWORD)qMin(kWriteChunk, alignedSize - done);
+        DWORD written = 0;
+        ok = WriteFile(hFile, data + done, chunk, &written, nullptr) && written == chunk;
+        done += written;
+    }
+    CloseHandle(hFile);
+
+    // 不足一个扇区的尾部用普通方式追加
+    if (ok && done < size){
+        QFile file(filePath);
+        ok = file.open(QIODevice::WriteOnly | QIODevice::Append)
+             && file.write(data + done, size - done) == size - done;
+    }
+    return ok;
+#else
+    QByteArray path = QFile::encodeName(filePath);
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int fd = directIO ? ::open(path.constData(), flags | O_DIRECT, 0644) : -1;
+    if (fd < 0){
+        directIO = false;// tmpfs等不支持O_DIRECT
+        fd = ::open(path.constData(), flags, 0644);
+    }
+    if (fd < 0){
+        qWarning() << "创建文件失败，errno：" << errno;
+        return false;
+    }
+
+    // 预分配磁盘空间，减少写入过程中的元数据更新和碎片
+    if (size > 0)
+        posix_fallocate(fd, 0, size);
+
+    qint64 alignedSize = directIO ? (size & ~(kDirectAlign - 1)) : size;
+    qint64 done = 0;
+    bool ok = true;
+    while (done < size){
+        if (done == alignedSize && directIO){
+            // 不足一个块的尾部关闭O_DIRECT后再写
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            directIO = false;
+            alignedSize = size;
+        }
+
+        ssize_t rc = ::pwrite(fd, data + done, qMin(kWriteChunk, alignedSize - done), done);
+        if (rc < 0){
+            if (errno == EINTR)
+                continue;
+            if (errno == EINVAL && directIO){
+                // 设备逻辑块大于对齐值，退回普通写入
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+                directIO = false;
+                alignedSize = size;
+                continue;
+            }
+            qWarning() << "写文件失败，errno：" << errno;
+            ok = false;
+            break;
+        }
+        if (rc == 0){
+            qWarning() << "写文件失败，没有写入数据，已写：" << done << "总长：" << size;
+            ok = false;
+            break;
+        }
+        done += rc;
+    }
+
+    ::close(fd);
+    return ok;
+#endif
+}
@@ -0,0 +1,77 @@
+﻿#ifndef SHOTFILEWRITER_H
+#define SHOTFILEWRITER_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QMap>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <functional>
+#include "shotcontainer.h"
+
+/**
+ * ShotFileWriter 炮数据并发写盘
+ * 每个文件一个写任务，由内部线程池并发执行，同时在写的文件数即为队列深度，超出的任务在线程池中排队。
+ * 单个文件写入流程：预分配文件大小 -> 直接I/O（Linux O_DIRECT / Windows FILE_FLAG_NO_BUFFERING）写4096对齐部分
+ * -> 普通方式写不足4096字节的尾部。文件系统不支持直接I/O时自动退回普通写入。
+ * 按磁盘（挂载点/盘符）统计写入字节数和耗时，用于评估硬盘速度。
+ */
+class ShotFileWriter
+{
+public:
+    struct DiskStats {
+        qint64 bytes = 0;       // 写入字节数
+        qint32 files = 0;       // 写入文件数
+        qint32 failed = 0;      // 失败文件数
+        qint64 firstStartNs = -1;// 第一个文件开始写的时刻
+        qint64 lastFinishNs = 0; // 最后一个文件写完的时刻
+
+        double mbPerSecond() const {
+            qint64 ns = lastFinishNs - firstStartNs;
+            return (firstStartNs >= 0 && ns > 0) ? bytes / 1048576.0 / (ns / 1e9) : 0.0;
+        }
+    };
+
+    explicit ShotFileWriter(int queueDepth = 4, bool directIO = false);
+    ~ShotFileWriter();
+
+    void setQueueDepth(int queueDepth);
+    int queueDepth() const { return mQueueDepth; }
+    void setDirectIO(bool directIO) { mDirectIO = directIO; }
+    bool directIO() const { return mDirectIO; }
+
+    /*提交写文件任务，data在回调之前必须保持有效，回调在写盘线程中执行*/
+    void submit(const QString& filePath, const char* data, qint64 size, std::function<void(bool)> done = nullptr);
+    /*提交写文件任务，文件内容由produce在写盘线程中生成（如零压缩），生成时间不计入磁盘速度*/
+    void submit(const QString& filePath, std::function<QByteArray()> produce, std::function<void(bool)> done = nullptr);
+    /*提交写入整炮容器的任务，偏移由容器分配，entry见ShotContainer::makeEntry*/
+    void submit(ShotContainerWriter* container, const ShotContainer::IndexEntry& entry, const char* data, qint64 size, std::function<void(bool)> done = nullptr);
+    void submit(ShotContainerWriter* container, const ShotContainer::IndexEntry& entry, std::function<QByteArray()> produce, std::function<void(bool)> done = nullptr);
+    /*等待已提交的任务全部完成，msecs<0一直等待，超时返回false*/
+    bool waitForDone(int msecs = -1);
+    /*丢弃还没开始写的任务（这些任务的回调不会执行）*/
+    void cancelPending();
+
+    void resetStatistics();
+    QMap<QString, DiskStats> statistics() const;
+    QString statisticsText() const;
+
+    /*同步写单个文件*/
+    static bool writeFile(const QString& filePath, const char* data, qint64 size, bool directIO = false);
+
+private:
+    QString diskOf(const QString& filePath);
+    void writeAndRecord(const QString& filePath, const QString& disk, qint64 size, const std::function<bool()>& write, const std::function<void(bool)>& done);
+
+    int mQueueDepth = 4;
+    bool mDirectIO = false;
+    QThreadPool mPool;
+    mutable QMutex mMutex;
+    QElapsedTimer mTimer;
+    QMap<QString, DiskStats> mStats;
+    QMap<QString, QString> mDiskOfDir;// 目录 -> 磁盘，避免每个文件都查询一次
+};
+
+#endif // SHOTFILEWRITER_H
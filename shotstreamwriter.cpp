@@ -0,0 +1,256 @@
+﻿#include "shotstreamwriter.h"
+#include <QDeadlineTimer>
+#include <QSharedPointer>
+#include <QDateTime>
+#include "planarframe.h"
+#include <QDebug>
+
+/**
+ * CaptureFrameRing 锁页帧缓冲环====================================================
+*/
+CaptureFrameRing::CaptureFrameRing(int capacity, quint32 waveformSize, quint32 spectrumSize, int numaNode)
+{
+    mValid = true;
+    mSlots.resize(qMax(1, capacity));
+    for (int i=0; i<mSlots.size(); ++i){
+        CaptureFrameSlot& slot = mSlots[i];
+        slot.index = i;
+
+        slot.waveformBuffer = FrameBufferPool::instance().acquire(waveformSize, numaNode);
+        slot.spectrumBuffer = FrameBufferPool::instance().acquire(spectrumSize, numaNode);
+        if (!slot.waveformBuffer || !slot.spectrumBuffer){
+            qCritical() << i+1 << "allocate_buffer fail.";
+            mValid = false;
+        }
+
+        if (slot.waveformBuffer)
+            slot.waveform = slot.waveformBuffer->toByteArray();
+        if (slot.spectrumBuffer)
+            slot.spectrum = slot.spectrumBuffer->toByteArray();
+        mFree.enqueue(i);
+    }
+
+    mMinFree.store(mFree.size());
+}
+
+CaptureFrameSlot* CaptureFrameRing::acquire(int timeoutMs)
+{
+    QMutexLocker locker(&mMutex);
+    QDeadlineTimer deadline(timeoutMs < 0 ? QDeadlineTimer::Forever : QDeadlineTimer(timeoutMs));
+    while (mFree.isEmpty()){
+        if (!mNotEmpty.wait(&mMutex, deadline))
+            break;
+    }
+    if (mFree.isEmpty())
+        return nullptr;
+
+    CaptureFrameSlot* slot = &mSlots[mFree.dequeue()];
+    if (mFree.size() < mMinFree.load())
+        mMinFree.store(mFree.size());
+
+    return slot;
+}
+
+void CaptureFrameRing::release(CaptureFrameSlot* slot)
+{
+    if (!slot)
+        return;
+
+    QMutexLocker locker(&mMutex);
+    mFree.enqueue(slot->index);
+    mNotEmpty.wakeOne();
+}
+
+int CaptureFrameRing::freeCount() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFree.size();
+}
+
+void CaptureFrameRing::resetStatistics()
+{
+    QMutexLocker locker(&mMutex);
+    mMinFree.store(mFree.size());
+}
+
+/**
+ * ShotStreamWriter 流式写盘====================================================
+*/
+ShotStreamWriter::ShotStreamWriter(int queueDepth, bool directIO)
+    : mFileWriter(queueDepth, directIO)
+{
+}
+
+ShotStreamWriter::~ShotStreamWriter()
+{
+    finishShot();
+}
+
+void ShotStreamWriter::setWriterOptions(int queueDepth, bool directIO)
+{
+    mFileWriter.setQueueDepth(queueDepth);
+    mFileWriter.setDirectIO(directIO);
+}
+
+void ShotStreamWriter::setZeroSuppression(bool enable, const ZeroSuppressOptions& options)
+{
+    QMutexLocker locker(&mMutex);
+    mZeroSuppress = enable;
+    mZeroSuppressOptions = options;
+}
+
+void ShotStreamWriter::setLosslessCompression(bool enable)
+{
+    QMutexLocker locker(&mMutex);
+    mLossless = enable;
+}
+
+void ShotStreamWriter::setContainerMode(bool enable)
+{
+    QMutexLocker locker(&mMutex);
+    mContainerMode = enable;
+}
+
+void ShotStreamWriter::setPlanarLayout(bool enable)
+{
+    QMutexLocker locker(&mMutex);
+    mPlanar = enable;
+}
+
+void ShotStreamWriter::setFrameWrittenCallback(FrameWrittenCallback callback)
+{
+    QMutexLocker locker(&mMutex);
+    mFrameWritten = callback;
+}
+
+void ShotStreamWriter::beginShot(const QString& saveFilePath, quint32 physicalNo, bool isDDR1, bool discard)
+{
+    QMutexLocker locker(&mMutex);
+    mSaveFilePath = saveFilePath;
+    mPhysicalNo = physicalNo;
+    mIsDDR1 = isDDR1;
+    mDiscard = discard;
+    mFirstFrameNo = 1;
+
+    mWrittenFrames.store(0);
+    mFailedFrames.store(0);
+    mWrittenBytes.store(0);
+    mSuppressedFrames.store(0);
+    mSuppressedBytes.store(0);
+    mFileWriter.resetStatistics();
+
+    if (mContainerMode && !discard){
+        QString containerPath = ShotContainer::containerPath(saveFilePath, physicalNo, isDDR1);
+        if (!mContainer.open(containerPath, physicalNo, isDDR1, mFileWriter.directIO(), QDateTime::currentMSecsSinceEpoch()))
+            qCritical() << "创建整炮容器失败：" << containerPath;
+    }
+}
+
+void ShotStreamWriter::setFirstFrameNo(quint32 firstFrameNo)
+{
+    QMutexLocker locker(&mMutex);
+    mFirstFrameNo = qMax(1u, firstFrameNo);
+}
+
+void ShotStreamWriter::push(const CaptureFrameHandle& frame)
+{
+    QString saveFilePath;
+    quint32 physicalNo, firstFrameNo;
+    bool isDDR1, discard, zeroSuppress, lossless, planar, container;
+    ZeroSuppressOptions zeroSuppressOptions;
+    FrameWrittenCallback frameWritten;
+    {
+        QMutexLocker locker(&mMutex);
+        saveFilePath = mSaveFilePath;
+        physicalNo = mPhysicalNo;
+        isDDR1 = mIsDDR1;
+        discard = mDiscard;
+        firstFrameNo = mFirstFrameNo;
+        zeroSuppress = mZeroSuppress;
+        zeroSuppressOptions = mZeroSuppressOptions;
+        lossless = mLossless;
+        planar = mPlanar;
+        container = mContainer.isOpen();
+        frameWritten = mFrameWritten;
+    }
+
+    if (discard || !frame->readOk || frame->frameNo < firstFrameNo)
+        return;
+
+    // 写盘任务持有帧句柄，波形和能谱两个文件都写完以后才会释放缓冲
+    QSharedPointer<std::atomic<int>> remaining = QSharedPointer<std::atomic<int>>::create(2);
+    QSharedPointer<std::atomic<bool>> failed = QSharedPointer<std::atomic<bool>>::create(false);
+    auto onWritten = [=](bool ok){
+        if (!ok)
+            failed->store(true);
+        if (--(*remaining) > 0)
+            return;
+
+        if (failed->load()){
+            mFailedFrames++;
+        }
+        else{
+            mWrittenFrames++;
+            mWrittenBytes += frame->waveformSize + frame->spectrumSize;
+        }
+        if (frameWritten)
+            frameWritten(frame->frameNo, !failed->load());
+    };
+
+    QChar side = isDDR1 ? 'A' : 'B';
+    quint32 fileNo = frame->frameNo - firstFrameNo + 1;
+    QString dataFileName = QString("%1/%2%3data%4.bin").arg(saveFilePath).arg(physicalNo).arg(side).arg(fileNo);
+    QString specFileName = QString("%1/%2%3spec%4.bin").arg(saveFilePath).arg(physicalNo).arg(side).arg(fileNo);
+
+    // 零压缩、无损压缩和分平面在写盘线程中转换，压缩没有意义时保存原始数据
+    std::function<QByteArray()> produce;
+    if (zeroSuppress && !ZeroSuppressor::keepRaw(frame->frameNo, frame->faults, zeroSuppressOptions)){
+        produce = [=](){
+            QByteArray data = ZeroSuppressor::encode(frame->waveformData(), frame->waveformSize, zeroSuppressOptions);
+            if (data.isEmpty())
+                return frame->waveform();
+
+            mSuppressedFrames++;
+            mSuppressedBytes += data.size();
+            return data;
+        };
+    }
+    else if (lossless){
+        dataFileName = WaveformCodec::encodedFileName(dataFileName);
+        produce = [=](){
+            QByteArray data = WaveformCodec::encode(frame->waveformData(), frame->waveformSize);
+            return data.isEmpty() ? frame->waveform() : data;
+        };
+    }
+    else if (planar){
+        produce = [=](){
+            QByteArray data = PlanarFrame::encode(frame->waveformData(), frame->waveformSize);
+            return data.isEmpty() ? frame->waveform() : data;
+        };
+    }
+
+    if (container){
+        // 整炮容器：帧内容与单帧文件相同，按原文件名可以从索引中找到
+        ShotContainer::IndexEntry waveformEntry = ShotContainer::makeEntry(ShotContainer::Waveform, fileNo, frame->frameNo, frame->captureUtcNs);
+        ShotContainer::IndexEntry spectrumEntry = ShotContainer::makeEntry(ShotContainer::Spectrum, fileNo, frame->frameNo, frame->captureUtcNs);
+        if (produce)
+            mFileWriter.submit(&mContainer, waveformEntry, produce, onWritten);
+        else
+            mFileWriter.submit(&mContainer, waveformEntry, frame->waveformData(), frame->waveformSize, onWritten);
+        mFileWriter.submit(&mContainer, spectrumEntry, frame->spectrumData(), frame->spectrumSize, onWritten);
+        return;
+    }
+
+    if (produce)
+        mFileWriter.submit(dataFileName, produce, onWritten);
+    else
+        mFileWriter.submit(dataFileName, frame->waveformData(), frame->waveformSize, onWritten);
+    mFileWriter.submit(specFileName, frame->spectrumData(), frame->spectrumSize, onWritten);
+}
+
+void ShotStreamWriter::finishShot()
+{
+    mFileWriter.waitForDone();
+    if (mContainer.isOpen())
+        mContainer.close();
+}
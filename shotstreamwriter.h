@@ -0,0 +1,121 @@
+﻿#ifndef SHOTSTREAMWRITER_H
+#define SHOTSTREAMWRITER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QVector>
+#include <QByteArray>
+#include <atomic>
+#include "shotfilewriter.h"
+#include "framebufferpool.h"
+#include "captureframe.h"
+#include "zerosuppressor.h"
+#include "waveformcodec.h"
+
+// 环形缓冲中的一个槽位：DDR波形数据 + RAM能谱数据
+struct CaptureFrameSlot {
+    int index = -1;         // 在环形缓冲中的序号
+    QByteArray waveform;    // fromRawData包装的锁页内存
+    QByteArray spectrum;
+    FrameBufferHandle waveformBuffer;// 缓冲池句柄，环析构时归还
+    FrameBufferHandle spectrumBuffer;
+};
+
+/**
+ * CaptureFrameRing 锁页帧缓冲环
+ * 采集线程从环中取空闲缓冲做DMA，DMA完成后包装成CaptureFrameHandle交给写盘和在线分析，
+ * 最后一个句柄释放时归还槽位。内存占用只与环大小有关，与采集时长无关。硬盘写入跟不上时acquire会阻塞，形成反压。
+ * 缓冲从FrameBufferPool按采集卡所在NUMA节点申请。
+ */
+class CaptureFrameRing
+{
+public:
+    explicit CaptureFrameRing(int capacity, quint32 waveformSize, quint32 spectrumSize, int numaNode = -1);
+
+    bool isValid() const { return mValid; }
+    int capacity() const { return mSlots.size(); }
+
+    /*取一个空闲缓冲，timeoutMs<0时一直等待，超时返回nullptr*/
+    CaptureFrameSlot* acquire(int timeoutMs = -1);
+    void release(CaptureFrameSlot* slot);
+
+    int freeCount() const;
+    int minFreeCount() const { return mMinFree.load(); }// 空闲缓冲的历史最低值，用于判断硬盘是否跟得上
+    void resetStatistics();
+
+private:
+    QVector<CaptureFrameSlot> mSlots;
+    QQueue<int> mFree;
+    mutable QMutex mMutex;
+    QWaitCondition mNotEmpty;
+    std::atomic<int> mMinFree{0};
+    bool mValid = false;
+};
+
+/**
+ * ShotStreamWriter 流式写盘
+ * 采集过程中实时把DMA完成的帧写成 %1%2data%3.bin / %1%2spec%3.bin，
+ * 交给ShotFileWriter并发直接I/O写入，写盘期间持有帧句柄，一帧的两个文件都写完后释放
+ */
+class ShotStreamWriter
+{
+public:
+    typedef std::function<void(quint32 frameNo, bool ok)> FrameWrittenCallback;
+
+    explicit ShotStreamWriter(int queueDepth = 4, bool directIO = false);
+    ~ShotStreamWriter();
+
+    void setWriterOptions(int queueDepth, bool directIO);
+    /*零压缩保存：波形文件在写盘线程中压缩后写入，keepRaw的帧仍写原始数据*/
+    void setZeroSuppression(bool enable, const ZeroSuppressOptions& options);
+    /*无损压缩保存：不做零压缩的波形帧写成%1%2data%3.nbin*/
+    void setLosslessCompression(bool enable);
+    /*整炮容器保存：一炮的帧都写入%1%2shot.nsc，beginShot时创建，finishShot时写索引*/
+    void setContainerMode(bool enable);
+    /*通道分平面保存：没有零压缩/无损压缩的波形帧转成PlanarFrame格式写入*/
+    void setPlanarLayout(bool enable);
+    /*一帧的两个文件都写完时回调，在写盘线程中执行*/
+    void setFrameWrittenCallback(FrameWrittenCallback callback);
+
+    /*开始新的一炮，discard=true时只归还缓冲不写盘（测试模式）*/
+    void beginShot(const QString& saveFilePath, quint32 physicalNo, bool isDDR1, bool discard);
+    /*文件序号从firstFrameNo对应的帧开始编为1，包序号更小的帧不写（预触发只保存最后一段）*/
+    void setFirstFrameNo(quint32 firstFrameNo);
+    /*提交一帧（DMA已完成），可以在任意线程调用*/
+    void push(const CaptureFrameHandle& frame);
+    /*等待所有已提交的帧写完*/
+    void finishShot();
+
+    quint32 writtenFrames() const { return mWrittenFrames.load(); }
+    quint32 failedFrames() const { return mFailedFrames.load(); }
+    qint64 writtenBytes() const { return mWrittenBytes.load(); }
+    QString diskStatisticsText() const { return mFileWriter.statisticsText(); }
+    quint32 suppressedFrames() const { return mSuppressedFrames.load(); }
+    qint64 suppressedBytes() const { return mSuppressedBytes.load(); }// 零压缩后的波形字节数
+
+private:
+    ShotFileWriter mFileWriter;
+    QString mSaveFilePath;
+    quint32 mPhysicalNo = 1;
+    bool mIsDDR1 = true;
+    bool mDiscard = false;
+    quint32 mFirstFrameNo = 1;
+    bool mZeroSuppress = false;
+    ZeroSuppressOptions mZeroSuppressOptions;
+    bool mLossless = false;
+    bool mContainerMode = false;
+    bool mPlanar = false;
+    ShotContainerWriter mContainer;
+    FrameWrittenCallback mFrameWritten;
+    QMutex mMutex;
+
+    std::atomic<quint32> mWrittenFrames{0};
+    std::atomic<quint32> mFailedFrames{0};
+    std::atomic<qint64> mWrittenBytes{0};
+    std::atomic<quint32> mSuppressedFrames{0};
+    std::atomic<qint64> mSuppressedBytes{0};
+};
+
+#endif // SHOTSTREAMWRITER_H
@@ -0,0 +1,128 @@
+﻿#include "threadscheduler.h"
+#include <QFile>
+#include <QStringList>
+#include <QThread>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#endif
+
+bool ThreadScheduler::applyToCurrentThread(int cpu, Policy policy, int priority, QString* error)
+{
+    QStringList errors;
+#ifdef _WIN32
+    if (cpu >= 0 && cpu < 64){
+        if (SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1ULL << cpu)) == 0)
+            errors << QStringLiteral("SetThreadAffinityMask失败，错误码：%1").arg(GetLastError());
+    }
+
+    // Windows没有FIFO/RR之分，统一使用最高的非实时进程优先级
+    Q_UNUSED(priority)
+    if (policy != Normal && !SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL))
+        errors << QStringLiteral("SetThreadPriority失败，错误码：%1").arg(GetLastError());
+#else
+    if (cpu >= 0 && cpu < CPU_SETSIZE){
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(cpu, &mask);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask);
+        if (ret != 0)
+            errors << QStringLiteral("绑定CPU%1失败：%2").arg(cpu).arg(QString::fromLocal8Bit(strerror(ret)));
+    }
+
+    sched_param param;
+    memset(&param, 0, sizeof(param));
+    int nativePolicy = SCHED_OTHER;
+    if (policy != Normal){
+        nativePolicy = (policy == Fifo) ? SCHED_FIFO : SCHED_RR;
+        param.sched_priority = qBound(sched_get_priority_min(nativePolicy), priority, sched_get_priority_max(nativePolicy));
+    }
+    int ret = pthread_setschedparam(pthread_self(), nativePolicy, &param);
+    if (ret != 0)
+        errors << QStringLiteral("设置%1失败：%2").arg(policyName(policy)).arg(QString::fromLocal8Bit(strerror(ret)));
+#endif
+
+    if (error)
+        *error = errors.join(QStringLiteral("，"));
+    return errors.isEmpty();
+}
+
+QList<int> ThreadScheduler::parseCpuList(const QString& text)
+{
+    QList<int> cpus;
+    for (const QString& part : text.split(',', Qt::SkipEmptyParts)){
+        QStringList range = part.trimmed().split('-');
+        bool ok1 = false, ok2 = false;
+        int first = range.value(0).toInt(&ok1);
+        int last = range.size() > 1 ? range.value(1).toInt(&ok2) : first;
+        if (!ok1 || (range.size() > 1 && !ok2) || first < 0 || last < first)
+            continue;
+
+        for (int cpu = first; cpu <= last; ++cpu){
+            if (!cpus.contains(cpu))
+                cpus.append(cpu);
+        }
+    }
+    return cpus;
+}
+
+QList<int> ThreadScheduler::isolatedCpus()
+{
+#ifdef _WIN32
+    return QList<int>();
+#else
+    QFile file(QStringLiteral("/sys/devices/system/cpu/isolated"));
+    if (!file.open(QIODevice::ReadOnly))
+        return QList<int>();
+    return parseCpuList(QString::fromLatin1(file.readAll()).trimmed());
+#endif
+}
+
+QList<int> ThreadScheduler::defaultCpus()
+{
+    QList<int> cpus = isolatedCpus();
+    if (!cpus.isEmpty())
+        return cpus;
+
+    // CPU0留给系统中断和界面
+    for (int cpu = 1; cpu < QThread::idealThreadCount(); ++cpu)
+        cpus.append(cpu);
+    if (cpus.isEmpty())
+        cpus.append(0);
+    return cpus;
+}
+
+QString ThreadScheduler::policyName(Policy policy)
+{
+    switch (policy) {
+    case Fifo: return QStringLiteral("SCHED_FIFO");
+    case RoundRobin: return QStringLiteral("SCHED_RR");
+    default: return QStringLiteral("系统默认");
+    }
+}
+
+qint64 ThreadScheduler::currentThreadCpuTimeUs()
+{
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+        return 0;
+
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernelTime.dwLowDateTime;
+    kernel.HighPart = kernelTime.dwHighDateTime;
+    user.LowPart = userTime.dwLowDateTime;
+    user.HighPart = userTime.dwHighDateTime;
+    return (kernel.QuadPart + user.QuadPart) / 10;// 100ns为单位
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
@@ -0,0 +1,40 @@
+﻿#ifndef THREADSCHEDULER_H
+#define THREADSCHEDULER_H
+
+#include <QtGlobal>
+#include <QString>
+#include <QList>
+
+/**
+ * ThreadScheduler 采集线程调度策略
+ * 把当前线程绑定到指定CPU核心并设置调度策略：
+ *   Linux：pthread_setaffinity_np + SCHED_FIFO/SCHED_RR（需要root或CAP_SYS_NICE），优先使用isolcpus隔离的核心；
+ *   Windows：SetThreadAffinityMask + THREAD_PRIORITY_TIME_CRITICAL。
+ * 只作用于调用线程，必须在目标线程内部调用。
+ */
+class ThreadScheduler
+{
+public:
+    enum Policy {
+        Normal = 0,     // 系统默认
+        Fifo,           // SCHED_FIFO
+        RoundRobin      // SCHED_RR
+    };
+
+    /*cpu<0时不绑定核心，失败时error返回原因*/
+    static bool applyToCurrentThread(int cpu, Policy policy, int priority, QString* error = nullptr);
+
+    /*解析"2-5,8"形式的CPU列表*/
+    static QList<int> parseCpuList(const QString& text);
+    /*内核参数isolcpus隔离的CPU，Windows返回空*/
+    static QList<int> isolatedCpus();
+    /*配置为空时使用的CPU：有隔离核心时用隔离核心，否则除CPU0以外的全部核心*/
+    static QList<int> defaultCpus();
+
+    static QString policyName(Policy policy);
+
+    /*当前线程占用的CPU时间（us）*/
+    static qint64 currentThreadCpuTimeUs();
+};
+
+#endif // THREADSCHEDULER_H
@@ -0,0 +1,309 @@
+﻿#include "waveformcodec.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    const char kMagic[8] = {'N','C','N','B','I','N','0','1'};
+    const qint64 kHeadBytes = 12;   // 帧头帧尾各12字节
+    const int kChannels = 3;
+    const int kGroup = 128;         // 位打包每组点数
+    const int kLanes = 8;           // 纵向排列的路数（128位寄存器中的16位元素个数）
+
+    // 原始帧为每6个采样一组：ch0 ch0 ch1 ch1 ch2 ch2，与readBin3Ch_fast的解交织一致
+    inline qint64 sampleIndex(int ch, qint64 j)
+    {
+        return (j >> 1) * 6 + ch * 2 + (j & 1);
+    }
+
+    inline quint16 zigzag(quint16 delta)
+    {
+        qint16 d = (qint16)delta;
+        return quint16((d << 1) ^ (d >> 15));
+    }
+
+    inline quint16 unzigzag(quint16 z)
+    {
+        return quint16((z >> 1) ^ (0u - (z & 1u)));
+    }
+
+    int bitWidth(const quint16* in)
+    {
+        quint16 acc = 0;
+        for (int i = 0; i < kGroup; ++i)
+            acc |= in[i];
+
+        int bits = 0;
+        while (acc){
+            ++bits;
+            acc >>= 1;
+        }
+        return bits;
+    }
+
+    // 128个值打包成bits个128位字，第k个值放在第k%8路的第k/8个位置
+    void pack128(const quint16* in, int bits, quint16* out)
+    {
+        if (bits == 0)
+            return;
+
+        quint16 acc[kLanes] = {0};
+        int shift = 0;
+        for (int k = 0; k < kGroup / kLanes; ++k){
+            const quint16* v = in + k * kLanes;
+            for (int lane = 0; lane < kLanes; ++lane)
+                acc[lane] |= quint16(v[lane] << shift);
+
+            shift += bits;
+            if (shift >= 16){
+                shift -= 16;
+                for (int lane = 0; lane < kLanes; ++lane)
+                    out[lane] = acc[lane];
+                out += kLanes;
+                for (int lane = 0; lane < kLanes; ++lane)
+                    acc[lane] = shift ? quint16(v[lane] >> (bits - shift)) : 0;
+            }
+        }
+    }
+
+    void unpack128(const quint16* in, int bits, quint16* out)
+    {
+        if (bits == 0){
+            std::fill(out, out + kGroup, 0);
+            return;
+        }
+
+        const quint16 mask = quint16((1u << bits) - 1);
+        int shift = 0;
+        for (int k = 0; k < kGroup / kLanes; ++k){
+            quint16* o = out + k * kLanes;
+            if (shift + bits <= 16){
+                for (int lane = 0; lane < kLanes; ++lane)
+                    o[lane] = quint16(in[lane] >> shift) & mask;
+            }
+            else{
+                for (int lane = 0; lane < kLanes; ++lane)
+                    o[lane] = quint16((in[lane] >> shift) | (in[kLanes + lane] << (16 - shift))) & mask;
+            }
+
+            shift += bits;
+            if (shift >= 16){
+                shift -= 16;
+                in += kLanes;
+            }
+        }
+    }
+
+    bool readHeader(const QByteArray& fileData, WaveformCodec::NbinHeader& header)
+    {
+        if (fileData.size() < (int)sizeof(WaveformCodec::NbinHeader))
+            return false;
+
+        std::memcpy(&header, fileData.constData(), sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+            return false;
+        if (header.channels != kChannels || header.groupSamples != kGroup || header.flags != 0)
+            return false;
+        if (header.blockSamples == 0 || header.blockSamples % kGroup != 0 || header.samplesPerChannel % 2 != 0)
+            return false;
+        if (header.blockCount != (header.samplesPerChannel + header.blockSamples - 1) / header.blockSamples)
+            return false;
+        if (header.rawSize != header.headBytes + header.tailBytes + header.samplesPerChannel * kChannels * 2)
+            return false;
+
+        qint64 tableEnd = sizeof(header) + header.headBytes + header.tailBytes + (qint64(header.blockCount) + 1) * 8;
+        return tableEnd <= fileData.size();
+    }
+}
+
+QByteArray WaveformCodec::encode(const char* frame, qint64 size, int blockSamples)
+{
+    const qint64 payloadBytes = size - 2 * kHeadBytes;
+    if (!frame || payloadBytes <= 0 || payloadBytes % 12 != 0)
+        return QByteArray();
+
+    const quint16* src = reinterpret_cast<const quint16*>(frame + kHeadBytes);
+    const qint64 samples = payloadBytes / 2 / kChannels;
+    const qint64 block = qMax<qint64>(kGroup, blockSamples / kGroup * kGroup);
+    const qint64 blockCount = (samples + block - 1) / block;
+    const qint64 maxGroups = (block + kGroup - 1) / kGroup;
+
+    // 按最坏情况（每点16位）分配，编码完再截断
+    const qint64 tableOffset = sizeof(NbinHeader) + 2 * kHeadBytes;
+    const qint64 dataOffset = tableOffset + (blockCount + 1) * 8;
+    QByteArray out(dataOffset + blockCount * kChannels * (2 + maxGroups + maxGroups * kGroup * 2), Qt::Uninitialized);
+
+    NbinHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.flags = 0;
+    header.channels = kChannels;
+    header.headBytes = kHeadBytes;
+    header.tailBytes = kHeadBytes;
+    header.groupSamples = kGroup;
+    header.blockSamples = quint32(block);
+    header.blockCount = quint32(blockCount);
+    header.samplesPerChannel = quint64(samples);
+    header.rawSize = quint64(size);
+    char* base = out.data();
+    std::memcpy(base, &header, sizeof(header));
+    std::memcpy(base + sizeof(header), frame, kHeadBytes);
+    std::memcpy(base + sizeof(header) + kHeadBytes, frame + size - kHeadBytes, kHeadBytes);
+
+    QVector<quint16> samplesOfChannel(block);
+    QVector<quint16> zz(maxGroups * kGroup);
+    char* p = base + dataOffset;
+    for (qint64 b = 0; b < blockCount; ++b){
+        quint64 offset = p - base;
+        std::memcpy(base + tableOffset + b * 8, &offset, 8);
+
+        const qint64 begin = b * block;
+        const qint64 count = qMin(block, samples - begin);
+        const qint64 groups = (count + kGroup - 1) / kGroup;
+        for (int ch = 0; ch < kChannels; ++ch){
+            // 隔8点差分 + zig-zag，前8点与块首点做差，首点单独保存
+            quint16* x = samplesOfChannel.data();
+            const quint16* s = src + sampleIndex(ch, begin);
+            for (qint64 j = 0; j < count; j += 2, s += 6){
+                x[j] = s[0];
+                x[j + 1] = s[1];
+            }
+
+            const quint16 first = x[0];
+            std::memcpy(p, &first, 2);
+            p += 2;
+            const qint64 head = qMin<qint64>(kLanes, count);
+            for (qint64 j = 0; j < head; ++j)
+                zz[j] = zigzag(quint16(x[j] - first));
+            for (qint64 j = head; j < count; ++j)
+                zz[j] = zigzag(quint16(x[j] - x[j - kLanes]));
+            std::fill(zz.begin() + count, zz.begin() + groups * kGroup, 0);
+
+            quint8* widths = reinterpret_cast<quint8*>(p);
+            p += groups;
+            for (qint64 g = 0; g < groups; ++g){
+                int bits = bitWidth(zz.constData() + g * kGroup);
+                widths[g] = quint8(bits);
+                pack128(zz.constData() + g * kGroup, bits, reinterpret_cast<quint16*>(p));
+                p += bits * 16;
+            }
+        }
+    }
+    quint64 end = p - base;
+    std::memcpy(base + tableOffset + blockCount * 8, &end, 8);
+
+    // 没有压缩效果时保存原始数据
+    if ((qint64)end >= size)
+        return QByteArray();
+
+    out.resize(int(end));
+    return out;
+}
+
+bool WaveformCodec::isEncoded(const QByteArray& fileData)
+{
+    return fileData.size() >= (int)sizeof(NbinHeader) && std::memcmp(fileData.constData(), kMagic, sizeof(kMagic)) == 0;
+}
+
+bool WaveformCodec::decodeChannels(const QByteArray& fileData, QVector<quint16>& ch0, QVector<quint16>& ch1, QVector<quint16>& ch2)
+{
+    NbinHeader header;
+    if (!readHeader(fileData, header))
+        return false;
+
+    const char* base = fileData.constData();
+    const qint64 fileSize = fileData.size();
+    const qint64 tableOffset = sizeof(header) + header.headBytes + header.tailBytes;
+    const qint64 samples = header.samplesPerChannel;
+    const qint64 block = header.blockSamples;
+
+    QVector<quint16>* chs[kChannels] = {&ch0, &ch1, &ch2};
+    for (int ch = 0; ch < kChannels; ++ch)
+        chs[ch]->resize(samples);
+
+    quint16 zz[kGroup];
+    for (qint64 b = 0; b < header.blockCount; ++b){
+        quint64 offset, end;
+        std::memcpy(&offset, base + tableOffset + b * 8, 8);
+        std::memcpy(&end, base + tableOffset + (b + 1) * 8, 8);
+        if (offset > end || (qint64)end > fileSize)
+            return false;
+
+        const char* p = base + offset;
+        const char* pend = base + end;
+        const qint64 begin = b * block;
+        const qint64 count = qMin(block, samples - begin);
+        const qint64 groups = (count + kGroup - 1) / kGroup;
+        for (int ch = 0; ch < kChannels; ++ch){
+            if (p + 2 + groups > pend)
+                return false;
+
+            quint16* dst = chs[ch]->data() + begin;
+            quint16 first;
+            std::memcpy(&first, p, 2);
+            p += 2;
+            quint16 x[kLanes];
+            std::fill(x, x + kLanes, first);
+            const quint8* widths = reinterpret_cast<const quint8*>(p);
+            p += groups;
+            for (qint64 g = 0; g < groups; ++g){
+                const int bits = widths[g];
+                if (bits > 16 || p + bits * 16 > pend)
+                    return false;
+
+                unpack128(reinterpret_cast<const quint16*>(p), bits, zz);
+                p += bits * 16;
+
+                // 反zig-zag + 隔8点前缀和，8路互不相关
+                quint16* o = dst + g * kGroup;
+                const int n = int(qMin<qint64>(kGroup, count - g * kGroup));
+                if (n == kGroup){
+                    for (int k = 0; k < kGroup; k += kLanes){
+                        for (int lane = 0; lane < kLanes; ++lane){
+                            x[lane] = quint16(x[lane] + unzigzag(zz[k + lane]));
+                            o[k + lane] = x[lane];
+                        }
+                    }
+                }
+                else{
+                    for (int i = 0; i < n; ++i){
+                        x[i % kLanes] = quint16(x[i % kLanes] + unzigzag(zz[i]));
+                        o[i] = x[i % kLanes];
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+QByteArray WaveformCodec::decode(const QByteArray& fileData)
+{
+    NbinHeader header;
+    if (!readHeader(fileData, header))
+        return QByteArray();
+
+    QVector<quint16> ch[kChannels];
+    if (!decodeChannels(fileData, ch[0], ch[1], ch[2]))
+        return QByteArray();
+
+    QByteArray raw(int(header.rawSize), Qt::Uninitialized);
+    const char* head = fileData.constData() + sizeof(header);
+    std::memcpy(raw.data(), head, header.headBytes);
+    std::memcpy(raw.data() + raw.size() - header.tailBytes, head + header.headBytes, header.tailBytes);
+
+    quint16* dst = reinterpret_cast<quint16*>(raw.data() + header.headBytes);
+    const qint64 samples = header.samplesPerChannel;
+    for (int c = 0; c < kChannels; ++c){
+        const quint16* src = ch[c].constData();
+        for (qint64 j = 0; j < samples; ++j)
+            dst[sampleIndex(c, j)] = src[j];
+    }
+    return raw;
+}
+
+QString WaveformCodec::encodedFileName(const QString& binFileName)
+{
+    if (binFileName.endsWith(".bin", Qt::CaseInsensitive))
+        return binFileName.left(binFileName.size() - 4) + ".nbin";
+    return binFileName + ".nbin";
+}
@@ -0,0 +1,54 @@
+﻿#ifndef WAVEFORMCODEC_H
+#define WAVEFORMCODEC_H
+
+#include <QtGlobal>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+/**
+ * WaveformCodec 波形无损压缩（.nbin）
+ * 原始波形帧相邻采样变化很小，按通道解交织后隔8点差分、zig-zag，再按128点一组位打包，
+ * 每组的位宽取组内最大值。位打包采用8路16位纵向排列（第k个值放在第k%8路），
+ * 隔8点差分使前缀和也按8路独立进行，解包和还原的内层循环都是8路相同操作，编译器可以直接向量化。
+ *
+ * 文件格式（小端），文件名 %1%2data%3.nbin：
+ *   NbinHeader
+ *   原始帧头 headBytes 字节 + 帧尾 tailBytes 字节
+ *   块偏移表：blockCount+1 个 quint64（相对文件开头），块可以单独解码
+ *   数据块：每块每通道 blockSamples 点，通道0~2依次为
+ *           quint16 首点 + 每组位宽 quint8[组数] + 每组 位宽*16 字节
+ *
+ * 解码结果与原始帧逐字节相同。DataAnalysisWorker::readBin3Ch_fast在.bin不存在时读取同名.nbin并自动解码。
+ */
+class WaveformCodec
+{
+public:
+#pragma pack(push, 1)
+    struct NbinHeader {
+        char magic[8];              // "NCNBIN01"
+        quint32 flags;              // 保留（熵编码等），当前为0
+        quint16 channels;           // 3
+        quint16 headBytes;          // 12
+        quint16 tailBytes;          // 12
+        quint16 groupSamples;       // 128
+        quint32 blockSamples;       // 每块每通道点数
+        quint32 blockCount;
+        quint64 samplesPerChannel;
+        quint64 rawSize;            // 原始帧字节数
+    };
+#pragma pack(pop)
+
+    /*压缩一帧波形，帧格式不符合时返回空，调用者应保存原始数据*/
+    static QByteArray encode(const char* frame, qint64 size, int blockSamples = 65536);
+    /*是否为.nbin压缩数据*/
+    static bool isEncoded(const QByteArray& fileData);
+    /*解码成三个通道（与readBin3Ch_fast小端解交织结果相同），失败返回false*/
+    static bool decodeChannels(const QByteArray& fileData, QVector<quint16>& ch0, QVector<quint16>& ch1, QVector<quint16>& ch2);
+    /*还原成原始帧，失败返回空*/
+    static QByteArray decode(const QByteArray& fileData);
+    /*.bin数据文件对应的压缩文件名*/
+    static QString encodedFileName(const QString& binFileName);
+};
+
+#endif // WAVEFORMCODEC_H
@@ -0,0 +1,81 @@
+﻿#include "xdmabarmap.h"
+#include <QDebug>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#endif
+
+XdmaBarMap::~XdmaBarMap()
+{
+    unmap();
+}
+
+bool XdmaBarMap::map(const QString& path, qint64 size)
+{
+    unmap();
+#ifdef _WIN32
+    // Windows版xdma驱动不支持把BAR映射到用户态
+    Q_UNUSED(path);
+    Q_UNUSED(size);
+    return false;
+#else
+    int fd = ::open(path.toStdString().c_str(), O_RDWR | O_SYNC);
+    if (fd < 0)
+        return false;
+
+    void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    ::close(fd);// 映射建立以后不再需要文件描述符
+    if (base == MAP_FAILED){
+        qWarning().noquote() << "mmap" << path << "fail:" << QString::fromLocal8Bit(strerror(error));
+        return false;
+    }
+
+    mBase = static_cast<volatile char*>(base);
+    mSize = size;
+    return true;
+#endif
+}
+
+void XdmaBarMap::unmap()
+{
+#ifndef _WIN32
+    if (mBase)
+        ::munmap((void*)mBase, mSize);
+#endif
+    mBase = nullptr;
+    mSize = 0;
+}
+
+bool XdmaBarMap::contains(quint64 offset, qint64 size) const
+{
+    return mBase && size >= 0 && ((offset + size + 3) & ~quint64(3)) <= (quint64)mSize;
+}
+
+void XdmaBarMap::read(quint64 offset, char* data, qint64 size) const
+{
+    quint64 end = offset + size;
+    for (quint64 word = offset & ~quint64(3); word < end; word += 4){
+        quint32 value = load<quint32>(word);
+        quint64 from = qMax(word, offset);
+        quint64 to = qMin(word + 4, end);
+        memcpy(data + (from - offset), reinterpret_cast<const char*>(&value) + (from - word), to - from);
+    }
+}
+
+bool XdmaBarMap::write(quint64 offset, const char* data, qint64 size)
+{
+    if ((offset & 3) || (size & 3))
+        return false;
+
+    for (qint64 i = 0; i < size; i += 4){
+        quint32 value;
+        memcpy(&value, data + i, 4);
+        store<quint32>(offset + i, value);
+    }
+    return true;
+}
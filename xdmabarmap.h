@@ -0,0 +1,46 @@
+﻿#ifndef XDMABARMAP_H
+#define XDMABARMAP_H
+
+#include <QtGlobal>
+#include <QString>
+
+/**
+ * XdmaBarMap user/bypass BAR内存映射
+ * 把XDMA的user（寄存器）或bypass（能谱RAM）BAR映射到进程地址空间，之后读写寄存器是一次volatile访存，
+ * 不再经过ReadFile/pread系统调用。AXI-Lite从机不支持字节访问，所有访问都按32位对齐进行。
+ * Linux xdma驱动的 _user/_bypass 字符设备支持mmap；Windows驱动不提供BAR映射，map返回false，由调用者退回读写句柄。
+ */
+class XdmaBarMap
+{
+public:
+    XdmaBarMap() = default;
+    ~XdmaBarMap();
+    Q_DISABLE_COPY(XdmaBarMap)
+
+    /*映射设备文件的前size字节（size需要不超过BAR大小），失败时返回false*/
+    bool map(const QString& path, qint64 size);
+    void unmap();
+    bool isMapped() const { return mBase != nullptr; }
+    qint64 size() const { return mSize; }
+    /*[offset, offset+size)按32位对齐扩展后是否都在映射范围内*/
+    bool contains(quint64 offset, qint64 size) const;
+
+    /*类型化访问，offset需要按sizeof(T)对齐*/
+    template<typename T> T load(quint64 offset) const {
+        return *reinterpret_cast<const volatile T*>(mBase + offset);
+    }
+    template<typename T> void store(quint64 offset, T value) {
+        *reinterpret_cast<volatile T*>(mBase + offset) = value;
+    }
+
+    /*按32位读取任意范围（能谱块、单字节就绪寄存器）*/
+    void read(quint64 offset, char* data, qint64 size) const;
+    /*按32位写入，offset和size必须4字节对齐，否则返回false*/
+    bool write(quint64 offset, const char* data, qint64 size);
+
+private:
+    volatile char* mBase = nullptr;
+    qint64 mSize = 0;
+};
+
+#endif // XDMABARMAP_H
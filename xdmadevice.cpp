@@ -0,0 +1,816 @@
+﻿#include "xdmadevice.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QtEndian>
+#include <QThread>
+#include <cstring>
+
+#ifdef _WIN32
+#include <setupapi.h>
+#include <initguid.h>
+#include <devpkey.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#endif
+
+/**
+ * XdmaDevice ====================================================
+*/
+QString XdmaDevice::channelSuffix(Channel channel)
+{
+    switch (channel) {
+    case chUser:   return QStringLiteral(XDMA_FILE_USER);
+    case chBypass: return QStringLiteral(XDMA_FILE_BYPASS);
+    case chC2H0:   return QStringLiteral(XDMA_FILE_C2H_0);
+    case chC2H1:   return QStringLiteral(XDMA_FILE_C2H_1);
+    case chC2H2:   return QStringLiteral(XDMA_FILE_C2H_2);
+    case chC2H3:   return QStringLiteral(XDMA_FILE_C2H_3);
+    default:       return QString();
+    }
+}
+
+QString XdmaDevice::eventSuffix(quint8 index)
+{
+    switch (index) {
+    case 0:  return QStringLiteral(XDMA_FILE_EVENT_0);
+    case 1:  return QStringLiteral(XDMA_FILE_EVENT_1);
+    case 2:  return QStringLiteral(XDMA_FILE_EVENT_2);
+    case 3:  return QStringLiteral(XDMA_FILE_EVENT_3);
+    default: return QString();
+    }
+}
+
+void XdmaDevice::closeAll()
+{
+    for (int ch = 0; ch < chCount; ++ch)
+        closeChannel((Channel)ch);
+    for (int i = 0; i < XdmaRegDef::EVENT_COUNT; ++i)
+        closeEvent(i);
+}
+
+bool XdmaDevice::readRegister(quint64 offset, quint8& value)
+{
+    char buf = 0;
+    if (!read(chUser, offset, &buf, 1))
+        return false;
+
+    value = (quint8)buf;
+    return true;
+}
+
+bool XdmaDevice::readRegister(quint64 offset, quint32& value)
+{
+    char buf[4];
+    if (!read(chUser, offset, buf, 4))
+        return false;
+    value = qFromLittleEndian<quint32>(buf);
+    return true;
+}
+
+std::atomic<bool> XdmaDevice::sBarMappingEnabled{false};
+
+void XdmaDevice::setBarMappingEnabled(bool enable)
+{
+    sBarMappingEnabled.store(enable);
+}
+
+bool XdmaDevice::barMappingEnabled()
+{
+    return sBarMappingEnabled.load();
+}
+
+bool XdmaDevice::writeRegister(quint64 offset, quint32 value)
+{
+    // 小端对齐，和FPGA文档一致
+    char cmd[4];
+    qToLittleEndian(value, cmd);
+    return write(chUser, offset, cmd, 4);
+}
+
+bool XdmaDevice::fakeDeviceEnabled()
+{
+    return !qEnvironmentVariableIsEmpty("NEUTRON_FAKE_XDMA");
+}
+
+QStringList XdmaDevice::enumFakeDevices()
+{
+    QStringList lstDevices;
+    bool ok = false;
+    int boards = qEnvironmentVariableIntValue("NEUTRON_FAKE_XDMA_BOARDS", &ok);
+    if (!ok || boards <= 0)
+        boards = 3;
+
+    for (int i = 1; i <= qMin(boards, 3); ++i)
+        lstDevices.append(QStringLiteral("fakexdma%1").arg(i));
+    return lstDevices;
+}
+
+XdmaDevice* XdmaDevice::create(const QString& deviceName)
+{
+    if (deviceName.startsWith(QStringLiteral("fakexdma")))
+        return new XdmaFakeDevice(deviceName);
+
+    return new XdmaNativeDevice(deviceName);
+}
+
+/**
+ * XdmaNativeDevice ====================================================
+*/
+XdmaNativeDevice::XdmaNativeDevice(const QString& deviceName)
+    : XdmaDevice(deviceName)
+{
+    for (int ch = 0; ch < chCount; ++ch){
+#ifdef _WIN32
+        mHandles[ch] = INVALID_HANDLE_VALUE;
+#else
+        mHandles[ch] = -1;
+#endif
+    }
+
+    for (int i = 0; i < XdmaRegDef::EVENT_COUNT; ++i){
+#ifdef _WIN32
+        mEventHandles[i] = INVALID_HANDLE_VALUE;
+        mEventSignals[i] = NULL;
+#else
+        mEventHandles[i] = -1;
+#endif
+    }
+}
+
+XdmaNativeDevice::~XdmaNativeDevice()
+{
+    closeAll();
+}
+
+XdmaNativeDevice::NativeHandle XdmaNativeDevice::openHandle(Channel channel) const
+{
+    QString path = mDeviceName + channelSuffix(channel);
+#ifdef _WIN32
+    DWORD dwFlagsAndAttributes = FILE_ATTRIBUTE_NORMAL | FILE_SHARE_READ | FILE_SHARE_WRITE;
+    if (channel >= chC2H0)
+        dwFlagsAndAttributes |= FILE_FLAG_NO_BUFFERING;// 跳过内核缓存，直接读取
+
+    HANDLE fd = CreateFileA(path.toStdString().c_str(),
+                            GENERIC_READ | GENERIC_WRITE,
+                            0,
+                            NULL,
+                            OPEN_EXISTING,
+                            dwFlagsAndAttributes,
+                            NULL);
+    if (fd == INVALID_HANDLE_VALUE)
+        qCritical() << "open" << path << "fail, win32 error code:" << GetLastError();
+    return fd;
+#else
+    int fd = ::open(path.toStdString().c_str(), O_RDWR);
+    if (fd < 0)
+        qCritical() << "open" << path << "fail, errno:" << errno;
+    return fd;
+#endif
+}
+
+void XdmaNativeDevice::closeHandle(NativeHandle handle)
+{
+    if (!isValidHandle(handle))
+        return;
+#ifdef _WIN32
+    CloseHandle(handle);
+#else
+    ::close(handle);
+#endif
+}
+
+bool XdmaNativeDevice::isValidHandle(NativeHandle handle)
+{
+#ifdef _WIN32
+    return handle != INVALID_HANDLE_VALUE;
+#else
+    return handle >= 0;
+#endif
+}
+
+bool XdmaNativeDevice::preadHandle(NativeHandle fd, quint64 offset, char* data, qint64 size)
+{
+#ifdef _WIN32
+    // 同步句柄配合OVERLAPPED偏移即为定位读，多个线程共用同一句柄时不会互相改写文件指针；读不满时从剩余位置继续读，与Linux一致
+    qint64 done = 0;
+    while (done < size) {
+        OVERLAPPED overlapped = {0};
+        overlapped.Offset = (DWORD)((offset + done) & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)((offset + done) >> 32);
+        DWORD nNumberOfBytesRead = 0;
+        if (!ReadFile(fd, data + done, (DWORD)(size - done), &nNumberOfBytesRead, &overlapped)) {
+            qDebug() << "ReadFile fail, win32 error code:" << GetLastError();
+            return false;
+        }
+        if (nNumberOfBytesRead == 0) {
+            qDebug() << "ReadFile returned 0, offset:" << offset + done << "remaining:" << size - done;
+            return false;
+        }
+        done += nNumberOfBytesRead;
+    }
+    return true;
+#else
+    qint64 done = 0;
+    while (done < size) {
+        ssize_t rc = ::pread(fd, data + done, size - done, offset + done);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            qDebug() << "pread fail, errno:" << errno;
+            return false;
+        }
+        if (rc == 0) {
+            qDebug() << "pread returned 0, offset:" << offset + done << "remaining:" << size - done;
+            return false;
+        }
+        done += rc;
+    }
+    return true;
+#endif
+}
+
+bool XdmaNativeDevice::pwriteHandle(NativeHandle fd, quint64 offset, const char* data, qint64 size)
+{
+#ifdef _WIN32
+    qint64 done = 0;
+    while (done < size) {
+        OVERLAPPED overlapped = {0};
+        overlapped.Offset = (DWORD)((offset + done) & 0xFFFFFFFF);
+        overlapped.OffsetHigh = (DWORD)((offset + done) >> 32);
+        DWORD dwNumberOfBytesWritten = 0;
+        if (!WriteFile(fd, data + done, (DWORD)(size - done), &dwNumberOfBytesWritten, &overlapped)) {
+            qDebug() << "WriteFile fail, win32 error code:" << GetLastError();
+            return false;
+        }
+        if (dwNumberOfBytesWritten == 0) {
+            qDebug() << "WriteFile returned 0, offset:" << offset + done << "remaining:" << size - done;
+            return false;
+        }
+        done += dwNumberOfBytesWritten;
+    }
+    return true;
+#else
+    qint64 done = 0;
+    while (done < size) {
+        ssize_t rc = ::pwrite(fd, data + done, size - done, offset + done);
+        if (rc < 0) {
+            if (errno == EINTR)
+                continue;
+            qDebug() << "pwrite fail, errno:" << errno;
+            return false;
+        }
+        if (rc == 0) {
+            qDebug() << "pwrite returned 0, offset:" << offset + done << "remaining:" << size - done;
+            return false;
+        }
+        done += rc;
+    }
+    return true;
+#endif
+}
+
+bool XdmaNativeDevice::openChannel(Channel channel)
+{
+    if (isValidHandle(mHandles[channel]))
+        return true;
+
+    mHandles[channel] = openHandle(channel);
+    if (!isValidHandle(mHandles[channel]))
+        return false;
+
+    // 寄存器和能谱RAM所在的BAR映射到用户态，映射失败时继续使用句柄读写
+    if (channel <= chBypass && barMappingEnabled()){
+        qint64 size = (channel == chUser) ? XdmaRegDef::USER_BAR_MAP_SIZE : XdmaRegDef::BYPASS_BAR_MAP_SIZE;
+        if (mBarMaps[channel].map(mDeviceName + channelSuffix(channel), size))
+            qDebug().noquote() << mDeviceName + channelSuffix(channel) << "BAR已映射，大小：0x" + QString::number(size, 16);
+    }
+    return true;
+}
+
+void XdmaNativeDevice::closeChannel(Channel channel)
+{
+    if (channel <= chBypass)
+        mBarMaps[channel].unmap();
+    closeHandle(mHandles[channel]);
+#ifdef _WIN32
+    mHandles[channel] = INVALID_HANDLE_VALUE;
+#else
+    mHandles[channel] = -1;
+#endif
+}
+
+int XdmaNativeDevice::numaNode() const
+{
+#ifdef _WIN32
+    // 由设备接口路径找到设备实例，读取DEVPKEY_Device_Numa_Node
+    int node = -1;
+    HDEVINFO hDevInfo = SetupDiCreateDeviceInfoList(NULL, NULL);
+    if (hDevInfo == INVALID_HANDLE_VALUE)
+        return node;
+
+    SP_DEVICE_INTERFACE_DATA interfaceData;
+    interfaceData.cbSize = sizeof(SP_DEVICE_INTERFACE_DATA);
+    SP_DEVINFO_DATA devInfoData;
+    devInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
+    if (SetupDiOpenDeviceInterfaceA(hDevInfo, mDeviceName.toStdString().c_str(), 0, &interfaceData)
+        && SetupDiEnumDeviceInfo(hDevInfo, 0, &devInfoData)){// 打开接口时设备实例已加入集合
+        DEVPROPTYPE propType = 0;
+        ULONG value = 0;
+        if (SetupDiGetDevicePropertyW(hDevInfo, &devInfoData, &DEVPKEY_Device_Numa_Node, &propType, (PBYTE)&value, sizeof(value), NULL, 0)
+            && propType == DEVPROP_TYPE_UINT32){
+            node = (int)value;
+        }
+    }
+
+    SetupDiDestroyDeviceInfoList(hDevInfo);
+    return node;
+#else
+    // /dev/xdma0 -> /sys/class/xdma/xdma0_user/device/numa_node
+    QString name = QFileInfo(mDeviceName).fileName();
+    QFile file(QStringLiteral("/sys/class/xdma/%1%2/device/numa_node").arg(name).arg(XDMA_FILE_USER));
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+
+    bool ok = false;
+    int node = file.readAll().trimmed().toInt(&ok);
+    return ok ? node : -1;
+#endif
+}
+
+bool XdmaNativeDevice::isChannelOpen(Channel channel) const
+{
+    return isValidHandle(mHandles[channel]);
+}
+
+bool XdmaNativeDevice::isBarMapped(Channel channel) const
+{
+    return channel <= chBypass && mBarMaps[channel].isMapped();
+}
+
+bool XdmaNativeDevice::read(Channel channel, quint64 offset, char* data, qint64 size)
+{
+    if (channel <= chBypass && mBarMaps[channel].contains(offset, size)){
+        mBarMaps[channel].read(offset, data, size);
+        return true;
+    }
+
+    if (isValidHandle(mHandles[channel]))
+        return preadHandle(mHandles[channel], offset, data, size);
+
+    NativeHandle fd = openHandle(channel);
+    if (!isValidHandle(fd))
+        return false;
+
+    bool ret = preadHandle(fd, offset, data, size);
+    closeHandle(fd);
+    return ret;
+}
+
+bool XdmaNativeDevice::write(Channel channel, quint64 offset, const char* data, qint64 size)
+{
+    // 非4字节对齐的写入退回句柄
+    if (channel <= chBypass && mBarMaps[channel].contains(offset, size) && mBarMaps[channel].write(offset, data, size))
+        return true;
+
+    if (isValidHandle(mHandles[channel]))
+        return pwriteHandle(mHandles[channel], offset, data, size);
+
+    NativeHandle fd = openHandle(channel);
+    if (!isValidHandle(fd))
+        return false;
+
+    bool ret = pwriteHandle(fd, offset, data, size);
+    closeHandle(fd);
+    return ret;
+}
+
+bool XdmaNativeDevice::openEvent(quint8 index)
+{
+    if (index >= XdmaRegDef::EVENT_COUNT)
+        return false;
+    if (isValidHandle(mEventHandles[index]))
+        return true;
+
+    QString path = mDeviceName + eventSuffix(index);
+#ifdef _WIN32
+    // 事件文件用重叠方式打开，才能带超时等待
+    mEventHandles[index] = CreateFileA(path.toStdString().c_str(),
+                                       GENERIC_READ,
+                                       0,
+                                       NULL,
+                                       OPEN_EXISTING,
+                                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
+                                       NULL);
+    if (mEventHandles[index] == INVALID_HANDLE_VALUE){
+        qCritical() << "open" << path << "fail, win32 error code:" << GetLastError();
+        return false;
+    }
+    mEventSignals[index] = CreateEvent(nullptr, true, false, nullptr);
+#else
+    mEventHandles[index] = ::open(path.toStdString().c_str(), O_RDONLY);
+    if (mEventHandles[index] < 0){
+        qCritical() << "open" << path << "fail, errno:" << errno;
+        return false;
+    }
+#endif
+    return true;
+}
+
+void XdmaNativeDevice::closeEvent(quint8 index)
+{
+    if (index >= XdmaRegDef::EVENT_COUNT)
+        return;
+
+    closeHandle(mEventHandles[index]);
+#ifdef _WIN32
+    mEventHandles[index] = INVALID_HANDLE_VALUE;
+    if (mEventSignals[index]){
+        CloseHandle(mEventSignals[index]);
+        mEventSignals[index] = NULL;
+    }
+#else
+    mEventHandles[index] = -1;
+#endif
+}
+
+XdmaDevice::WaitResult XdmaNativeDevice::waitEvent(quint8 index, int timeoutMs)
+{
+    if (index >= XdmaRegDef::EVENT_COUNT || !isValidHandle(mEventHandles[index]))
+        return wrError;
+
+    quint32 eventCount = 0;
+#ifdef _WIN32
+    // 读事件文件会一直挂起直到中断到来
+    OVERLAPPED overlapped = {0};
+    overlapped.hEvent = mEventSignals[index];
+    ResetEvent(overlapped.hEvent);
+    DWORD nNumberOfBytesRead = 0;
+    if (!ReadFile(mEventHandles[index], &eventCount, sizeof(eventCount), &nNumberOfBytesRead, &overlapped)){
+        if (GetLastError() != ERROR_IO_PENDING){
+            qDebug() << "ReadFile event fail, win32 error code:" << GetLastError();
+            return wrError;
+        }
+
+        if (WaitForSingleObject(overlapped.hEvent, timeoutMs < 0 ? INFINITE : (DWORD)timeoutMs) != WAIT_OBJECT_0){
+            CancelIo(mEventHandles[index]);
+            GetOverlappedResult(mEventHandles[index], &overlapped, &nNumberOfBytesRead, true);
+            return wrTimeout;
+        }
+
+        if (!GetOverlappedResult(mEventHandles[index], &overlapped, &nNumberOfBytesRead, false)){
+            qDebug() << "GetOverlappedResult event fail, win32 error code:" << GetLastError();
+            return wrError;
+        }
+    }
+    return wrSignaled;
+#else
+    // xdma驱动的events文件支持poll，可读表示有未取走的中断
+    struct pollfd pfd;
+    pfd.fd = mEventHandles[index];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int rc = ::poll(&pfd, 1, timeoutMs);
+    if (rc == 0)
+        return wrTimeout;
+    if (rc < 0)
+        return errno == EINTR ? wrTimeout : wrError;
+
+    // 读取并清除中断计数
+    if (::read(mEventHandles[index], &eventCount, sizeof(eventCount)) != sizeof(eventCount)){
+        qDebug() << "read event fail, errno:" << errno;
+        return wrError;
+    }
+    return wrSignaled;
+#endif
+}
+
+/**
+ * XdmaFakeDevice ====================================================
+*/
+namespace {
+    const qint64 kFakeFramePeriodMs = 40;   // 与PACKET_TIMELENGTH一致
+    const int kFakeCachedFrames = 4;        // 每个DDR最多缓存的历史帧数
+    const qint64 kHardwareMaxFrames = 260;  // 板卡DDR最多存260帧，最后一帧就绪寄存器为0x18
+}
+
+struct XdmaFakeDevice::BoardState {
+    QMutex mutex;
+    QElapsedTimer timer;
+    bool running = false;
+    qint64 periodNs = kFakeFramePeriodMs * 1000000;
+    qint64 maxFrames = 0;// 0表示不限帧数
+    QString dataDir;
+    bool cacheLoaded = false;
+    QVector<QByteArray> waveformCache[2];// [0]DDR1 [1]DDR2
+    QVector<QByteArray> spectrumCache[2];
+
+    bool replay = false;            // 逐帧回放数据目录中的整炮文件，不缓存
+    qint64 replayFrames[2] = {0, 0};// 数据目录中从1开始连续的帧数
+    qint64 stuckFrame = 0;          // 故障注入：从该帧起就绪寄存器不再变化
+    QList<qint64> gapFrames;        // 故障注入：这些帧处丢失一帧，之后的数据序号整体后移
+
+    // 开始测量以来的节拍数，寄存器卡死后不再增加（需要持有mutex）
+    qint64 tick() const {
+        if (!running)
+            return 0;
+        qint64 k = timer.nsecsElapsed() / periodNs;
+        return (stuckFrame > 0 && k > stuckFrame) ? stuckFrame : k;
+    }
+
+    // 采集到的第frameNo帧实际对应的数据帧号（gapFrames构造后不再改变，不需要加锁）
+    qint64 dataFrameOf(qint64 frameNo) const {
+        qint64 dataNo = frameNo;
+        for (qint64 gap : gapFrames){
+            if (gap <= frameNo)
+                dataNo++;
+        }
+        return dataNo;
+    }
+};
+
+XdmaFakeDevice::XdmaFakeDevice(const QString& deviceName)
+    : XdmaDevice(deviceName)
+{
+    mPhysicalNo = qBound(1, deviceName.right(1).toInt(), 3);
+
+    static QMutex registryMutex;
+    static QMap<QString, QSharedPointer<BoardState>> registry;
+    QMutexLocker locker(&registryMutex);
+    mBoard = registry.value(deviceName);
+    if (mBoard.isNull()){
+        mBoard = QSharedPointer<BoardState>::create();
+        mBoard->dataDir = qEnvironmentVariable("NEUTRON_FAKE_XDMA");
+        mBoard->maxFrames = qEnvironmentVariableIntValue("NEUTRON_FAKE_XDMA_FRAMES");
+        mBoard->replay = qEnvironmentVariableIntValue("NEUTRON_FAKE_XDMA_REPLAY") != 0;
+        mBoard->stuckFrame = qEnvironmentVariableIntValue("NEUTRON_FAKE_XDMA_STUCK");
+
+        bool ok = false;
+        double speed = qEnvironmentVariable("NEUTRON_FAKE_XDMA_SPEED").toDouble(&ok);
+        if (ok && speed > 0)
+            mBoard->periodNs = qMax<qint64>(1000000, qint64(kFakeFramePeriodMs * 1000000 / speed));
+
+        for (const QString& gap : qEnvironmentVariable("NEUTRON_FAKE_XDMA_GAPS").split(',', Qt::SkipEmptyParts)){
+            qint64 frameNo = gap.trimmed().toLongLong(&ok);
+            if (ok && frameNo > 0)
+                mBoard->gapFrames.append(frameNo);
+        }
+        registry.insert(deviceName, mBoard);
+    }
+}
+
+qint64 XdmaFakeDevice::framePeriodNs() const
+{
+    return mBoard->periodNs;
+}
+
+bool XdmaFakeDevice::openChannel(Channel channel)
+{
+    mChannelOpened[channel] = true;
+    return true;
+}
+
+void XdmaFakeDevice::closeChannel(Channel channel)
+{
+    mChannelOpened[channel] = false;
+}
+
+bool XdmaFakeDevice::isChannelOpen(Channel channel) const
+{
+    return mChannelOpened[channel];
+}
+
+bool XdmaFakeDevice::openEvent(quint8 index)
+{
+    if (index >= XdmaRegDef::EVENT_COUNT)
+        return false;
+
+    mEventOpened[index] = true;
+    mEventTicks[index] = 0;
+    return true;
+}
+
+void XdmaFakeDevice::closeEvent(quint8 index)
+{
+    if (index < XdmaRegDef::EVENT_COUNT)
+        mEventOpened[index] = false;
+}
+
+// 就绪寄存器每变化一次产生一次中断，节拍从开始测量算起
+XdmaDevice::WaitResult XdmaFakeDevice::waitEvent(quint8 index, int timeoutMs)
+{
+    if (index >= XdmaRegDef::EVENT_COUNT || !mEventOpened[index])
+        return wrError;
+
+    QElapsedTimer waitTimer;
+    waitTimer.start();
+    while (true)
+    {
+        qint64 tick = 0;
+        qint64 remainMs = 1;
+        {
+            QMutexLocker locker(&mBoard->mutex);
+            if (mBoard->running){
+                qint64 elapsedNs = mBoard->timer.nsecsElapsed();
+                tick = mBoard->tick() + 1;
+                remainMs = qMax<qint64>(1, (mBoard->periodNs - elapsedNs % mBoard->periodNs) / 1000000);
+            }
+        }
+
+        if (tick > mEventTicks[index]){
+            mEventTicks[index] = tick;
+            return wrSignaled;
+        }
+
+        qint64 leftMs = timeoutMs < 0 ? remainMs : qMin<qint64>(remainMs, timeoutMs - waitTimer.elapsed());
+        if (leftMs <= 0)
+            return wrTimeout;
+        QThread::msleep(leftMs);
+    }
+}
+
+quint8 XdmaFakeDevice::currentReadyValue() const
+{
+    QMutexLocker locker(&mBoard->mutex);
+    if (!mBoard->running)
+        return 0x00;
+
+    qint64 k = mBoard->tick();
+    if (k == 0)
+        return XdmaRegDef::READY_STEP_VALUES[3];// 首个0x10表示数据准备中
+    if (mBoard->maxFrames > 0 && k > mBoard->maxFrames)
+        return 0x00;// 模拟停止测量
+    if (k == kHardwareMaxFrames && mBoard->maxFrames == kHardwareMaxFrames)
+        return XdmaRegDef::READY_STOP_VALUE;// DDR存满
+
+    return XdmaRegDef::READY_STEP_VALUES[(k - 1) % 4];
+}
+
+// 返回某个DDR区域最近一次就绪时对应的帧号（从1开始）
+qint64 XdmaFakeDevice::currentFrameOfStep(int step) const
+{
+    QMutexLocker locker(&mBoard->mutex);
+    qint64 k = mBoard->tick();
+    if (k < 1)
+        return step + 1;
+
+    qint64 frameNo = k - (((k - 1 - step) % 4) + 4) % 4;
+    if (frameNo < 1)
+        frameNo += 4;
+    return frameNo;
+}
+
+bool XdmaFakeDevice::read(Channel channel, quint64 offset, char* data, qint64 size)
+{
+    using namespace XdmaRegDef;
+    if (channel == chUser){
+        memset(data, 0, size);
+        if (offset == DDR1_READY_ADDR || offset == DDR2_READY_ADDR)
+            data[0] = (char)currentReadyValue();
+        return true;
+    }
+
+    {
+        // 首次读数据时加载历史文件
+        QMutexLocker locker(&mBoard->mutex);
+        if (!mBoard->cacheLoaded && mBoard->replay){
+            // 回放模式只统计帧数，读数据时再从文件读取
+            mBoard->cacheLoaded = true;
+            for (int side = 0; side < 2; ++side){
+                QChar sideName = side == 0 ? 'A' : 'B';
+                qint64 id = 1;
+                while (QFileInfo::exists(QString("%1/%2%3data%4.bin").arg(mBoard->dataDir).arg(mPhysicalNo).arg(sideName).arg(id)))
+                    id++;
+                mBoard->replayFrames[side] = id - 1;
+            }
+
+            qInfo().nospace() << "模拟采集卡[" << mPhysicalNo << "] 回放整炮数据：DDR1 " << mBoard->replayFrames[0]
+                              << "帧 DDR2 " << mBoard->replayFrames[1] << "帧"
+                              << " 周期(us)：" << mBoard->periodNs / 1000
+                              << " 寄存器卡死帧：" << mBoard->stuckFrame
+                              << " 丢帧位置：" << mBoard->gapFrames.size();
+        }
+        else if (!mBoard->cacheLoaded){
+            mBoard->cacheLoaded = true;
+            for (int side = 0; side < 2; ++side){
+                QChar sideName = side == 0 ? 'A' : 'B';
+                for (int id = 1; id <= kFakeCachedFrames; ++id){
+                    QFile waveformFile(QString("%1/%2%3data%4.bin").arg(mBoard->dataDir).arg(mPhysicalNo).arg(sideName).arg(id));
+                    if (waveformFile.open(QIODevice::ReadOnly))
+                        mBoard->waveformCache[side].append(waveformFile.readAll());
+                    QFile spectrumFile(QString("%1/%2%3spec%4.bin").arg(mBoard->dataDir).arg(mPhysicalNo).arg(sideName).arg(id));
+                    if (spectrumFile.open(QIODevice::ReadOnly))
+                        mBoard->spectrumCache[side].append(spectrumFile.readAll());
+                }
+            }
+
+            qInfo().nospace() << "模拟采集卡[" << mPhysicalNo << "] 加载历史数据："
+                              << mBoard->waveformCache[0].size() + mBoard->waveformCache[1].size() << "帧波形 "
+                              << mBoard->spectrumCache[0].size() + mBoard->spectrumCache[1].size() << "帧能谱";
+        }
+    }
+
+    if (channel == chBypass){
+        bool isDDR1 = offset < RAM2_BASE;
+        quint64 relative = offset - (isDDR1 ? RAM1_BASE : RAM2_BASE);
+        int step = int(relative / RAM_STEP_STRIDE) & 0x03;
+        fillSpectrumFrame(isDDR1, currentFrameOfStep(step), data, size);
+        return true;
+    }
+
+    bool isDDR1 = offset < DDR2_BASE;
+    quint64 relative = offset - (isDDR1 ? DDR1_BASE : DDR2_BASE);
+    int step = int(relative / DDR_STEP_STRIDE) & 0x03;
+    fillWaveformFrame(isDDR1, currentFrameOfStep(step), data, size, relative % DDR_STEP_STRIDE);
+    return true;
+}
+
+bool XdmaFakeDevice::write(Channel channel, quint64 offset, const char* data, qint64 size)
+{
+    if (channel != chUser || offset != XdmaRegDef::USER_CTRL_ADDR || size < 4)
+        return true;
+
+    quint32 cmd = qFromLittleEndian<quint32>(data);
+    QMutexLocker locker(&mBoard->mutex);
+    if (cmd == XdmaRegDef::CMD_START_MEASURE){
+        mBoard->running = true;
+        mBoard->timer.start();
+    }
+    else if (cmd == XdmaRegDef::CMD_RESET_DDR || cmd == XdmaRegDef::CMD_RESET_ADC){
+        mBoard->running = false;
+    }
+
+    return true;
+}
+
+// 波形帧：包头/包尾各12字节，按12字节反转后第7字节为帧序号
+void XdmaFakeDevice::fillWaveformFrame(bool isDDR1, qint64 frameNo, char* data, qint64 size, qint64 frameOffset)
+{
+    frameNo = mBoard->dataFrameOf(frameNo);
+    const QVector<QByteArray>& cache = mBoard->waveformCache[isDDR1 ? 0 : 1];
+    if (mBoard->replay){
+        readReplayFile(QStringLiteral("data"), isDDR1, frameNo, data, size, frameOffset);
+    }
+    else if (!cache.isEmpty()){
+        const QByteArray& src = cache.at((frameNo - 1) % cache.size());
+        qint64 copySize = qBound<qint64>(0, src.size() - frameOffset, size);
+        memcpy(data, src.constData() + frameOffset, copySize);
+        memset(data + copySize, 0, size - copySize);
+    }
+    else {
+        memset(data, 0, size);
+    }
+
+    const qint64 headPos = 12 - 1 - 7;
+    const qint64 tailPos = XdmaRegDef::DDR_FRAME_SIZE - 12 + headPos;
+    if (headPos >= frameOffset && headPos < frameOffset + size)
+        data[headPos - frameOffset] = (char)(frameNo & 0xFF);
+    if (tailPos >= frameOffset && tailPos < frameOffset + size)
+        data[tailPos - frameOffset] = (char)(frameNo & 0xFF);
+}
+
+// 能谱帧：包头16字节反转后以FFAB00D2开头，第4、5字节为能谱序号
+void XdmaFakeDevice::fillSpectrumFrame(bool isDDR1, qint64 frameNo, char* data, qint64 size)
+{
+    frameNo = mBoard->dataFrameOf(frameNo);
+    const QVector<QByteArray>& cache = mBoard->spectrumCache[isDDR1 ? 0 : 1];
+    if (mBoard->replay){
+        readReplayFile(QStringLiteral("spec"), isDDR1, frameNo, data, size, 0);
+    }
+    else if (!cache.isEmpty()){
+        const QByteArray& src = cache.at((frameNo - 1) % cache.size());
+        qint64 copySize = qMin<qint64>(src.size(), size);
+        memcpy(data, src.constData(), copySize);
+        memset(data + copySize, 0, size - copySize);
+    }
+    else {
+        memset(data, 0, size);
+    }
+
+    if (size >= 16){
+        data[15] = (char)0xFF;
+        data[14] = (char)0xAB;
+        data[13] = (char)0x00;
+        data[12] = (char)0xD2;
+        data[11] = (char)((frameNo >> 8) & 0xFF);
+        data[10] = (char)(frameNo & 0xFF);
+    }
+}
+
+// 回放模式：从数据目录读取整炮文件的对应区间，帧数用完后从第1帧循环
+void XdmaFakeDevice::readReplayFile(const QString& kind, bool isDDR1, qint64 frameNo, char* data, qint64 size, qint64 fileOffset)
+{
+    qint64 frames = mBoard->replayFrames[isDDR1 ? 0 : 1];
+    qint64 readSize = 0;
+    if (frames > 0){
+        qint64 id = (frameNo - 1) % frames + 1;
+        QFile file(QString("%1/%2%3%4%5.bin").arg(mBoard->dataDir).arg(mPhysicalNo).arg(isDDR1 ? 'A' : 'B').arg(kind).arg(id));
+        if (file.open(QIODevice::ReadOnly) && file.seek(fileOffset))
+            readSize = qMax<qint64>(0, file.read(data, size));
+    }
+
+    memset(data + readSize, 0, size - readSize);
+}
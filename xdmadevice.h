@@ -0,0 +1,309 @@
+﻿#ifndef XDMADEVICE_H
+#define XDMADEVICE_H
+
+#include <QObject>
+#include <QString>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QSharedPointer>
+#include <QVector>
+#include <atomic>
+#include "xdmabarmap.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#ifdef _WIN32
+#define	XDMA_FILE_USER		"\\user"
+#define	XDMA_FILE_CONTROL	"\\control"
+#define XDMA_FILE_BYPASS	"\\bypass"
+#define	XDMA_FILE_H2C_0		"\\h2c_0"
+#define	XDMA_FILE_H2C_1		"\\h2c_1"
+#define	XDMA_FILE_H2C_2		"\\h2c_2"
+#define	XDMA_FILE_H2C_3		"\\h2c_3"
+#define	XDMA_FILE_C2H		"\\c2h"
+#define	XDMA_FILE_C2H_0		"\\c2h_0"
+#define	XDMA_FILE_C2H_1		"\\c2h_1"
+#define	XDMA_FILE_C2H_2		"\\c2h_2"
+#define	XDMA_FILE_C2H_3		"\\c2h_3"
+#define	XDMA_FILE_EVENT_0	"\\event_0"
+#define	XDMA_FILE_EVENT_1	"\\event_1"
+#define	XDMA_FILE_EVENT_2	"\\event_2"
+#define	XDMA_FILE_EVENT_3	"\\event_3"
+#else
+#define	XDMA_FILE_USER		"_user"
+#define	XDMA_FILE_CONTROL	"_control"
+#define XDMA_FILE_BYPASS	"_bypass"
+#define	XDMA_FILE_H2C_0		"_h2c_0"
+#define	XDMA_FILE_H2C_1		"_h2c_1"
+#define	XDMA_FILE_H2C_2		"_h2c_2"
+#define	XDMA_FILE_H2C_3		"_h2c_3"
+#define	XDMA_FILE_C2H		"_c2h"
+#define	XDMA_FILE_C2H_0		"_c2h_0"
+#define	XDMA_FILE_C2H_1		"_c2h_1"
+#define	XDMA_FILE_C2H_2		"_c2h_2"
+#define	XDMA_FILE_C2H_3		"_c2h_3"
+#define	XDMA_FILE_EVENT_0	"_events_0"
+#define	XDMA_FILE_EVENT_1	"_events_1"
+#define	XDMA_FILE_EVENT_2	"_events_2"
+#define	XDMA_FILE_EVENT_3	"_events_3"
+#endif
+
+// 首先把所有硬件相关常量统一定义在PCIe底层头文件，不要散落在业务代码
+namespace XdmaRegDef {
+    // 寄存器映射定义，和FPGA文档一一对应
+    constexpr quint64 USER_CTRL_ADDR = 0x20000; // 寄存器地址
+    constexpr quint32 REG_CMD_BASE = 0x12340000; // 寄存器命令基值，命令为 0x1234 | 偏移(8位) | 参数(8位)
+
+    constexpr quint8 THRESHOLD_LOW_OFS = 0xF7;// 触发阈值低位
+    constexpr quint8 THRESHOLD_HIGH_OFS = 0xF8;// 触发阈值高位
+
+    constexpr quint8 CARD1_PSD_THRESHOLD_OFS = 0xF1;// 卡#1PSD阈值
+    constexpr quint8 CARD2_PSD_THRESHOLD_OFS = 0xF2;// 卡#2PSD阈值
+    constexpr quint8 CARD3_PSD_THRESHOLD_OFS = 0xF3;// 卡#3PSD阈值
+    constexpr quint8 CARD4_PSD_THRESHOLD_OFS = 0xF4;// 卡#4PSD阈值
+    constexpr quint8 CARD5_PSD_THRESHOLD_OFS = 0xF5;// 卡#5PSD阈值
+    constexpr quint8 CARD6_PSD_THRESHOLD_OFS = 0xF6;// 卡#6PSD阈值
+    constexpr quint8 MEASURE_TIME_OFS = 0xFA;// 测量时间 0x16-160ms 0x18-800ms 0x20-4000ms 0x30
+    constexpr quint8 MEASURE_TIME_VALUE = 0x30;
+
+    // 带参数的控制命令，如触发阈值低位 regCommand(0xF7, 0x34) = 0x1234F734（小端写入为 34 F7 34 12）
+    constexpr quint32 regCommand(quint8 ofs, quint8 value){
+        return REG_CMD_BASE | (quint32(ofs) << 8) | value;
+    }
+
+    // 操作延时配置，单位毫秒
+    constexpr int REG_OP_WAIT_MS = 10;  // 操作
+    constexpr int REG_CLEAR_WAIT_MS = 5;// 清零
+    constexpr int REG_RESET_WAIT_MS = 100;// 复位和测量时间配置命令的保持时间
+
+    // 数据就绪寄存器（user通道）
+    constexpr quint64 DDR1_READY_ADDR = 0x0;    // DDR1就绪寄存器
+    constexpr quint64 DDR2_READY_ADDR = 0x10000;// DDR2就绪寄存器
+
+    // 数据就绪用户中断事件号（usr_irq_req位，对应events_N）
+    constexpr quint8 DDR1_READY_EVENT = 0;
+    constexpr quint8 DDR2_READY_EVENT = 1;
+    constexpr int EVENT_COUNT = 4;
+
+    // 控制命令（小端写入USER_CTRL_ADDR）
+    constexpr quint32 CMD_CLEAR = 0x00000000;         // 清零握手
+    constexpr quint32 CMD_START_MEASURE = 0x1234E001; // 开始测量
+    constexpr quint32 CMD_EMPTY = 0x1234F001;         // 清空
+    constexpr quint32 CMD_RESET_DDR = 0x1234D001;     // 复位DDR
+    constexpr quint32 CMD_RESET_ADC = 0x1234D002;     // 复位数采
+
+    // DDR波形数据布局（c2h通道）
+    constexpr quint64 DDR1_BASE = 0x00000000;
+    constexpr quint64 DDR2_BASE = 0x40000000;
+    constexpr quint64 DDR_STEP_STRIDE = 0x07271400; // 每个就绪区域的步长
+    constexpr quint32 DDR_FRAME_SIZE = 0x07270E00;  // 每帧波形数据大小（120MB）
+
+    // 条带读取：一帧按4段分到c2h_0~3并行读取，每段起点按4KB对齐（缓冲页对齐，直接I/O和DMA描述符要求）
+    constexpr quint32 C2H_ENGINE_COUNT = 4;
+    constexpr quint32 C2H_STRIPE_ALIGN = 0x1000;
+    constexpr quint32 C2H_STRIPE_SIZE = (DDR_FRAME_SIZE / C2H_ENGINE_COUNT + C2H_STRIPE_ALIGN - 1) / C2H_STRIPE_ALIGN * C2H_STRIPE_ALIGN;
+
+    // RAM能谱数据布局（bypass通道）
+    constexpr quint64 RAM1_BASE = 0x00000;
+    constexpr quint64 RAM2_BASE = 0x40000;
+    constexpr quint64 RAM_STEP_STRIDE = 0xA000;
+    constexpr quint32 RAM_FRAME_SIZE = 0xA000;
+
+    // BAR内存映射范围：覆盖用到的最大偏移（user到控制寄存器，bypass到RAM2第4块区域）
+    constexpr qint64 USER_BAR_MAP_SIZE = USER_CTRL_ADDR + 0x1000;
+    constexpr qint64 BYPASS_BAR_MAP_SIZE = RAM2_BASE + 4 * RAM_STEP_STRIDE;
+
+    // 就绪寄存器依次出现的值，对应DDR四块区域（0x10首次出现表示准备中）
+    constexpr quint8 READY_STEP_VALUES[4] = {0x11, 0x12, 0x14, 0x10};
+    constexpr quint8 READY_STOP_VALUE = 0x18;
+
+    // 就绪寄存器值转换为DDR区域序号，无效值返回-1
+    inline int readyValueToStep(quint8 value){
+        switch (value) {
+        case 0x11: return 0;
+        case 0x12: return 1;
+        case 0x14: return 2;
+        case 0x10:
+        case 0x18: return 3;
+        default: return -1;
+        }
+    }
+}
+
+/**
+ * XdmaDevice XDMA设备访问层
+ * 把采集卡的 user/bypass/c2h_N 通道统一封装成按偏移读写的接口，屏蔽平台差异：
+ *   Windows：\\?\pci#...\user 等设备接口，CreateFile/ReadFile
+ *   Linux：/dev/xdmaN_user 等字符设备，pread/pwrite；user/bypass通道优先mmap BAR直接访存（XdmaBarMap）
+ * 另外提供一个基于文件的模拟设备，方便在没有采集卡的机器上跑通完整采集流程。
+ */
+class XdmaDevice
+{
+public:
+    enum Channel {
+        chUser = 0,
+        chBypass,
+        chC2H0,
+        chC2H1,
+        chC2H2,
+        chC2H3,
+        chCount
+    };
+
+    enum WaitResult {
+        wrSignaled = 0, // 中断到达
+        wrTimeout,      // 超时
+        wrError         // 设备不支持或读失败
+    };
+
+    explicit XdmaDevice(const QString& deviceName) : mDeviceName(deviceName) {}
+    virtual ~XdmaDevice() = default;
+
+    QString deviceName() const { return mDeviceName; }
+    virtual bool isFake() const { return false; }
+    /*采集卡所在的NUMA节点，未知时返回-1*/
+    virtual int numaNode() const { return -1; }
+    /*数据帧节拍（ns），模拟设备回放倍速时会缩短*/
+    virtual qint64 framePeriodNs() const { return 40 * 1000000LL; }
+
+    /*打开/关闭通道，打开后的通道句柄长期有效，直到closeChannel或closeAll*/
+    virtual bool openChannel(Channel channel) = 0;
+    virtual void closeChannel(Channel channel) = 0;
+    virtual bool isChannelOpen(Channel channel) const = 0;
+    void closeAll();
+
+    /*按偏移读写，未打开的通道会临时打开一次，读写完毕后立即关闭*/
+    virtual bool read(Channel channel, quint64 offset, char* data, qint64 size) = 0;
+    virtual bool write(Channel channel, quint64 offset, const char* data, qint64 size) = 0;
+
+    /*用户中断事件，打开后waitEvent阻塞等待中断；打开前已到达的中断会立即返回*/
+    virtual bool openEvent(quint8 index) = 0;
+    virtual void closeEvent(quint8 index) = 0;
+    virtual WaitResult waitEvent(quint8 index, int timeoutMs) = 0;
+
+    /*常用寄存器操作*/
+    bool readRegister(quint64 offset, quint8& value);
+    bool readRegister(quint64 offset, quint32& value);
+    bool writeRegister(quint64 offset, quint32 value);
+
+    /*user/bypass通道打开时是否映射BAR（全局设置，下次打开通道时生效），映射失败时自动使用读写句柄*/
+    static void setBarMappingEnabled(bool enable);
+    static bool barMappingEnabled();
+    /*通道当前是否通过BAR映射访问*/
+    virtual bool isBarMapped(Channel channel) const { Q_UNUSED(channel); return false; }
+
+    static Channel c2hChannel(quint8 index) { return Channel(chC2H0 + (index & 0x03)); }
+    static QString channelSuffix(Channel channel);
+    static QString eventSuffix(quint8 index);
+
+    /*根据设备名称创建设备（模拟设备名称以fakexdma开头）*/
+    static XdmaDevice* create(const QString& deviceName);
+
+    /*模拟设备：环境变量NEUTRON_FAKE_XDMA指定数据目录时启用*/
+    static bool fakeDeviceEnabled();
+    static QStringList enumFakeDevices();
+
+protected:
+    QString mDeviceName;
+    static std::atomic<bool> sBarMappingEnabled;
+};
+
+/**
+ * XdmaNativeDevice 真实采集卡
+ */
+class XdmaNativeDevice : public XdmaDevice
+{
+public:
+    explicit XdmaNativeDevice(const QString& deviceName);
+    ~XdmaNativeDevice();
+
+    int numaNode() const override;
+
+    bool openChannel(Channel channel) override;
+    void closeChannel(Channel channel) override;
+    bool isChannelOpen(Channel channel) const override;
+
+    bool read(Channel channel, quint64 offset, char* data, qint64 size) override;
+    bool write(Channel channel, quint64 offset, const char* data, qint64 size) override;
+
+    bool openEvent(quint8 index) override;
+    void closeEvent(quint8 index) override;
+    WaitResult waitEvent(quint8 index, int timeoutMs) override;
+
+    bool isBarMapped(Channel channel) const override;
+
+private:
+#ifdef _WIN32
+    typedef HANDLE NativeHandle;
+#else
+    typedef int NativeHandle;
+#endif
+    NativeHandle openHandle(Channel channel) const;
+    static void closeHandle(NativeHandle handle);
+    static bool isValidHandle(NativeHandle handle);
+    static bool preadHandle(NativeHandle handle, quint64 offset, char* data, qint64 size);
+    static bool pwriteHandle(NativeHandle handle, quint64 offset, const char* data, qint64 size);
+
+    NativeHandle mHandles[chCount];
+    XdmaBarMap mBarMaps[chBypass + 1];// user/bypass BAR映射，下标为通道
+    NativeHandle mEventHandles[XdmaRegDef::EVENT_COUNT];
+#ifdef _WIN32
+    HANDLE mEventSignals[XdmaRegDef::EVENT_COUNT];// 重叠读完成通知
+#endif
+};
+
+/**
+ * XdmaFakeDevice 模拟采集卡
+ * DDR/RAM内容来自数据目录中的历史文件（%1%2data%3.bin / %1%2spec%3.bin），
+ * 没有历史文件时自动生成带正确包序号的空帧；
+ * 收到开始测量指令后，按PACKET_TIMELENGTH节拍依次输出就绪寄存器值 0x10 -> 0x11 -> 0x12 -> 0x14 -> 0x10 ...，
+ * 每次寄存器值变化同时产生一次用户中断事件；
+ * 同一块卡的DDR1/DDR2共享一份板卡状态。
+ * 回放和故障注入通过环境变量配置，用于长时间浸泡测试和吞吐测试：
+ *   NEUTRON_FAKE_XDMA_FRAMES  采集多少帧后停止（寄存器回到0x00），为260时最后一帧寄存器值为0x18
+ *   NEUTRON_FAKE_XDMA_REPLAY  为1时逐帧读取数据目录中的整炮文件（按实际帧号，用完后循环），不再只缓存前4帧
+ *   NEUTRON_FAKE_XDMA_SPEED   回放倍速，节拍为PACKET_TIMELENGTH/倍速（最短1ms）
+ *   NEUTRON_FAKE_XDMA_STUCK   从该帧起就绪寄存器不再变化，也不再产生中断（寄存器卡死）
+ *   NEUTRON_FAKE_XDMA_GAPS    逗号分隔的帧号，在这些帧处丢失一帧，之后的包头/能谱序号整体后移
+ */
+class XdmaFakeDevice : public XdmaDevice
+{
+public:
+    explicit XdmaFakeDevice(const QString& deviceName);
+
+    bool isFake() const override { return true; }
+    qint64 framePeriodNs() const override;
+
+    bool openChannel(Channel channel) override;
+    void closeChannel(Channel channel) override;
+    bool isChannelOpen(Channel channel) const override;
+
+    bool read(Channel channel, quint64 offset, char* data, qint64 size) override;
+    bool write(Channel channel, quint64 offset, const char* data, qint64 size) override;
+
+    bool openEvent(quint8 index) override;
+    void closeEvent(quint8 index) override;
+    WaitResult waitEvent(quint8 index, int timeoutMs) override;
+
+    struct BoardState;
+
+private:
+    quint8 currentReadyValue() const;
+    qint64 currentFrameOfStep(int step) const;
+    void fillWaveformFrame(bool isDDR1, qint64 frameNo, char* data, qint64 size, qint64 frameOffset);
+    void fillSpectrumFrame(bool isDDR1, qint64 frameNo, char* data, qint64 size);
+    void readReplayFile(const QString& kind, bool isDDR1, qint64 frameNo, char* data, qint64 size, qint64 fileOffset);
+
+    quint8 mPhysicalNo = 1;
+    QSharedPointer<BoardState> mBoard;
+    bool mChannelOpened[chCount] = {false};
+    qint64 mEventTicks[XdmaRegDef::EVENT_COUNT] = {0};// 已经取走的中断节拍
+    bool mEventOpened[XdmaRegDef::EVENT_COUNT] = {false};
+};
+
+#endif // XDMADEVICE_H
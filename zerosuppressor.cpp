@@ -0,0 +1,268 @@
+﻿#include "zerosuppressor.h"
+#include "globalsettings.h"
+#include <QtEndian>
+#include <QVector>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+namespace {
+    const char kMagic[8] = {'N','C','Z','S','U','P','0','1'};
+    const qint64 kHeadBytes = 12;   // 帧头帧尾各12字节
+    const int kChannels = 3;
+
+    // 原始帧为每6个采样一组：ch0 ch0 ch1 ch1 ch2 ch2，与readBin3Ch_fast的解交织一致
+    inline qint64 sampleIndex(int ch, qint64 j)
+    {
+        return (j >> 1) * 6 + ch * 2 + (j & 1);
+    }
+
+    // [from, to)内抽样统计直方图，出现次数最多的值作为基线估计（与离线calculateBaseline一致）
+    // 每块调用一次，只清零和扫描出现过的取值范围，直方图用完后保持全零
+    quint16 estimateBaseline(const quint16* src, int ch, qint64 from, qint64 to)
+    {
+        thread_local std::array<int, 65536> hist;
+        int lo = 65535, hi = 0;
+        for (qint64 j = from; j < to; j += 8){
+            int v = qFromLittleEndian(src[sampleIndex(ch, j)]);
+            ++hist[v];
+            lo = qMin(lo, v);
+            hi = qMax(hi, v);
+        }
+
+        int maxCount = -1;
+        quint16 best = 0;
+        for (int i = lo; i <= hi; ++i){
+            if (hist[i] > maxCount){
+                maxCount = hist[i];
+                best = (quint16)i;
+            }
+            hist[i] = 0;
+        }
+        return best;
+    }
+}
+
+QByteArray ZeroSuppressor::encode(const char* frame, qint64 size, const ZeroSuppressOptions& options)
+{
+    const qint64 payloadBytes = size - 2 * kHeadBytes;
+    if (!frame || payloadBytes <= 0 || payloadBytes % 12 != 0)
+        return QByteArray();
+
+    const quint16* src = reinterpret_cast<const quint16*>(frame + kHeadBytes);
+    const qint64 samples = payloadBytes / 2 / kChannels;
+    const qint64 blockSamples = qMax(1024, options.blockSamples);
+    const qint64 blockCount = (samples + blockSamples - 1) / blockSamples;
+
+    QVector<ZsWindow> windows[kChannels];
+    QVector<ZsBlock> blocks[kChannels];
+    quint32 keptSamples[kChannels] = {0};
+    for (int ch = 0; ch < kChannels; ++ch){
+        auto at = [&](qint64 j){ return (int)qFromLittleEndian(src[sampleIndex(ch, j)]); };
+
+        // 每块单独估计基线，触发阈值跟随基线缓慢漂移，漂移不会掩盖或制造触发
+        QVector<int> blockBaselines(int(blockCount));
+        for (qint64 b = 0; b < blockCount; ++b)
+            blockBaselines[int(b)] = estimateBaseline(src, ch, b * blockSamples, qMin(samples, (b + 1) * blockSamples));
+
+        // 触发条件与离线一致：偶数点超过阈值，且前后隔点递增；找到后跳过一个波形长度
+        QVector<ZsWindow>& chWindows = windows[ch];
+        for (qint64 j = 4; j + 2 < samples; j += 2){
+            int v = at(j);
+            if (v <= blockBaselines[int(j / blockSamples)] + options.threshold
+                || at(j - 4) >= at(j - 2) || at(j - 2) >= v || v >= at(j + 2))
+                continue;
+
+            qint64 start = qMax<qint64>(0, j - options.prePoints);
+            qint64 end = qMin<qint64>(samples, j + WAVEFORM_LENGTH + options.postPoints);
+            if (!chWindows.isEmpty() && start <= (qint64)(chWindows.last().start + chWindows.last().length)){
+                chWindows.last().length = quint32(end - chWindows.last().start);
+            }
+            else{
+                chWindows.append({quint32(start), quint32(end - start)});
+            }
+            j += WAVEFORM_LENGTH;
+        }
+
+        // 每块统计窗口以外的采样，窗口把块分成几段，每段内不再逐点判断窗口
+        QVector<ZsBlock>& chBlocks = blocks[ch];
+        chBlocks.resize(blockCount);
+        int windowIndex = 0;
+        for (qint64 b = 0; b < blockCount; ++b){
+            qint64 blockEnd = qMin(samples, (b + 1) * blockSamples);
+            qint64 sum = 0, sumSquares = 0, count = 0;
+            int minValue = 65535, maxValue = 0;
+            auto accumulate = [&](qint64 from, qint64 to){
+                for (qint64 j = from; j < to; ++j){
+                    int v = at(j);
+                    sum += v;
+                    sumSquares += (qint64)v * v;
+                    minValue = qMin(minValue, v);
+                    maxValue = qMax(maxValue, v);
+                }
+                count += qMax<qint64>(0, to - from);
+            };
+
+            qint64 j = b * blockSamples;
+            while (windowIndex < chWindows.size() && (qint64)chWindows[windowIndex].start < blockEnd){
+                qint64 windowEnd = (qint64)chWindows[windowIndex].start + chWindows[windowIndex].length;
+                accumulate(j, chWindows[windowIndex].start);
+                j = qMax(j, windowEnd);
+                if (windowEnd > blockEnd)
+                    break;// 窗口延续到下一块
+                ++windowIndex;
+            }
+            accumulate(j, blockEnd);
+
+            ZsBlock& block = chBlocks[b];
+            if (count > 0){
+                double mean = double(sum) / count;
+                double variance = qMax(0.0, double(sumSquares) / count - mean * mean);
+                block.baseline = quint16(qBound(0.0, std::round(mean), 65535.0));
+                block.noise = quint16(qMin(65535.0, std::sqrt(variance) * 16));
+                block.minValue = quint16(minValue);
+                block.maxValue = quint16(maxValue);
+            }
+            else{
+                // 整块都在窗口内，用前一块的基线
+                block = (b > 0) ? chBlocks[b - 1] : ZsBlock{quint16(blockBaselines[0]), 0, 0, 0};
+            }
+        }
+
+        for (const ZsWindow& window : chWindows)
+            keptSamples[ch] += window.length;
+    }
+
+    // 组装输出
+    qint64 outSize = sizeof(ZsHeader) + 2 * kHeadBytes;
+    for (int ch = 0; ch < kChannels; ++ch)
+        outSize += blocks[ch].size() * sizeof(ZsBlock) + windows[ch].size() * sizeof(ZsWindow) + keptSamples[ch] * sizeof(quint16);
+    if (outSize >= size)
+        return QByteArray();// 触发太密集，压缩没有意义
+
+    QByteArray out(int(outSize), Qt::Uninitialized);
+    char* p = out.data();
+
+    ZsHeader header;
+    memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.rawSize = qToLittleEndian<quint32>(quint32(size));
+    header.samplesPerChannel = qToLittleEndian<quint32>(quint32(samples));
+    header.channels = qToLittleEndian<quint16>(kChannels);
+    header.headBytes = qToLittleEndian<quint16>(kHeadBytes);
+    header.blockSamples = qToLittleEndian<quint32>(quint32(blockSamples));
+    header.blockCount = qToLittleEndian<quint32>(quint32(blockCount));
+    for (int ch = 0; ch < kChannels; ++ch){
+        header.windowCount[ch] = qToLittleEndian<quint32>(quint32(windows[ch].size()));
+        header.keptSamples[ch] = qToLittleEndian<quint32>(keptSamples[ch]);
+    }
+    header.threshold = qToLittleEndian<qint32>(options.threshold);
+    header.prePoints = qToLittleEndian<quint16>(quint16(options.prePoints));
+    header.postPoints = qToLittleEndian<quint16>(quint16(options.postPoints));
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+
+    memcpy(p, frame, kHeadBytes);
+    memcpy(p + kHeadBytes, frame + size - kHeadBytes, kHeadBytes);
+    p += 2 * kHeadBytes;
+
+    for (int ch = 0; ch < kChannels; ++ch){
+        for (const ZsBlock& block : blocks[ch]){
+            ZsBlock le = {qToLittleEndian(block.baseline), qToLittleEndian(block.noise), qToLittleEndian(block.minValue), qToLittleEndian(block.maxValue)};
+            memcpy(p, &le, sizeof(le));
+            p += sizeof(le);
+        }
+    }
+
+    for (int ch = 0; ch < kChannels; ++ch){
+        for (const ZsWindow& window : windows[ch]){
+            ZsWindow le = {qToLittleEndian(window.start), qToLittleEndian(window.length)};
+            memcpy(p, &le, sizeof(le));
+            p += sizeof(le);
+
+            // 原始采样本身就是小端，直接拷贝
+            quint16* dst = reinterpret_cast<quint16*>(p);
+            for (quint32 i = 0; i < window.length; ++i)
+                dst[i] = src[sampleIndex(ch, window.start + i)];
+            p += window.length * sizeof(quint16);
+        }
+    }
+
+    return out;
+}
+
+bool ZeroSuppressor::isSuppressed(const QByteArray& fileData)
+{
+    return fileData.size() >= (int)sizeof(ZsHeader) && memcmp(fileData.constData(), kMagic, sizeof(kMagic)) == 0;
+}
+
+QByteArray ZeroSuppressor::expand(const QByteArray& fileData)
+{
+    if (!isSuppressed(fileData))
+        return QByteArray();
+
+    ZsHeader header;
+    memcpy(&header, fileData.constData(), sizeof(header));
+    const qint64 rawSize = qFromLittleEndian(header.rawSize);
+    const qint64 samples = qFromLittleEndian(header.samplesPerChannel);
+    const qint64 blockSamples = qFromLittleEndian(header.blockSamples);
+    const qint64 blockCount = qFromLittleEndian(header.blockCount);
+    if (qFromLittleEndian(header.channels) != kChannels || qFromLittleEndian(header.headBytes) != kHeadBytes
+        || blockSamples <= 0 || rawSize != samples * kChannels * 2 + 2 * kHeadBytes)
+        return QByteArray();
+
+    const char* p = fileData.constData() + sizeof(header);
+    const char* end = fileData.constData() + fileData.size();
+    if (end - p < 2 * kHeadBytes + blockCount * kChannels * (qint64)sizeof(ZsBlock))
+        return QByteArray();
+
+    QByteArray raw(int(rawSize), Qt::Uninitialized);
+    memcpy(raw.data(), p, kHeadBytes);
+    memcpy(raw.data() + rawSize - kHeadBytes, p + kHeadBytes, kHeadBytes);
+    p += 2 * kHeadBytes;
+
+    // 先用每块基线填充
+    quint16* dst = reinterpret_cast<quint16*>(raw.data() + kHeadBytes);
+    for (int ch = 0; ch < kChannels; ++ch){
+        for (qint64 b = 0; b < blockCount; ++b){
+            ZsBlock block;
+            memcpy(&block, p, sizeof(block));
+            p += sizeof(block);
+
+            quint16 baseline = block.baseline;// 已经是小端
+            qint64 blockEnd = qMin(samples, (b + 1) * blockSamples);
+            for (qint64 j = b * blockSamples; j < blockEnd; ++j)
+                dst[sampleIndex(ch, j)] = baseline;
+        }
+    }
+
+    // 再写回窗口内的原始采样
+    for (int ch = 0; ch < kChannels; ++ch){
+        quint32 windowCount = qFromLittleEndian(header.windowCount[ch]);
+        for (quint32 w = 0; w < windowCount; ++w){
+            if (end - p < (qint64)sizeof(ZsWindow))
+                return QByteArray();
+            ZsWindow window;
+            memcpy(&window, p, sizeof(window));
+            p += sizeof(window);
+
+            qint64 start = qFromLittleEndian(window.start);
+            qint64 length = qFromLittleEndian(window.length);
+            if (start + length > samples || end - p < length * (qint64)sizeof(quint16))
+                return QByteArray();
+
+            const quint16* samplesData = reinterpret_cast<const quint16*>(p);
+            for (qint64 i = 0; i < length; ++i)
+                dst[sampleIndex(ch, start + i)] = samplesData[i];
+            p += length * sizeof(quint16);
+        }
+    }
+
+    return raw;
+}
+
+bool ZeroSuppressor::keepRaw(quint32 frameNo, quint32 faults, const ZeroSuppressOptions& options)
+{
+    if (faults != 0)
+        return true;
+    return options.rawEvery > 0 && (frameNo - 1) % options.rawEvery == 0;
+}
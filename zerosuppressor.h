@@ -0,0 +1,73 @@
+﻿#ifndef ZEROSUPPRESSOR_H
+#define ZEROSUPPRESSOR_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+// 零压缩参数
+struct ZeroSuppressOptions {
+    int threshold = 100;        // 触发阈值（扣基线后），应低于离线分析使用的阈值
+    int prePoints = 64;         // 触发点之前保留的点数
+    int postPoints = 64;        // 一个波形长度（WAVEFORM_LENGTH）之后再保留的点数
+    int blockSamples = 65536;   // 基线统计块长度（每通道点数），触发阈值按块基线计算
+    int rawEvery = 100;         // 每隔多少帧保留一帧原始数据，0为不保留（校验失败的帧总是保留原始数据）
+};
+
+/**
+ * ZeroSuppressor 波形零压缩
+ * 采集时对每帧波形按离线提取（DataAnalysisWorker::overThreshold）相同的规则找触发点，阈值为所在统计块的基线（众数）加threshold，
+ * 只保存触发窗口内的原始采样，窗口以外每个统计块只保存基线、噪声和最大最小值，文件名不变（%1%2data%3.bin）。
+ *
+ * 文件格式（小端）：
+ *   ZsHeader
+ *   原始帧头12字节 + 帧尾12字节
+ *   基线记录：通道0~2依次，每通道blockCount个ZsBlock
+ *   触发窗口：通道0~2依次，每个窗口ZsWindow后跟length个quint16原始采样（通道内的采样序号）
+ *
+ * 读取时用expand还原成原始帧格式（窗口以外用所在块的基线填充），
+ * DataAnalysisWorker::readBin3Ch_fast会自动识别并还原，离线分析流程不需要修改。
+ * 帧CRC（%1%2crc.txt）仍然是原始帧的CRC，零压缩文件不能用它校验。
+ */
+class ZeroSuppressor
+{
+public:
+#pragma pack(push, 1)
+    struct ZsHeader {
+        char magic[8];              // "NCZSUP01"
+        quint32 rawSize;            // 原始帧字节数
+        quint32 samplesPerChannel;
+        quint16 channels;           // 3
+        quint16 headBytes;          // 12
+        quint32 blockSamples;
+        quint32 blockCount;         // 每通道
+        quint32 windowCount[3];
+        quint32 keptSamples[3];     // 窗口内的采样数
+        qint32 threshold;
+        quint16 prePoints;
+        quint16 postPoints;
+    };
+
+    struct ZsBlock {
+        quint16 baseline;           // 窗口以外采样的均值
+        quint16 noise;              // 窗口以外采样的均方根偏差，单位1/16
+        quint16 minValue;
+        quint16 maxValue;
+    };
+
+    struct ZsWindow {
+        quint32 start;
+        quint32 length;
+    };
+#pragma pack(pop)
+
+    /*压缩一帧波形，帧格式不符合时返回空，调用者应保存原始数据*/
+    static QByteArray encode(const char* frame, qint64 size, const ZeroSuppressOptions& options);
+    /*是否为零压缩文件*/
+    static bool isSuppressed(const QByteArray& fileData);
+    /*还原成原始帧格式，失败返回空*/
+    static QByteArray expand(const QByteArray& fileData);
+    /*该帧是否保留原始数据*/
+    static bool keepRaw(quint32 frameNo, quint32 faults, const ZeroSuppressOptions& options);
+};
+
+#endif // ZEROSUPPRESSOR_H